@@ -138,7 +138,11 @@ public:
   RWBoolean			operator<=(const RWBinaryTree& bt) const; // Subset of bt
   RWBoolean			operator==(const RWBinaryTree& bt) const;
 
-  // Special member function to balance a binary tree:
+  /*
+   * The tree is kept height balanced (an AVL tree) as items are
+   * inserted and removed, so lookups stay logarithmic whatever the
+   * insertion order.  balance() rebuilds it as a complete tree.
+   */
   void				balance();
 
 /********  Standard Member Functions for Collection Classes ********/  
@@ -163,9 +167,12 @@ protected:
   void				balanceUnique();
   RWTreeNode*	        	balanceChildren(size_t, RWGQueue(RWCollectable)&);
   void				countChildren(const RWTreeNode*, size_t&) const;
+  size_t			countMatches(const RWTreeNode*, const RWCollectable*) const;
   void				deleteChildren(RWTreeNode*);
-  RWCollectable*		deleteNode(RWTreeNode* victim, RWTreeNode* parent);
+  RWTreeNode*			insertChild(RWTreeNode*, RWCollectable*);
   void				insertChildrenOf(const RWTreeNode*);
+  RWTreeNode*			removeChild(RWTreeNode*, const RWCollectable*, RWCollectable*&);
+  RWTreeNode*			removeLeftmost(RWTreeNode*, RWTreeNode*&);
   void				levelApply(RWapplyCollectable, void*);
 
 private:
@@ -191,6 +198,7 @@ protected:
   RWGStack(RWTreeNode)		stack;
 private:
   void				descendLeft();
+  const RWTreeNode*		lowerBound(const RWCollectable*) const;
 public:
   RWBinaryTreeIterator(const RWBinaryTree&);
   virtual ~RWBinaryTreeIterator();
@@ -217,10 +225,17 @@ friend class RWExport RWBinaryTreeIterator;
   RWTreeNode*		right;	// Pointer to right node.
   RWTreeNode*		left;   // Pointer to left node.
   RWCollectable*	e;      // Pointer to RWCollectable object.
+  unsigned		height;	// Height of the subtree rooted here.
 private:
   // Private constructor:
   RWTreeNode(RWCollectable* a, RWTreeNode* p=rwnil, RWTreeNode* n=rwnil) 
-    { e = a; left = p; right = n; }
+    { e = a; left = p; right = n; height = 1; }
+
+  static unsigned	heightOf(const RWTreeNode* t) { return t ? t->height : 0; }
+  void			fixHeight();
+  RWTreeNode*		rebalance();
+  RWTreeNode*		rotateLeft();
+  RWTreeNode*		rotateRight();
 };
 
 #endif /* __RWBINTREE_H__ */
@@ -100,6 +100,7 @@ class RWExport RWBTreeDictionary : public RWBTree {
 public:
 
   RWBTreeDictionary();
+  RWBTreeDictionary(unsigned order);
   RWBTreeDictionary(const RWBTreeDictionary&);
   void			operator=(const RWBTreeDictionary&);
 
@@ -95,7 +95,7 @@
 #include "rw/colclass.h"
 #include "rw/mempool.h"
 
-// Set the order of the B-Tree:
+// Set the default order of the B-Tree:
 #ifdef RDEBUG
   const unsigned rworder  = 2;
 #else
@@ -103,22 +103,44 @@
 #endif
   const unsigned rworder2 = 2*rworder;
 
+// Forward declaration:
+class RWExport RWBTree;
+
 /****************************************************************
  *								*
  *			RWBTreeNode				*
  *								*
  ****************************************************************/
 
+/*
+ * A key slot: the item, together with a copy of its ordering
+ * prefix (see RWCollectable::orderingPrefix()) so that most
+ * comparisons made while searching a node can be settled without
+ * touching the item itself.
+ */
+struct RWBTreeKey {
+  unsigned long		prefix;
+  RWCollectable*	item;
+};
+
+/*
+ * Nodes are variable sized, depending on the order of their tree.
+ * Each is carved from a block from the memory pool, rounded up to,
+ * and aligned on, a cache line; the key slots and then the child
+ * pointers follow the header directly.
+ */
 class RWExport RWBTreeNode   RWMemoryPool_OPTION {
 friend class RWExport RWBTree;
 
-  RWBTreeNode();			// Private constructors.
-  RWBTreeNode(RWCollectable*);
-  unsigned	counter;		// How many of the [rworder2] fields are used.
-  RWCollectableP key[rworder2];		// Array of pointers keys.
-  RWBTreeNode*	next[rworder2+1];	// Array of pointers to children nodes.
-  unsigned	binarySearch(const RWCollectable*) const; 	// Binary search for insertion.
-  void		initialize();
+  unsigned	counter;		// How many of the 2*order fields are used.
+  RWBTreeKey*	key;			// Array of 2*order keys.
+  RWBTreeNode**	next;			// Array of 2*order+1 pointers to children nodes.
+  char*		block;			// Allocation holding self.
+
+  static RWBTreeNode*	create(unsigned order);
+  static void		destroy(RWBTreeNode*, unsigned order);
+  unsigned	binarySearch(const RWBTreeKey&, RWBoolean) const; 	// Binary search for insertion.
+  int		compare(unsigned, const RWBTreeKey&, RWBoolean) const;
   void		siz(size_t&) const;	// Count items in self & children.
   RWBoolean	subSetOf(const RWBTree& bt) const;
 };
@@ -136,6 +158,7 @@ class RWExport RWBTree : public RWCollection {
 public:
 
   RWBTree();
+  RWBTree(unsigned order);		// Nodes hold order to 2*order items
   virtual ~RWBTree();
   RWBTree(const RWBTree&);
 
@@ -145,6 +168,7 @@ public:
 
 // Special member function to return the height of the B-tree.
   unsigned			height() const;
+  unsigned			order() const	{return order_;}
 
 /************ Standard Collection classes functions **************/
   virtual void			apply(RWapplyCollectable, void*);
@@ -163,16 +187,18 @@ public:
 private:
 
   RWBTreeNode*		root;			// root = first node in tree.
-  RWCollectable* 	tempKey;		// Place holder to handle node over- and underflow
+  unsigned		order_;			// Minimum keys in a non-root node.
+  RWBoolean		prefixed_;		// All keys have ordering prefixes.
+  RWBTreeKey	 	tempKey;		// Place holder to handle node over- and underflow
   RWBTreeNode*		tempNode;		// Place holder to handle node over- and underflow
 
 protected:
 
   void			apl(RWBTreeNode*, RWapplyCollectable, void*);	// Apply to all children
   void			del(RWBTreeNode*);				// Delete all children.
-  int			ins(RWCollectable* a, RWBTreeNode*);		// Insert a in tree.
-  int			rem(const RWCollectable* a, RWBTreeNode*, RWCollectable*&); // Remove a
+  int			ins(const RWBTreeKey&, RWBTreeNode*);		// Insert a in tree.
+  int			rem(const RWBTreeKey&, RWBoolean, RWBTreeNode*, RWCollectable*&); // Remove a
+  RWBoolean		probe(const RWCollectable*, RWBTreeKey&) const;
 };    
 			 
 #endif /* __RWBTREE_H__ */
-
@@ -71,30 +71,43 @@
  */
 
 #include "rw/vpage.h"
+#include "rw/iostats.h"
 STARTWRAP
 #include <stddef.h>
 ENDWRAP
 
+class RWPageBuffer;
+
+/*
+ * Pages are found in the buffers through a hash table on their
+ * handles, and a buffer is chosen for reuse by the CLOCK algorithm:
+ * a hand sweeps the buffers, passing over locked ones and giving
+ * those referenced since its last visit a second chance.  lock() and
+ * unlock() therefore take the same time however many buffers there
+ * are.  A dirty page is swapped out when its buffer is reused.
+ */
 class RWExport RWBufferedPageHeap : public RWVirtualPageHeap {
   unsigned		nBuffers_;	// Number of buffers (each is pageSize() big)
-  RWvoid*		buffers_;	// Points to an array of pointers to buffers
-  RWHandle*		handles_;	// Page handle associated with each buffer
-  short*		lockCounts_;	// Lock count for each buffer
-  unsigned*		age_;		// Age of buffer since accessed
-  RWBoolean*		dirty_;		// Whether this buffer has changed since swap in
+  RWPageBuffer*		slots_;		// The buffers and what they hold
+  size_t*		buckets_;	// Handle hash -> first slot in chain
+  unsigned		nbuckets_;	// Power of 2
+  size_t		unused_;	// Chain of slots holding no page
+  size_t		hand_;		// The clock hand
+  RWPageHeapStatistics	stats_;		// Lock hits, swaps and evictions
 protected:
-  size_t		ageAndFindHandle(RWHandle);	// Find slot for given handle and age all slots
   size_t		findHandle(RWHandle);		// Find slot for given handle
   size_t		findUnusedSlot();		// Find an unused slot
   size_t		swapPageIn(RWHandle);		// Swap in page with given handle
-  size_t		swapOutLRUSlot();		// Swap out the Least Recently Used page
+  size_t		swapOutVictim();		// Free a slot chosen by the clock
   virtual RWBoolean	swapIn(RWHandle, void*)  = 0;	// Supplied by specializing class
   virtual RWBoolean	swapOut(RWHandle, void*) = 0;
 public:
   RWBufferedPageHeap(unsigned pgsize, unsigned nbufs=10);
   virtual		~RWBufferedPageHeap();
 
-  RWBoolean		isValid()		{return buffers_!=NULL;}
+  RWBoolean		isValid()		{return slots_!=rwnil;}
+  void			resetStatistics()	{stats_.reset();}
+  const RWPageHeapStatistics& statistics() const {return stats_;}
 
   // Inherited from RWVirtualPageHeap:
   virtual RWHandle	allocate()           = 0;	// Allocate a page
@@ -102,6 +115,11 @@ public:
   virtual void		dirty(RWHandle);		// Declare page as dirty
   virtual void*		lock(RWHandle);			// Lock a page
   virtual void		unlock(RWHandle);		// Unlock a page
+
+private:
+  unsigned		hashHandle(RWHandle) const;
+  void			hashInsert(size_t);
+  void			hashRemove(size_t);
 };
 
 #endif	/* __RWBUFPAGE_H__ */
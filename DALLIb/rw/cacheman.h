@@ -78,28 +78,115 @@
  */
 
 #include "rw/tooldefs.h"
+#include "rw/iostats.h"
+
+class RWCacheReplacer;
 
 class RWExport RWCacheManager
 {
 
 public:
 
-  RWCacheManager(RWFile* file, unsigned blocksz, unsigned mxblks = 10);
+  /* policyMode selects the block replacement policy:
+   *  LRUPolicy	   -- Exact least recently used order.  Default
+   *  ClockPolicy  -- One-bit approximation of LRU (second chance)
+   *  TwoQPolicy   -- Scan resistant 2Q: blocks touched only once are
+   *		      evicted before blocks that have been re-referenced
+   * All three make their decisions in constant time.
+   */
+  enum policyMode	{LRUPolicy, ClockPolicy, TwoQPolicy};
+
+  /*
+   * address() returns a pointer to a block without copying it, if one
+   * is available: either a cached copy or, if the file is memory mapped,
+   * the mapping itself.  Otherwise it returns rwnil and read() must be
+   * used.  The pointer is good until the next call to the cache manager.
+   * If the file is memory mapped, blocks which are not already cached
+   * are read from and written to the mapping directly, bypassing the
+   * cache slots.
+   *
+   * pin() loads a block into a slot, if it is not already there, and
+   * keeps it from being chosen for replacement until the matching
+   * unpin(); the pointer it returns stays good, and current with any
+   * write() to the block, for that long.  It returns rwnil if every
+   * slot is already pinned.  Reads and writes of other blocks then go
+   * straight to the file.
+   *
+   * Misses at consecutive block addresses are taken to be a sequential
+   * scan.  The next readahead() blocks are then fetched with a single
+   * read and the system is advised that the window after them will be
+   * wanted.  readahead(n) sets the window (0 or 1 turns it off) and
+   * returns the old setting.  It starts off: a window caches blocks
+   * nobody asked for, so it is only safe for an owner that writes
+   * every block through the cache.  prefetch() is given a set of
+   * blocks about to be visited, such as the sons of a B-Tree node, and
+   * hints the ones not already cached to the system, coalesced into
+   * runs.
+   *
+   * retain() marks a cached block as one to be kept, such as an
+   * interior node of a B-Tree.  Up to keep() blocks are held as though
+   * pinned, the least recently retained giving way to newcomers, so
+   * that a scan cannot push them out.  keep(n) sets the number, at most
+   * half the slots, and returns the old one; the default is 0.
+   *
+   * resize() changes the number of slots without losing the blocks
+   * already cached, as many as fit, pinned and kept blocks first.  The
+   * pointers handed out by pin() and address() are then stale.
+   *
+   * lookup(), fetch() and install() split read() up for a caller
+   * that locks the cache manager but not the file.  lookup() copies
+   * a block that is cached or mapped and otherwise returns FALSE.
+   * fetch() reads the block from the file without touching the cache,
+   * so needs no lock if the file sharesReads(), and install() then
+   * puts it in a slot.  There is no readahead on this path.
+   *
+   * statistics() counts requests, hits, evictions and the traffic to
+   * the file.  The cache writes through, so every write() reaches it.
+   */
+
+  RWCacheManager(RWFile* file, unsigned blocksz, unsigned mxblks = 10,
+		 policyMode policy = LRUPolicy);
   ~RWCacheManager();
 
+  const char*		address(RWoffset locn); // Zero-copy; see below
+  RWBoolean		fetch(RWoffset locn, void* dat);	// See above
   RWBoolean		flush();	// Perform any pending writes.
+  void			prefetch(const RWoffset* locns, size_t n);
+  void			install(RWoffset locn, const void* dat);
   void			invalidate();	// Invalidate the entire cache
+  unsigned		keep() const {return keepMax_;}
+  unsigned		keep(unsigned blocks);	// Returns old value
+  RWBoolean		lookup(RWoffset locn, void* dat);
+  unsigned		maxBlocks() const {return maxblocks_;}
+  const char*		pin(RWoffset locn);	// See above
+  policyMode		policy() const {return policy_;}
   RWBoolean		read(RWoffset locn, void* dat);
+  unsigned		readahead() const {return ahead_;}
+  unsigned		readahead(unsigned blocks);	// Returns old value
+  void			resetStatistics()	{stats_.reset();}
+  void			resize(unsigned mxblks);	// See above
+  void			retain(RWoffset locn);	// See above
+  const RWCacheStatistics& statistics() const	{return stats_;}
+  void			unpin(RWoffset locn);
   RWBoolean		write(RWoffset locn, void* dat);
 
 private:
 
   RWCacheManager(const RWCacheManager&); // Private to insure no copies
   void			operator=(const RWCacheManager&); // Ditto
-  size_t		ageAndFindSlot(RWoffset);
+  size_t		findSlot(RWoffset) const;
+  RWBoolean		fileRead(RWoffset, void*, size_t);
+  RWBoolean		fileWrite(RWoffset, const void*, size_t);
   RWBoolean		flush(unsigned);
   size_t		getFreeSlot();
-  size_t		LRU() const; // Find least recently used block
+  RWBoolean		readWindow(RWoffset locn, void* dat);
+  unsigned		hashOffset(RWoffset) const;
+  void			hashInsert(size_t);
+  void			hashRemove(size_t);
+  void			keepLink(size_t);
+  void			keepUnlink(size_t);
+  void			allocSlots();
+  void			freeSlots();
 
 private:
 
@@ -108,8 +195,24 @@ private:
   unsigned		nused_;	    // Number being used.
   unsigned		blocksize_; // Size of a block
   RWoffset*		diskAddrs_; // Its disk address
-  unsigned*		useCounts_; // Use count for the block
   char*			buff_;	    // The set of blocks.
+  policyMode		policy_;    // Which replacement policy is in use
+  RWCacheReplacer*	replacer_;  // Implementation of the policy
+  unsigned		nbuckets_;  // Size of the offset->slot hash (power of 2)
+  size_t*		buckets_;   // First slot in each hash chain
+  size_t*		hashNext_;  // Next slot in the same hash chain
+  unsigned*		pins_;	    // Pin count of each slot
+  unsigned		ahead_;	    // Readahead window, in blocks
+  RWoffset		nextMiss_;  // Miss address that continues a scan
+  char*			kept_;	    // TRUE if retain()ed and not yet dropped
+  size_t*		keepPrev_;  // Kept blocks, most recently retained at
+  size_t*		keepNext_;  //   keepHead_
+  size_t		keepHead_;
+  size_t		keepTail_;
+  unsigned		nkept_;
+  unsigned		keepMax_;
+  char*			stage_;	    // Buffer for a readahead window
+  RWCacheStatistics	stats_;
 };
 
 #endif
@@ -124,6 +124,7 @@ public:
   virtual int			compareTo(const RWCollectable*) const;
   virtual unsigned		hash() const;
   virtual RWBoolean		isEqual(const RWCollectable*) const;
+  virtual RWBoolean		orderingPrefix(unsigned long&) const;
   virtual void			restoreGuts(RWvistream&);
   virtual void			restoreGuts(RWFile&);
   virtual void			saveGuts(RWvostream&) const;
@@ -157,6 +158,7 @@ public:
    virtual unsigned		hash() const;
    virtual int			compareTo(const RWCollectable*) const;
    virtual RWBoolean		isEqual(const RWCollectable* c) const;
+   virtual RWBoolean		orderingPrefix(unsigned long&) const;
 };
       
 #endif /* __RWCOLLASS_H__ */
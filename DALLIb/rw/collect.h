@@ -239,6 +239,7 @@ public:
   virtual int			compareTo(const RWCollectable*) const;
   virtual unsigned		hash() const;
   virtual RWBoolean		isEqual(const RWCollectable*) const;
+  virtual RWBoolean		orderingPrefix(unsigned long&) const;
   virtual void			restoreGuts(RWFile&);
   virtual void			restoreGuts(RWvistream&);
   virtual void			saveGuts(RWFile&) const;
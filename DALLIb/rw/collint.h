@@ -107,6 +107,7 @@ public:
   virtual int			compareTo(const RWCollectable*) const;
   virtual unsigned		hash() const;
   virtual RWBoolean		isEqual(const RWCollectable*) const;
+  virtual RWBoolean		orderingPrefix(unsigned long&) const;
   virtual void			restoreGuts(RWvistream&);
   virtual void			restoreGuts(RWFile&);
   virtual void			saveGuts(RWvostream&) const;
@@ -114,6 +114,7 @@
 
 #include "rw/cacheman.h"
 #include "rw/filemgr.h"
+#include "rw/iostats.h"
 #include "rw/mempool.h"
 #include "rw/cstring.h"
 #ifdef RDEBUG
@@ -121,13 +122,25 @@
 #endif
 
 typedef void	(*RWdiskTreeApply)  (const char*, RWstoredValue, void*);
+/*
+ * Supplies keys to bulkLoad() and sortAndLoad(): set key and val and
+ * return TRUE, or return FALSE when there are no more.  The key need
+ * only stay valid until the next call.
+ */
+typedef RWBoolean (*RWdiskTreeSource)(const char*& key, RWstoredValue& val, void*);
 extern "C" {
   typedef int	(*RWdiskTreeCompare)(const char*, const char*, size_t);
 }
 
 const RWstoredValue RWBTreeOnDiskCurrentVersion = 0x200;
+const RWstoredValue RWBTreeOnDiskPackedVersion  = 0x300;
 
 class RWExport RWDiskTreeNode;
+class RWExport RWDiskTreeLoader;
+class RWExport RWBTreeOnDiskCursor;
+class RWDiskTreeShadow;
+class RWDiskTreeFilter;
+class RWDiskTreeUpdate;
  
 /****************************************************************
  *								*
@@ -137,16 +150,26 @@ class RWExport RWDiskTreeNode;
 
 class RWExport RWBTreeOnDisk {
 friend class RWExport RWDiskTreeNode;
+friend class RWExport RWDiskTreeLoader;
+friend class RWExport RWBTreeOnDiskCursor;
+friend class RWDiskTreeUpdate;
 
 public:
   /* styleMode means:
    *  V6Style	   -- Use the V 6.x and above version. Default
    *  V5Style	   -- Use the V 5.x and below version.
+   *  PackedStyle  -- Keys of any length up to keylen, stored on disk
+   *		      without padding and each with the prefix it
+   *		      shares with the one before it left out.  A node
+   *		      holds as many keys as fit in a fixed page, the
+   *		      size of a V6Style node of the same order and
+   *		      keylen, or more if keylen is large for the order.
+   *		      minorder is unused.
    * createMode means:
    *  autoCreate   -- Look at start arg. If valid use, else create new
    *  create	   -- Ignore start arg. Build new tree in the FileManger
    */
-  enum styleMode	{V6Style, V5Style};
+  enum styleMode	{V6Style, V5Style, PackedStyle};
   enum createMode	{autoCreate, create};
 
   RWBTreeOnDisk(RWFileManager&,	  // No default possible!
@@ -162,15 +185,87 @@ public:
 
   ~RWBTreeOnDisk();
 
-  void			applyToKeyAndValue(RWdiskTreeApply ap, void* x)
-	{ apl(baseInfo.rootLoc, ap, x); }
+  void			applyToKeyAndValue(RWdiskTreeApply ap, void* x);
   RWoffset		baseLocation() const
 	{ return baseLoc; }
+  /*
+   * bloomFilter(TRUE) gives the tree a Bloom filter over its keys,
+   * kept in the same file, so that most lookups of keys which are not
+   * there are answered without searching the tree: about one in a
+   * hundred still are.  It is kept up to date by the changes to the
+   * tree, rebuilt when it fills, and reopened with the tree; one left
+   * behind by a crash is rebuilt.  Not for V5Style trees.  Each
+   * returns the old setting.  The filter works on the key bytes, so
+   * it is ignored while setComparison() has replaced the tree's own
+   * byte comparison; it is still kept up to date.
+   */
+  RWBoolean		bloomFilter() const
+	{ return filter != rwnil; }
+  RWBoolean		bloomFilter(RWBoolean);
+  /*
+   * bulkLoad() replaces the contents of the tree with keys delivered in
+   * ascending order, building it bottom up with each node packed to
+   * fill (0 < fill <= 1) of its capacity.  Duplicates are skipped.
+   * sortAndLoad() accepts keys in any order, sorting them first in
+   * runs of at most memory bytes.  Both return the number of entries.
+   */
+  unsigned long		bulkLoad(RWdiskTreeSource src, void* x, double fill = 1.0);
+  unsigned long		bulkLoad(const char* const* keys, const RWstoredValue* vals,
+				 unsigned long n, double fill = 1.0);
   void			clear();
+  /*
+   * The cache holds cacheCount() nodes, cacheBytes() bytes.  Either
+   * may be changed at any time, without losing the nodes already
+   * cached; each returns the old setting.  Interior nodes are kept in
+   * up to half the cache, where a scan of the leaves cannot push them
+   * out.  Should they not all fit, the least recently used give way,
+   * so the upper levels stay.  Once they are all in, a lookup reads
+   * at most the leaf it ends at.
+   */
+  unsigned long		cacheBytes() const
+	{ return (unsigned long)cacheBlocks * diskNodeSize; }
+  unsigned long		cacheBytes(unsigned long bytes);
   unsigned		cacheCount() const { return cacheBlocks; }
+  /*
+   * cachePolicy(p) changes the replacement policy of the node cache
+   * (see RWCacheManager::policyMode), emptying it; it returns the old
+   * policy.  The default is RWCacheManager::LRUPolicy.
+   */
+  RWCacheManager::policyMode cachePolicy() const
+	{ return cmgr->policy(); }
+  RWCacheManager::policyMode cachePolicy(RWCacheManager::policyMode p);
+  /*
+   * compact() moves nodes into free space nearer the front of the file,
+   * taking them in key order so that a scan of the tree reads the file
+   * more or less sequentially.  Each call visits about maxNodes nodes
+   * (0 for no limit), so the tree need only be set aside briefly, and
+   * returns TRUE when a pass over the whole tree is complete and the
+   * file has been cut back; the next call then starts another pass.
+   * In between, the tree may be used and changed as usual.  Each call
+   * is an update, so in copy-on-write mode lookups carry on alongside
+   * it.  Only files with the current style of free list can be
+   * compacted; see RWFileManager::allocateBelow().
+   */
+  RWBoolean		compact(unsigned long maxNodes = 0);
   unsigned		cacheCount(unsigned blocks);
+  const RWCacheStatistics& cacheStatistics() const
+	{ return cmgr->statistics(); }
   RWBoolean		contains(const char* key) const
 	{RWCString rK; RWstoredValue rV; return (findKeyAndValue(key, rK, rV) ? TRUE : FALSE); }
+  /*
+   * In copy-on-write mode a change never overwrites a node in place:
+   * modified nodes, and their ancestors, are written to new space and
+   * the new root is published when the change is complete.  Lookups
+   * (findKeyAndValue() and the members built on it, and height()) then
+   * see a consistent snapshot and, when compiled with RW_MULTI_THREAD,
+   * may run in any number of threads alongside one another and alongside
+   * changes, which are serialized.  Space given up by a change is
+   * recycled once no lookup can still be looking at it.  Cursors are
+   * not covered, and applyToKeyAndValue() does not write values back.
+   */
+  RWBoolean		copyOnWrite() const
+	{ return shadow != rwnil; }
+  RWBoolean		copyOnWrite(RWBoolean);	// Returns old setting
   unsigned long		entries() const;		// Total entries
   RWoffset		extraLocation(RWoffset off)
 	{ RWoffset r = baseInfo.extraLoc; baseInfo.extraLoc=off; return r; }
@@ -181,6 +276,17 @@ public:
   RWBoolean		findKeyAndValue(const char* key, RWCString&, RWstoredValue&) const;
   RWstoredValue		findValue(const char* key) const
 	{ RWCString retK; RWstoredValue ret; return(findKeyAndValue(key,retK,ret)) ? ret : RWNIL ;}
+  /*
+   * findValues() looks up keys[0..n-1] together, in one walk of the
+   * tree in key order, so that a node shared by several of them is
+   * visited once, and the sons of a node are visited in the order they
+   * lie in the file.  vals[i] is set to the value of keys[i], or RWNIL,
+   * and found[i], if found is not nil, to whether it is there.  Returns
+   * the number found.
+   */
+  unsigned long		findValues(const char* const* keys, unsigned long n,
+				   RWstoredValue* vals,
+				   RWBoolean* found = rwnil) const;
   unsigned		height() const;
   RWBoolean		insertKeyAndValue(const char*key, RWstoredValue val);
   RWBoolean		isEmpty() const
@@ -189,7 +295,7 @@ public:
 	{ return baseInfo.keylen; }
   unsigned		minOrder() const
 	{ return baseInfo.minorder; }
-  unsigned		nodeSize();
+  unsigned		nodeSize();		// on disk
   unsigned		occurrencesOf(const char* key) const
 	{ return contains(key) ? 1 : 0; }
   unsigned		order() const
@@ -200,9 +306,20 @@ public:
   RWBoolean		removeKeyAndValue(const char* key, RWstoredValue& retVal)
 	{ RWCString retK; return removeKeyAndValue(key, retK, retVal); }
   RWBoolean		replaceValue(const RWCString& key, const RWstoredValue newval, RWstoredValue& oldVal);
+  /*
+   * statistics() counts lookups and the nodes they visit, changes,
+   * node reads and writes, splits and merges; cacheStatistics() those
+   * of the cache manager.  resetStatistics() clears both.
+   */
+  void			resetStatistics();
   RWoffset		rootLocation() const
 	{ return baseLoc; }
   RWdiskTreeCompare	setComparison(RWdiskTreeCompare cf);
+  unsigned long		sortAndLoad(RWdiskTreeSource src, void* x,
+				    unsigned long memory = 1048576L,
+				    double fill = 1.0);
+  const RWDiskTreeStatistics& statistics() const
+	{ return *stats; }
   RWstoredValue		version()
 	{ return (RWNIL == baseInfo.version) ? 0 : baseInfo.version; }
 #ifdef RDEBUG
@@ -215,20 +332,29 @@ private:
 public:
 
   /******* used as signal during recursion unwrap ******/
-  enum retStatus {more, success, ignored};
+  enum retStatus {more, success, ignored, split};
 
 private:
   RWDiskTreeNode*	root;			// root = first node in tree.
   RWDiskTreeNode*	workNode;		// node currently in memory
+  RWDiskTreeNode*	viewNode;		// zero-copy look at a node
   RWoffset		workOffset;		// that node's disk location
   RWdiskTreeCompare	compareKeys;		// Compare function for keys
   char*			moreKey;		// Hold over/under-flow key
   RWstoredValue		moreItem;		// Hold over/under-flow item
   RWoffset		moreOffset;		// Hold o/u-flow disk offset
   RWoffset		baseLoc;		// offset to baseInfo in fmgr
+  RWDiskTreeShadow*	shadow;			// copy-on-write state, or rwnil
+  RWDiskTreeFilter*	filter;			// Bloom filter, or rwnil
 
   // information about the nodeRef pseudo-struct:
   unsigned		nodeRefSize;
+  unsigned		diskNodeSize;		// == nodeRefSize unless packed
+  unsigned		packLimit;		// most bytes in a packed node
+  char*			pageBuf;		// a packed node, on its way
+  RWDiskTreeStatistics*	stats;			// kept by const members too
+  char*			compactKey;		// compact() done up to here
+  RWBoolean		compacting;		// ... if a pass is under way
 
 private:
   // recursive functions to: apply, delete, insert or remove
@@ -237,14 +363,41 @@ private:
   retStatus		ins(const char* key, RWstoredValue val, RWoffset start);
   retStatus		rem(const char* key, RWoffset start, RWCString&, RWstoredValue&);
   // utility functions
+  void			abandonUpdate();	// endUpdate() after a throw
+  RWoffset		allocNode();
+  void			beginUpdate();		// copy-on-write bracketing
   void			combineNodes(int,RWoffset);// opposite of splitNode
+  RWBoolean		cpt(RWoffset, RWoffset, int, const char*,
+			    unsigned long&, RWBoolean&);	// compact()
+  void			countLookups(unsigned long, unsigned long) const;
+  void			empty();		// clear() without bracketing
+  void			endUpdate();
+  RWBoolean		excluded(const char* key) const; // by the filter
+  void			filterAdd(const char* key);
+  void			filterBuild(unsigned long capacity);
+  void			filterLoad();
+  void			filterSave(RWBoolean clean);
+  void			flt(RWoffset, RWDiskTreeFilter*); // filterBuild()
+  unsigned long		fnd(RWoffset, const char* const*, const unsigned long*,
+			    unsigned long, unsigned long,
+			    RWstoredValue*, RWBoolean*) const; // findValues()
+  void			fixSons(RWoffset, RWDiskTreeNode*);
+  void			freeNode(RWoffset);
+  void			growRoot();		// over moreXXX
   void			moveItLeft(int,RWoffset);  // lengthen left sib node
   void			moveItRight(int,RWoffset); // lengthen right sib node
+  void			putcache(RWoffset, RWDiskTreeNode*) const;
   void			readcache(RWoffset, RWDiskTreeNode*) const;
+  void			snapcache(RWoffset, RWDiskTreeNode*) const;
+  RWDiskTreeNode*	viewcache(RWoffset) const;
   void			writecache(RWoffset, RWDiskTreeNode*);
   void			readRoot();		// get root node from file
+  RWoffset		relocate(RWoffset, RWoffset, int); // move a node down
+  void			rebalance(int);		// restoreNode(), packed
   retStatus		restoreNode(int);	// if node got too small
+  retStatus		settle(RWBoolean written); // after a packed change
   void			splitNode(int loc);	// split at location loc
+  void			splitPacked();		// split by bytes
   void			swapWithSuccessor(int); // uses moreXXX
 /*
  * The next two functions are private to prevent copies: only one
@@ -270,14 +423,25 @@ protected:
     unsigned		keylen;		// length of keys
     unsigned		order;		// 1/2 max  entries per node
     unsigned		minorder;	// fewest allowed entries per node
-    RWoffset		reserved1;	// In case we ever want it
-    RWstoredValue	reserved2;	// ditto
-    unsigned long	flags;		// holds ignoreNulls for now
+    union {
+      RWoffset		reserved1;	// In case we ever want it
+      RWoffset		pageSize;	// bytes per node, if packed
+    };
+    union {
+      RWstoredValue	reserved2;	// ditto
+      RWoffset		filterLoc;	// Bloom filter, if hasFilter
+    };
+    unsigned long	flags;		// ignoreNulls, hasFilter
   } baseInfo;
+  baseInfoStruct	savedInfo;		// baseInfo as an update found it
 protected:
   /* ignoreNulls() prototypes getting individual flags from flags */
   RWBoolean		ignoreNulls() const
   { return baseInfo.flags & 1 ? TRUE : FALSE; }
+  RWBoolean		hasFilter() const
+  { return baseInfo.flags & 2 ? TRUE : FALSE; }
+  RWBoolean		packedKeys() const
+  { return baseInfo.version == RWBTreeOnDiskPackedVersion; }
   void			infoInit(RWstoredValue version,
 				  unsigned keylen,
 				  unsigned order,
@@ -291,6 +455,82 @@ protected:
 
 };    
 
+/****************************************************************
+ *								*
+ *			RWBTreeOnDiskCursor			*
+ *								*
+ ****************************************************************/
+
+/*
+ * A position in an RWBTreeOnDisk which can be moved in key order in
+ * either direction.  The nodes on the path from the root to the
+ * current key are pinned in the tree's cache, so stepping to a
+ * neighbouring key does not descend from the root again.
+ *
+ * The cursor may be restricted to the keys in [lo, hi), or to those
+ * starting with a given prefix; stepping out of the range invalidates
+ * it.  A fresh cursor is positioned before the first key in range, so
+ * that operator()() can be used as with other iterators:
+ *
+ *	RWBTreeOnDiskCursor c(tree);
+ *	c.setPrefix("abc", 3);
+ *	while ( c() ) cout << c.key() << endl;
+ *
+ * Inserting into or removing from the tree, or changing its
+ * cacheCount() or cachePolicy(), leaves the cursor's position
+ * undefined; seek(), first(), last() and reset() start afresh.  The
+ * cursor's pins are held in the tree's cache, so the tree must outlive
+ * its cursors.
+ */
+class RWExport RWBTreeOnDiskCursor {
+public:
+  RWBTreeOnDiskCursor(RWBTreeOnDisk& tree);
+  ~RWBTreeOnDiskCursor();
+
+  RWBoolean		operator()();		// First, or next, key in range
+  RWBoolean		first();		// Smallest key in range
+  RWBoolean		isValid() const
+	{ return depth_ >= 0; }
+  RWCString		key() const;
+  RWBoolean		last();			// Largest key in range
+  RWBoolean		next();
+  RWBoolean		prev();
+  void			reset();		// Back before the first key
+  RWBoolean		seek(const char* key);	// Smallest key >= key
+  void			setPrefix(const char* prefix, size_t len);
+  void			setRange(const char* lo, const char* hi);
+  RWstoredValue		value() const;
+
+private:
+  RWBoolean		inRange();
+  void			grow();
+  void			load(int level, RWoffset off);
+  void			release(int level);
+  RWBoolean		seekBefore(const char* key);
+  void			toLeftmost(int level, RWoffset off);
+  void			toRightmost(int level, RWoffset off);
+  RWBoolean		upBackward(int level);
+  RWBoolean		upForward(int level);
+
+  RWBTreeOnDiskCursor(const RWBTreeOnDiskCursor&);	// No copies
+  void			operator=(const RWBTreeOnDiskCursor&);
+
+private:
+  RWBTreeOnDisk*	tree_;
+  unsigned		keylen_;	// the tree's, for lo_ and hi_
+  int			depth_;		// level of current key; -1 if none
+  RWBoolean		fresh_;		// not yet moved since reset()
+  int			levels_;	// size of the path arrays
+  RWoffset*		off_;		// offset of node at each level
+  int*			idx_;		// child taken; key index at depth_
+  RWDiskTreeNode**	node_;		// node at each level: view or copy
+  RWDiskTreeNode**	view_;		// onto a pinned cache slot
+  RWDiskTreeNode**	copy_;		// used if a slot can't be pinned
+  RWBoolean*		pinned_;
+  char*			lo_;		// range; rwnil if unbounded
+  char*			hi_;
+};
+
 #endif /*  __RWDISKTREE_H__ */
 
 
@@ -0,0 +1,169 @@
+#ifndef __RWFILELOG_H__
+#define __RWFILELOG_H__
+
+/*
+ * RWFileLog --- write-ahead log for an RWFile
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ * Voice: (503) 754-3010	FAX: (503) 757-6650
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+/*
+ * While a log is attached to an RWFile nothing written to the file
+ * goes to it directly.  Writes are kept in memory, in page sized
+ * images which later reads see, and recorded in a separate log file.
+ * commit() appends the records since the last commit, followed by a
+ * commit record carrying their checksum, and makes the log durable.
+ * Once the log has grown past checkpointSize() the page images are
+ * written back to the file itself, the file is made durable, and the
+ * log is emptied.
+ *
+ * On construction the log is recovered: the records of every complete
+ * commit still in it are applied to the file, and anything after the
+ * last one --- a transaction that never committed, or a torn write ---
+ * is discarded.  A file is therefore only ever seen as it was at some
+ * commit.
+ *
+ * Under RW_MULTI_THREAD, commit() and sync() may be called from several
+ * threads at once.  Only one at a time waits for the disk; those that
+ * arrive meanwhile find their commits already covered, or are covered
+ * together by the next sync ("group commit").  Since a commit takes in
+ * everything written so far, a thread should commit with sync FALSE
+ * while it still excludes other writers, and sync() after letting them
+ * go.  Reads and writes through the RWFile itself must still be
+ * serialized by the caller, as they always have been.
+ *
+ * Normally used through RWFileManager::openLog().
+ */
+
+#include "rw/tooldefs.h"
+#ifdef RW_MULTI_THREAD
+# include "rw/mutex.h"
+#endif
+STARTWRAP
+#include <stdio.h>
+ENDWRAP
+
+class RWExport RWFile;
+
+class RWExport RWFileLog
+{
+
+public:
+
+  RWFileLog(RWFile* file, const char* logName);
+  ~RWFileLog();
+
+  RWBoolean		isValid() const {return logp_ != rwnil;}
+  const char*		logName() const {return name_;}
+
+  RWBoolean		checkpoint();		// Write back and empty log
+  unsigned long		checkpointSize() const {return ckptSize_;}
+  unsigned long		checkpointSize(unsigned long); // Returns old value
+  RWBoolean		commit(RWBoolean sync = TRUE);
+  unsigned long		commits() const {return commits_;}
+  RWBoolean		sync();		// Wait for earlier commits
+  unsigned long		syncs() const {return syncs_;}
+
+  // Used by RWFile in place of stdio:
+  RWBoolean		eof() const {return pos_ >= size_;}
+  size_t		read(void*, size_t);
+  size_t		read(long off, void*, size_t);	// Used by ReadAt()
+  RWBoolean		seek(long off)	{pos_ = off; return off >= 0;}
+  long			size() const	{return size_;}
+  long			tell() const	{return pos_;}
+  size_t		write(const void*, size_t);
+  size_t		write(long off, const void*, size_t);
+
+  enum { pageSize = 1024 };
+
+private:
+
+  RWFileLog(const RWFileLog&);
+  void			operator=(const RWFileLog&);
+
+  void			append(const void*, size_t);
+  RWBoolean		applyLog(long upto);
+  RWBoolean		emptyLog();
+  char*			page(long pageNo);
+  long			recover();
+  RWBoolean		syncData();
+  RWBoolean		syncLog();
+  RWBoolean		syncTo(unsigned long);
+  RWBoolean		writeBack();
+
+private:
+
+  RWFile*		file_;
+  FILE*			logp_;
+  char*			name_;
+  long			pos_;		// Current offset in the file
+  long			size_;		// Logical size of the file
+  long			fileSize_;	// Size of the file itself
+
+  // Page images not yet written back:
+  unsigned		nbuckets_;	// Power of 2
+  size_t*		buckets_;	// Page number hash -> first image
+  size_t*		hashNext_;
+  long*			pageNos_;
+  char**		pages_;
+  size_t		npages_;
+  size_t		maxpages_;
+
+  // Records written since the last commit:
+  char*			buf_;
+  size_t		buflen_;
+  size_t		bufmax_;
+  unsigned long		sum_;		// Their checksum
+
+  long			logSize_;	// Bytes appended to the log
+  unsigned long		ckptSize_;
+  unsigned long		appended_;	// Commits appended to the log
+  unsigned long		synced_;	// Commits known to be durable
+  unsigned long		commits_;
+  unsigned long		syncs_;
+#ifdef RW_MULTI_THREAD
+  RWMutex		lock_;		// Everything above
+  RWMutex		syncLock_;	// Held while waiting for the disk
+#endif
+};
+
+#endif /* __RWFILELOG_H__ */
@@ -97,6 +97,12 @@ class RWExport RWFileManager : public RWFile
 
 public:
 
+  /*
+   * A nil fname gives a file manager over a file in memory, for
+   * scratch structures: see RWFile.  SaveAs() writes it out whole,
+   * to be opened again by name; anything built on it should have
+   * written back its state (an RWBTreeOnDisk, by being destroyed) first.
+   */
   RWFileManager(const char* fname, const char* mode = rwnil);
 
   ~RWFileManager();
@@ -106,6 +112,38 @@ public:
   RWoffset		endData() const  {return endOfData_;} 
   RWoffset		start()   const	 {return startOfData_;}
 
+  /*
+   * For moving data toward the front of the file: allocateBelow()
+   * returns the lowest free space that will hold the given number of
+   * bytes, if it starts before limit, and RWNIL otherwise.  It scans
+   * the whole free list, and only files with the current style of
+   * free list support it.  Space freed at the end of the file is
+   * given back to the file manager straight away, but the file only
+   * shrinks when trim() cuts it back to endData().
+   */
+  RWoffset		allocateBelow(RWspace, RWoffset limit);
+  RWBoolean		trim();
+
+  /*
+   * Write-ahead logging (see <rw/filelog.h>).  openLog() first
+   * recovers from any earlier log of the same name, then rereads the
+   * file's header; it should be called before any structure is built
+   * on the file.  The default log name is the file name with ".log"
+   * appended.  From then on every change to the file --- user data and
+   * free list alike --- lands atomically at commit(), and survives a
+   * crash once a commit with sync TRUE, or a later sync(), has
+   * returned.  The log is written back to the file lazily, once it
+   * exceeds checkpointSize() bytes, by checkpoint(), and by closeLog()
+   * or the destructor, which commit first.  Without a log commit() is
+   * simply Flush().
+   */
+  RWBoolean		openLog(const char* logName = rwnil);
+  void			closeLog();
+  void			checkpoint();
+  void			commit(RWBoolean sync = TRUE);
+  RWFileLog*		log() const {return log_;}
+  void			sync();
+
 #ifdef RDEBUG
   RWoffset              walkFreeList(RWoffset&, int&, RWspace&);
   void			summarize();
@@ -119,6 +157,7 @@ protected:
   void                  seekErr();
   void                  writeErr();
   RWoffset              rootOffset() const;
+  void			readHeader();	// or write a new one
 
 private:
 
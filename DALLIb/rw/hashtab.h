@@ -47,7 +47,7 @@
  *
  ***************************************************************************
  *
- * Hash table look up with chaining
+ * Hash table look up with open addressing
  * Duplicates are kept as distinct entries.
  * 
  ***************************************************************************
@@ -119,14 +119,19 @@
 
 #include "rw/colclass.h"
 #include "rw/iterator.h"
-#include "rw/gvector.h"
 
-class RWExport RWSlistCollectables;
-class RWExport RWSlistCollectablesIterator;
 class RWExport RWHashTableIterator;
-// Declare a vector of pointers to RWSlistCollectables:
-typedef RWSlistCollectables* RWSlistCollectablesP;
-declare(RWGVector,RWSlistCollectablesP)
+
+/*
+ * A slot of the table: an item and its hash value.  An empty slot
+ * has no item and a zero hash; one whose item has been removed has
+ * no item and a non-zero hash, so that probes carry on past it.
+ */
+struct RWHashTableSlot
+{
+  RWCollectable*		item_;
+  unsigned			hash_;
+};
 
 /****************************************************************
  *								*
@@ -134,6 +139,19 @@ declare(RWGVector,RWSlistCollectablesP)
  *								*
  ****************************************************************/
 
+/*
+ * The table is open addressed: items are kept in a single array of
+ * slots, a power of two in number, each with the item's hash value
+ * beside it, and collisions are resolved by linear probing.  A probe
+ * compares hash values before calling isEqual().  When an insertion
+ * would fill more than maxLoad() of the slots (0.75 by default) the
+ * table grows, doubling; maxLoad(f) sets the fraction, between 0.25
+ * and 0.95, and returns the old one.  resize() may still be used to
+ * make room ahead of time.  Removing an item leaves its slot marked,
+ * so that an iterator is not disturbed by remove(); the marks are
+ * cleared whenever the table is rebuilt.
+ */
+
 class RWExport RWHashTable : public RWCollection {
 
   friend class RWExport RWHashTableIterator;
@@ -174,20 +192,47 @@ public:
 
 /********************** Special functions **********************************/
   virtual void			resize(size_t n = 0);
-  size_t			buckets() const {return table_.length();}
+  size_t			buckets() const {return nslots_;}
+  double			maxLoad() const {return maxLoad_;}
+  double			maxLoad(double f);	// Returns old value
 
 protected:
 
-  RWGVector(RWSlistCollectablesP) table_;  // Table of pointers to chains.
+  RWHashTableSlot*		table_;	   // The slots
+  size_t			nslots_;   // How many: a power of two
   size_t			nitems_;   // Total number of stored objects.
+  size_t			nremoved_; // Slots marked as removed
+  size_t			limit_;	   // Items plus marks that force growth
+  double			maxLoad_;
 
 protected:
 
-  size_t			hashIndex(const RWCollectable* p) const
-     { return (size_t)(p->hash() % buckets()); }
-  RWCollectable*		insertIndex(size_t, RWCollectable*);
+  /*
+   * findSlot() returns the slot of the first item equal to p (with
+   * identity, the first that is p) whose hash value is h, or RW_NPOS.
+   * insertHash() adds p, whose hash value is h, growing the table if
+   * need be.  removeSlot() empties a slot and returns its item.
+   */
+  size_t			findSlot(const RWCollectable* p, unsigned h,
+					 RWBoolean identity = FALSE) const;
+  size_t			homeSlot(unsigned h) const;
+  RWCollectable*		insertHash(unsigned h, RWCollectable* p);
+  RWCollectable*		removeSlot(size_t i);
+  void				rehash(size_t n);
 };
 
+inline size_t
+RWHashTable::homeSlot(unsigned h) const
+{
+  // Spread the bits of h, which may well vary only in the high
+  // order ones, over the low order bits used as the index:
+  unsigned long x = h;
+  x ^= x >> 16;
+  x *= 0x45d9f3bUL;
+  x ^= x >> 16;
+  return (size_t)x & (nslots_-1);
+}
+
 
 
 /****************************************************************
@@ -215,15 +260,10 @@ public:
   RWCollectable*		remove();			// Remove current item
   RWCollectable*   		removeNext(const RWCollectable*);	// Remove next matching item
 
-protected:
-
-  void				nextIterator();
-
 private:
 
   RWHashTable*			myHash_;
-  size_t			idx_;		// which Slist is current
-  RWSlistCollectablesIterator*	iterator_;	// an iterator for that Slist
+  size_t			idx_;		// current slot, plus one; 0 if before the first
 
 };
 
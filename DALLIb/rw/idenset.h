@@ -123,22 +123,6 @@ public:
   virtual RWCollectable*	remove(const RWCollectable*);
   virtual RWBoolean		isEqual(const RWCollectable*) const;
 
-protected:
-
-  size_t			hashIndexReference(const RWCollectable* p) const;
-
 };    
 
-/****************************************************************
- *								*
- *			INLINES					*
- *								*
- ****************************************************************/
-
-inline size_t
-RWIdentitySet::hashIndexReference(const RWCollectable* a) const
-{
-  return RWhashAddress((void*)a) % buckets();
-}
-
 #endif /* __RWIDENSET_H__ */
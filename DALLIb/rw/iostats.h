@@ -0,0 +1,162 @@
+#ifndef __RWIOSTATS_H__
+#define __RWIOSTATS_H__
+
+/*
+ * RWLatencyHistogram and the statistics kept by the disk based classes
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ * Voice: (503) 754-3010	FAX: (503) 757-6650
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+/*
+ * RWFile, RWCacheManager, RWBufferedPageHeap and RWBTreeOnDisk each
+ * keep one of the statistics objects below, returned by statistics()
+ * and cleared by resetStatistics().  The counters cost an increment
+ * apiece.  Under RW_MULTI_THREAD they are not locked, so readers
+ * running at once may lose the odd update.
+ *
+ * An RWLatencyHistogram counts events by how long they took, in
+ * buckets which double in width: bucket 0 holds those under a
+ * microsecond and bucket i those from 2^(i-1) up to 2^i microseconds.
+ * The last bucket takes anything longer.
+ */
+
+#include "rw/defs.h"
+
+class RWExport RWLatencyHistogram
+{
+
+public:
+
+  enum { nbuckets = 32 };
+
+  RWLatencyHistogram()			{reset();}
+
+  unsigned long		bucket(int i) const	{return counts_[i];}
+  unsigned long		count() const;
+  double		mean() const;		// Microseconds
+  unsigned long		percentile(double p) const; // Bound on fraction p
+  void			record(unsigned long usec);
+  void			reset();
+
+  static unsigned long	now();		// Microsecond clock, for timing
+  static unsigned long	upperBound(int i); // Limit of bucket i
+
+private:
+
+  unsigned long		counts_[nbuckets];
+  double		total_;		// Sum of the durations
+};
+
+class RWExport RWFileStatistics
+{
+
+public:
+
+  RWFileStatistics()			{reset();}
+  void			reset();
+
+  unsigned long		reads;		// Read() and ReadAt() requests
+  unsigned long		writes;		// Write() and WriteAt() requests
+  unsigned long		bytesRead;
+  unsigned long		bytesWritten;
+  RWLatencyHistogram	readTime;	// Only while RWFile::timeIO() is on
+  RWLatencyHistogram	writeTime;
+};
+
+class RWExport RWCacheStatistics
+{
+
+public:
+
+  RWCacheStatistics()			{reset();}
+  void			reset();
+
+  unsigned long		reads;		// read() and pin() requests
+  unsigned long		readHits;	// ... found in a slot
+  unsigned long		mappedReads;	// ... served by the file's mapping
+  unsigned long		writes;
+  unsigned long		writeHits;
+  unsigned long		evictions;	// Slots taken from another block
+  unsigned long		readahead;	// Blocks brought in ahead of need
+  unsigned long		prefetches;	// Blocks hinted by prefetch()
+  unsigned long		fileReads;	// Reads issued to the file
+  unsigned long		fileWrites;	// Writes through to the file
+  unsigned long		bytesRead;
+  unsigned long		bytesWritten;
+};
+
+class RWExport RWPageHeapStatistics
+{
+
+public:
+
+  RWPageHeapStatistics()		{reset();}
+  void			reset();
+
+  unsigned long		locks;		// lock() requests
+  unsigned long		lockHits;	// ... with the page in a buffer
+  unsigned long		swapIns;
+  unsigned long		evictions;	// Buffers taken from another page
+  unsigned long		swapOuts;	// Dirty pages written back
+};
+
+class RWExport RWDiskTreeStatistics
+{
+
+public:
+
+  RWDiskTreeStatistics()		{reset();}
+  void			reset();
+
+  unsigned long		lookups;	// findKeyAndValue() and friends
+  unsigned long		lookupVisits;	// Nodes they visited
+  unsigned long		filterRejects;	// Lookups the Bloom filter answered
+  unsigned long		inserts;
+  unsigned long		removes;
+  unsigned long		nodeReads;	// Nodes fetched through the cache
+  unsigned long		nodeWrites;
+  unsigned long		splits;
+  unsigned long		merges;
+  unsigned long		relocations;	// Nodes moved by compact()
+};
+
+#endif /* __RWIOSTATS_H__ */
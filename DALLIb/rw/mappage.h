@@ -0,0 +1,133 @@
+#ifndef __RWMAPPAGE_H__
+#define __RWMAPPAGE_H__
+
+/*
+ * RWMappedPageHeap: Virtual page heap kept in a memory mapped swap file.
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ * Voice: (503) 754-3010	FAX: (503) 757-6650
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+/*
+ * An RWMappedPageHeap keeps its pages in a sparse swap file which is
+ * mapped into memory.  lock() returns the address of the page in the
+ * mapping, so nothing is copied in or out of a buffer.  Pages may be
+ * large: the page size is rounded up to a multiple of the system's,
+ * and 64K to 2M suits big RWTValVirtualArray's.
+ *
+ * At most "nbufs" pages are kept resident.  When a page must be
+ * brought in and the budget is spent, a batch of pages which are
+ * not locked and have not been used recently is chosen by the CLOCK
+ * algorithm and swapped out: the batch is sorted, the dirty pages of
+ * each run of adjacent ones are written back with a single msync(),
+ * and the run is dropped from memory.  As with RWBufferedPageHeap,
+ * lock() returns nil if every resident page is locked.
+ *
+ * The file is mapped a segment at a time, so growing it never moves a
+ * page which is locked.  Memory mapping is only available under Unix
+ * (and not with RW_NO_MMAP); elsewhere the heap is never valid.
+ */
+
+#include "rw/vpage.h"
+#include "rw/iostats.h"
+STARTWRAP
+#include <stdio.h>
+ENDWRAP
+
+class RWMappedPage;
+
+class RWExport RWMappedPageHeap : public RWVirtualPageHeap {
+
+public:
+
+  RWMappedPageHeap(const char* filename=0, unsigned nbufs=64, unsigned pgsize=65536U);
+  virtual		~RWMappedPageHeap();
+
+  RWBoolean		isValid() const {return tempfp_!=0;}
+  void			resetStatistics()	{stats_.reset();}
+  const RWPageHeapStatistics& statistics() const {return stats_;}
+
+  // Inherited from RWVirtualPageHeap:
+  virtual RWHandle	allocate();
+  virtual void		deallocate(RWHandle);
+  virtual void		dirty(RWHandle);
+  virtual void*		lock(RWHandle);
+  virtual void		unlock(RWHandle);
+  virtual void		prefetch(RWHandle);
+
+  void			flush();	// Write back all dirty resident pages
+
+protected:
+
+  RWBoolean		handleValid(RWHandle) const;
+  char*			addressOfHandle(RWHandle) const;
+  RWoffset		offsetOfHandle(RWHandle) const;
+  RWBoolean		mapSegment();			// Map one more segment
+  RWBoolean		makeResident(RWHandle);		// Give the page a slot
+  void			swapOutBatch();			// Free a batch of slots
+  void			release(RWHandle*, unsigned);	// Write back and drop pages
+
+private:
+
+  static const unsigned long	segmentSize_;
+  static const unsigned		handleIncrement_;
+  static unsigned		roundPageSize(unsigned);
+
+  RWMappedPage*			pages_;		// State of each page, by handle-1
+  unsigned			nPages_;	// Handles given out so far
+  unsigned			maxPages_;	// Length of pages_
+  RWHandle			freeHandle_;	// Chain of deallocated handles
+  char**			segments_;	// Base of each mapped segment
+  unsigned			nSegments_;
+  unsigned			maxSegments_;	// Length of segments_
+  unsigned			pagesPerSegment_;
+  unsigned			nBuffers_;	// Residency budget
+  RWHandle*			resident_;	// The clock: handle in each slot, or 0
+  unsigned*			freeSlots_;	// Stack of empty slots
+  unsigned			nFree_;
+  unsigned			hand_;		// The clock hand
+  RWHandle*			victims_;	// Scratch for swapOutBatch()
+  FILE*				tempfp_;
+  RWPageHeapStatistics		stats_;
+
+};
+
+#endif	/* __RWMAPPAGE_H__ */
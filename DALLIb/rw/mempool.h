@@ -113,15 +113,25 @@
  * as nodes in a linked list or binary tree.  It can also help memory
  * fragmentation.
  *
- * Two static variables affect its performance:
- *
- *  RWMAXPOOLS:		The number of different sizes managed.  The
- *			default (5) will manage objects with sizes
- *			from 1 to 10 bytes big.  Objects bigger than this
- * 			will be handled by the operating system.
- *
- *  RWPOOLSIZE:		The maximum number of objects retained within a size class.
- *			Excess objects are returned to the operating system.
+ * Objects are sorted into size classes, each RWPOOLGRAIN bytes bigger
+ * than the last.  Each thread keeps, for each class, two "magazines"
+ * of free objects, from which it allocates and to which it frees
+ * without taking a lock.  Only when both are empty, or both full, does
+ * it trade a whole magazine with a depot shared by all the threads.
+ * The depot gets fresh objects by cutting up slabs of RWPOOLSLAB bytes
+ * obtained from the operating system, to which they are not returned:
+ * each size class keeps the most it has ever needed.
+ *
+ *  RWMAXPOOLS:		The number of size classes.  The default (32)
+ *			will manage objects of up to 256 bytes.  Objects
+ *			bigger than this will be handled by the operating
+ *			system.
+ *
+ *  RWPOOLSIZE:		The number of objects a magazine holds.
+ *
+ * A thread about to exit should call RWMemoryPool::releaseCache() to
+ * hand its magazines back to the depot, else the objects in them are
+ * lost to the other threads.
  */
 
 
@@ -139,37 +149,28 @@ STARTWRAP
 #include <stddef.h>	/* Looking for size_t*/
 ENDWRAP
 
-const int RWPOOLSIZE = 5;
-const int RWMAXPOOLS = 5;
+const int RWPOOLGRAIN = 8;
+const int RWPOOLSIZE = 16;
+const int RWMAXPOOLS = 32;
+const int RWPOOLSLAB = 4096;
 
 class RWExport RWMemoryPool {
-// If not a 16bitDLL and not memcheck and not debug
-// If following changes, also change #if in mempool.cpp
-#if !(defined(_RWTOOLSDLL) && defined(__WIN16__)) && !defined(RWMEMCK) && !defined(RWDEBUG) 
-  static void*		stash[RWMAXPOOLS][RWPOOLSIZE];	// The private stash
-  static short		nstash[RWMAXPOOLS];		// Number of free objects in each size class.
-#endif
 public:
 #ifdef RW_TCC_DELETE_SIZE_BUG
   ~RWMemoryPool() { }	// Superfluous destructor required for Borland bug
 #endif
   void			operator delete(void*, size_t);
   void*			operator new(size_t);
+  static void		releaseCache();	// See above
 #ifdef RWMEMCK
   void*			operator new(size_t size, const char* filename, int line);
 #endif
 };
 
-// Multi-threaded programs can't afford conflicts in the static
-// RWMemoryPool free-block pool.  We inherit differently because
-// otherwise every derived object would grow by (up to) 4 bytes,
-// for no reason.
+// Each thread has magazines of its own, so multi-threaded programs
+// use the pool too.
 
-#ifdef RW_MULTI_THREAD
-#define RWMemoryPool_OPTION
-#else
 #define RWMemoryPool_OPTION   : public RWMemoryPool
-#endif
 
 #endif /* RW_DONT_USE_MEMORY_POOL */
 
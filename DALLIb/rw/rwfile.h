@@ -118,21 +118,35 @@
  */
 
 #include "rw/defs.h"
+#include "rw/iostats.h"
+#ifdef RW_MULTI_THREAD
+# include "rw/mutex.h"
+#endif
 STARTWRAP
 #include <stdio.h>
 ENDWRAP
 
+class RWExport RWFileLog;
+
 class RWExport RWFile
 {
   RWFile(const RWFile&);  // Not implemented!
   void operator=(const RWFile&); // Not implemented!
 public:
+  /*
+   * With a nil name the file is kept in memory, in a region which
+   * grows as it is written: much as a mapped file (see MapFile()) with
+   * nothing behind it.  It is gone when destroyed, unless SaveAs() has
+   * been used to write it out to a real file.  It has no stream, and
+   * cannot be logged.
+   */
   RWFile(const char* name, const char* mode = rwnil);
   ~RWFile();
        
   const char*		GetName()   const {return filename;    }
   FILE*			GetStream() const {return filep;       }
-  RWBoolean		isValid()   const {return filep!=rwnil;}
+  RWBoolean		isValid()   const {return filep!=rwnil || map_base!=rwnil;}
+  RWBoolean		isInMemory() const {return filep==rwnil && map_base!=rwnil;}
   RWBoolean 		Exists();
   static RWBoolean 	Exists(const char* name);
        
@@ -221,12 +235,98 @@ public:
   RWBoolean   isReadOnly();
   RWBoolean   isWriteOnly();
   RWBoolean   isReadWrite();
+
+  /*
+   * Optional memory mapping (Unix only).  Once MapFile() succeeds all
+   * reads and writes go to the mapping instead of through stdio, and
+   * the mapping grows as data is written past its end.  Addresses
+   * returned by MappedAddress() are good until the mapping is next grown.
+   */
+  RWBoolean		MapFile();	// TRUE if mapping was established
+  void			UnmapFile();	// Back to stdio
+  RWBoolean		isMapped() const {return map_base!=rwnil;}
+  RWBoolean		GrowMap(long size); // Make [0,size) addressable
+  char*			MappedAddress(long offset, size_t N) const;
+
+  // Write the contents of a file in memory, or a mapped one, to the
+  // named file with a single write, replacing anything already there.
+  RWBoolean		SaveAs(const char* name);
+
+  /*
+   * Positioned I/O.  ReadAt() and WriteAt() transfer all N bytes at
+   * an explicit offset, or return FALSE, and leave the current offset
+   * alone.  Under Unix they go straight to the descriptor with pread()
+   * and pwrite(), one system call and no stdio buffering, and any
+   * number of threads may ReadAt() the same file at once.  WriteAt(),
+   * and mixing either with the stream functions above, must still be
+   * serialized by the caller.  Elsewhere they seek and use the stream.
+   * If sharesReads(), other threads may go on calling ReadAt() while
+   * one thread uses all the rest; what they read of a block written
+   * meanwhile is undefined.
+   */
+  RWBoolean		ReadAt(long offset, void* p, size_t N);
+  RWBoolean		sharesReads() const;
+  RWBoolean		WriteAt(long offset, const void* p, size_t N);
+
+  // Cut the file back to size bytes; FALSE if that can't be done
+  // here, or while the file is logged.
+  RWBoolean		Truncate(long size);
+
+  // Advise the system that [offset, offset+N) will be read soon, so
+  // that it can start the I/O in the background.  Only a hint: does
+  // nothing where the system offers no way to act on it.
+  void			Prefetch(long offset, long N);
+
+  /*
+   * Requests and bytes through Read() and Write(), ReadAt() and
+   * WriteAt().  While timeIO() is on, how long each took is recorded
+   * as well.  That costs two readings of the clock per request, so it
+   * is off to begin with.
+   */
+  const RWFileStatistics& statistics() const {return stats_;}
+  void			resetStatistics()	{RWGUARD(stateLock_); stats_.reset();}
+  RWBoolean		timeIO() const		{return timing_;}
+  RWBoolean		timeIO(RWBoolean on);	// Returns old setting
+
+  // TRUE while writes are going through a write-ahead log (see
+  // RWFileManager::openLog()).  Such a file cannot be mapped.
+  RWBoolean		isLogged() const {return log_!=rwnil;}
   
 protected:
 
   char*			filename;
   FILE*			filep;
   int       access_mode;
+  char*			map_base;	// Start of the mapping, or rwnil
+  long			map_length;	// Bytes mapped
+  long			map_size;	// Logical file size while mapped
+  long			map_pos;	// Current offset while mapped
+  RWFileLog*		log_;		// Write-ahead log, or rwnil
+  unsigned		stdio_state;	// stdioRead|stdioWritten
+#ifdef RW_MULTI_THREAD
+  RWMutex		stateLock_;	// stdio_state and stats_, for sharesReads()
+#endif
+  RWFileStatistics	stats_;
+  RWBoolean		timing_;	// Keep the latency histograms
+
+private:
+
+  // What the stream may hold that the descriptor does not know about:
+  enum { stdioRead = 1, stdioWritten = 2 };
+
+  static char*		memoryAlloc(long length);	// for files in memory
+  static void		memoryFree(char*, long length);
+  void			countRead(size_t bytes, unsigned long t0);
+  void			countWrite(size_t bytes, unsigned long t0);
+  size_t		directRead(long offset, void*, size_t);
+  size_t		directWrite(long offset, const void*, size_t);
+  size_t		rawRead(void*, size_t size, size_t count);
+  size_t		rawWrite(const void*, size_t size, size_t count);
+  size_t		streamRead(void*, size_t size, size_t count);
+  size_t		streamWrite(const void*, size_t size, size_t count);
+  RWBoolean		syncStream(RWBoolean writing);
+
+friend class RWFileLog;
 };
 
 #endif  /* __RWFILE_H__ */
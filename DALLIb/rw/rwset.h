@@ -48,7 +48,7 @@
  ***************************************************************************
  *
  * Duplicates are not allowed.
- * Hash table look up with chaining: derived from RWHashTable
+ * Hash table look up: derived from RWHashTable
  *
  * $Log: rwset.h,v $
  * Revision 6.5  1994/07/12  19:58:19  vriezen
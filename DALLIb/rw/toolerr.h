@@ -104,6 +104,7 @@
 #define RWTOOL_UNLOCK       RWTOOL_UNLOCK()
 #define RWTOOL_WRITEERR     RWTOOL_WRITEERR()
 #define RWTOOL_INDEXERR     RWTOOL_INDEXERR()
+#define RWTOOL_KEYORDER     RWTOOL_KEYORDER()
 
 extern const RWMsgId rwexport RWTOOL_ALLOCOUT;
 extern const RWMsgId rwexport RWTOOL_BADRE;
@@ -125,5 +126,6 @@ extern const RWMsgId rwexport RWTOOL_SUBSTRING;
 extern const RWMsgId rwexport RWTOOL_UNLOCK;
 extern const RWMsgId rwexport RWTOOL_WRITEERR;
 extern const RWMsgId rwexport RWTOOL_INDEXERR;
+extern const RWMsgId rwexport RWTOOL_KEYORDER;
 
 #endif  /*  __RWTOOLERR_H__ */
@@ -114,23 +114,20 @@ RWTVirtualRef<T>::set(long idx, const T& val)
 template <class T> void
 RWTVirtualRef<T>::set(long start, long extent, const T& val)
 {
-  long stop = start + extent - 1L;
-  RWPageSlot startSlot, stopSlot;
-  unsigned startRem, stopRem;
-  findLocation(start, startSlot, startRem);
-  findLocation(stop,  stopSlot,  stopRem);
-
-  for (RWPageSlot slot = startSlot; slot <= stopSlot; slot++)
+  RWPageSlot slot;
+  unsigned n;
+  long stop = start + extent;
+  findLocation(stop-1, slot, n);	// Check bounds before starting
+  while (start < stop)
   {
-    unsigned startIdx = slot==startSlot ? startRem : 0;
-    unsigned endIdx   = slot==stopSlot  ? stopRem  : nPerPage_-1;
-    T* p = (T*)lock(slot);
-    for (unsigned i = startIdx; i<=endIdx; i++)
+    T* p = lockRun(start, stop, slot, n);
+    for (register unsigned i = 0; i<n; i++)
     {
       p[i] = val;
     }
     dirty(slot);
     unlock(slot);
+    start += n;
   }
 }
 
@@ -216,3 +213,60 @@ RWTVirtualRef<T>::conformalCopy(long start1,
   }
 }
 
+
+template <class T> T*
+RWTVirtualRef<T>::lockRun(long idx, long stop, RWPageSlot& slot, unsigned& n)
+{
+  unsigned rem;
+  findLocation(idx, slot, rem);
+  n = nPerPage_ - rem;
+  if (idx + (long)n >= stop)
+    n = (unsigned)(stop - idx);
+  else
+    prefetch(slot+1);
+  return (T*)lock(slot) + rem;
+}
+
+template <class T> void
+RWTVirtualRef<T>::unlockRun(RWPageSlot slot, RWBoolean changed)
+{
+  if (changed) dirty(slot);
+  unlock(slot);
+}
+
+// Copy the N items starting at index "start" out to "dst":
+template <class T> void
+RWTVirtualRef<T>::copyOut(long start, long N, T* dst)
+{
+  if (N <= 0) return;
+  RWPageSlot slot;
+  unsigned n;
+  long stop = start + N;
+  findLocation(stop-1, slot, n);	// Check bounds before starting
+  while (start < stop)
+  {
+    const T* p = lockRun(start, stop, slot, n);
+    for (register unsigned i = 0; i<n; i++) *dst++ = p[i];
+    unlock(slot);
+    start += n;
+  }
+}
+
+// Copy N items from "src" into self, starting at index "start":
+template <class T> void
+RWTVirtualRef<T>::copyIn(long start, long N, const T* src)
+{
+  if (N <= 0) return;
+  RWPageSlot slot;
+  unsigned n;
+  long stop = start + N;
+  findLocation(stop-1, slot, n);	// Check bounds before starting
+  while (start < stop)
+  {
+    T* p = lockRun(start, stop, slot, n);
+    for (register unsigned i = 0; i<n; i++) p[i] = *src++;
+    dirty(slot);
+    unlock(slot);
+    start += n;
+  }
+}
@@ -111,6 +111,15 @@ public:
   void			set(long i, const T& v);
   void			set(long start, long extent, const T& v);
   virtual void		conformalCopy(long start1, RWVirtualRef& v2, long start2, long N);
+
+  // Page at a time access.  lockRun() locks the page holding element
+  // i and returns its address; n is set to the number of elements from
+  // i up to the end of the page or index "stop", whichever is first.
+  // The next page is prefetched if the run goes on past this one.
+  T*			lockRun(long i, long stop, RWPageSlot&, unsigned& n);
+  void			unlockRun(RWPageSlot, RWBoolean changed);
+  void			copyOut(long start, long N, T* dst);
+  void			copyIn(long start, long N, const T* src);
 };
 
 
@@ -168,3 +168,62 @@ RWTVirtualSlice<T>::operator=(const RWTValVirtualArray<T>& v)
   varray_->vref_->setSlice(start_, extent_, *(va.vref_), 0, v.length());
 }
 
+
+/****************************************************************
+ ****************************************************************
+ *								*
+ *		RWTValVirtualArrayIterator<T>			*
+ *			Definitions				*
+ *								*
+ ****************************************************************
+ ****************************************************************/
+
+template <class T> RWBoolean
+RWTValVirtualArrayIterator<T>::advance()
+{
+  if (cur_ && left_)
+  {
+    cur_++;
+    left_--;
+    next_++;
+    return TRUE;
+  }
+  release();
+  long stop = array_->length();
+  if (next_ >= stop) return FALSE;
+
+  unsigned n;
+  cur_    = array_->vref_->lockRun(next_++, stop, slot_, n);
+  left_   = n - 1;
+  dirty_  = FALSE;
+  return TRUE;
+}
+
+template <class T> void
+RWTValVirtualArrayIterator<T>::set(const T& v)
+{
+  RWPRECONDITION2(cur_ != rwnil, "RWTValVirtualArrayIterator<T>::set(const T&): No item at cursor");
+  if (!dirty_)
+  {
+    if (array_->vref_->references() > 1)
+    {
+      // Copy on write, then pick up the same place in the copy:
+      array_->vref_->unlock(slot_);
+      array_->cow();
+      unsigned n;
+      cur_ = array_->vref_->lockRun(next_-1, next_+left_, slot_, n);
+    }
+    dirty_ = TRUE;
+  }
+  *cur_ = v;
+}
+
+template <class T> void
+RWTValVirtualArrayIterator<T>::release()
+{
+  if (cur_)
+  {
+    array_->vref_->unlockRun(slot_, dirty_);
+    cur_ = rwnil;
+  }
+}
@@ -82,6 +82,7 @@
 
 template <class T> class RWTVirtualElement;
 template <class T> class RWTVirtualSlice;
+template <class T> class RWTValVirtualArrayIterator;
 
 /****************************************************************
  *								*
@@ -117,6 +118,14 @@ public:
 			slice(long start, long length);	// Slice as lvalue
   void			reshape(long newLength)
   				{cow(); vref_->reshape(newLength);}
+
+  // Bulk access, a page at a time:
+  void			copyOut(long start, long n, T* dst) const
+  				{vref_->copyOut(start, n, dst);}
+  void			copyIn(long start, long n, const T* src)
+  				{cow(); vref_->copyIn(start, n, src);}
+  void			fill(long start, long n, const T& v)
+  				{if (n>0) {cow(); vref_->set(start, n, v);}}
   RWVirtualPageHeap*	heap() const
   				{return vref_->heap();}
 private:
@@ -126,6 +135,7 @@ private:
   void			cow();		// Copy On Write
 friend class RWTVirtualElement<T>;
 friend class RWTVirtualSlice<T>;
+friend class RWTValVirtualArrayIterator<T>;
 };
 
 
@@ -204,6 +214,58 @@ friend class RWTValVirtualArray<T>;
 
 };
 
+/****************************************************************
+ *								*
+ *	Declaration of RWTValVirtualArrayIterator<T>		*
+ *								*
+ ****************************************************************/
+
+/*
+ * Sequential access which keeps the page under the cursor locked,
+ * rather than locking a page for every element, and asks the heap to
+ * prefetch the next page when it moves on to one.  The page is
+ * unlocked when the cursor leaves it, on reset(), or when the
+ * iterator is destroyed.  The array should not be reshaped or
+ * assigned to while an iterator on it has an element under its cursor.
+ */
+template <class T> class RWTValVirtualArrayIterator
+{
+
+public:
+
+  RWTValVirtualArrayIterator(RWTValVirtualArray<T>& a, long start=0)
+    : array_(&a), cur_(rwnil), left_(0), next_(start), dirty_(FALSE) {;}
+  ~RWTValVirtualArrayIterator()		{release();}
+
+  // Operators:
+  RWBoolean		operator++()	{return advance();}
+  RWBoolean		operator()()	{return advance();}
+
+  // Methods
+  RWTValVirtualArray<T>* container() const	{return array_;}
+  long			index() const	{return next_-1;}
+  T			key() const	{return *cur_;}
+  void			set(const T&);		// Change the item at the cursor
+  void			reset(long start=0)	{release(); next_ = start;}
+
+private:
+
+  RWBoolean		advance();
+  void			release();
+
+  RWTValVirtualArray<T>* array_;
+  RWPageSlot		slot_;		// Page under the cursor
+  T*			cur_;		// Item at the cursor; nil if none
+  unsigned		left_;		// Items after cur_ on the page
+  long			next_;		// Index after the cursor
+  RWBoolean		dirty_;		// Page has been changed
+
+  // Disallow postfix increment and copies.
+  RWBoolean		operator++(int);
+  RWTValVirtualArrayIterator(const RWTValVirtualArrayIterator<T>&);
+  void			operator=(const RWTValVirtualArrayIterator<T>&);
+};
+
 /****************************************
  *					*
  *		INLINES			*
@@ -92,6 +92,7 @@ public:
   virtual void		dirty(RWHandle)      = 0;	// Declare page as dirty
   virtual void*		lock(RWHandle)       = 0;	// Lock a page
   virtual void		unlock(RWHandle)     = 0;	// Unlock a page
+  virtual void		prefetch(RWHandle)   { }	// Hint: page will be locked soon
 };
 
 #endif	/* __RWVPAGE_H__ */
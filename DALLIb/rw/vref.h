@@ -109,13 +109,14 @@ public:
 
 public:
 
-  // The following three functions are formally intended to be
+  // The following four functions are formally intended to be
   // protected, but to avoid many friend functions have been made part
   // of the public interface.
 
   void			findLocation(long, RWPageSlot&, unsigned&) const;
   void*			lock(RWPageSlot p)	{return myHeap_->lock(handles_[p]);}
   void			unlock(RWPageSlot p)	{myHeap_->unlock(handles_[p]);}
+  void			prefetch(RWPageSlot p)	{if (p<nSlots_) myHeap_->prefetch(handles_[p]);}
 
 protected:
 
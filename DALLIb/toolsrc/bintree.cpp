@@ -151,12 +151,10 @@ RWBinaryTree::RWBinaryTree()
  *								*
  ****************************************************************/
 
-// This copy constructor constructs a balanced binary tree from a binary tree.
 RWBinaryTree::RWBinaryTree(const RWBinaryTree& bt) 
 {
   root = rwnil;
   *this += bt;
-  balance();
 }
 
 RWBinaryTree::~RWBinaryTree()
@@ -169,7 +167,6 @@ RWBinaryTree::operator=(const RWBinaryTree& bt)
 {
   RWBinaryTree::clear();
   *this += bt;
-  balance();
 }
 
 RWBoolean
@@ -272,6 +269,7 @@ RWBinaryTree::balanceChildren(size_t n, RWGQueue(RWCollectable)& gq)
   p->left     = balanceChildren(nleft, gq);
   p->e        = gq.get();
   p->right    = balanceChildren(nright, gq);
+  p->fixHeight();
   return p;
 }
 
@@ -328,29 +326,27 @@ RWCollectable*
 RWBinaryTree::insert(RWCollectable* a)
 {
   RWPRECONDITION2(a!=rwnil,"RWBinaryTree::insert(RWCollectable*): nil pointer");
-  if (isEmpty()) 
-    // Insert in root if tree is empty:
-    root = new RWTreeNode(a);	
-  else {
-  
-    int compare;
-    RWTreeNode* p;		// Place holder for parent.
-    RWTreeNode* t = root;		// Start at root.
-    do {			// Continue branching, looking for a 
-      p = t;			//   nil node in the proper spot.
-      compare = -t->e->compareTo(a);
-      t = compare<0 ? t->left : t->right;
-    } while (t);
-
-    RWTreeNode* temp = new RWTreeNode(a);
-    if (compare <  0)		// Add node to tree on the proper branch.
-      p->left = temp;
-    else 
-      p->right = temp;
-  }
+  root = insertChild(root, a);
   return a;
 }
 
+/*
+ * Protected function to insert an item into the subtree rooted
+ * at "t".  Duplicates go to the right, after any equal items already
+ * present.  Returns the new (rebalanced) root of the subtree.
+ */
+RWTreeNode*
+RWBinaryTree::insertChild(RWTreeNode* t, RWCollectable* a)
+{
+  if (t == rwnil) return new RWTreeNode(a);
+  int compare = -t->e->compareTo(a);
+  if (compare < 0)
+    t->left = insertChild(t->left, a);
+  else
+    t->right = insertChild(t->right, a);
+  return t->rebalance();
+}
+
 RWBoolean
 RWBinaryTree::isEqual(const RWCollectable* a) const
 {
@@ -376,15 +372,27 @@ size_t
 RWBinaryTree::occurrencesOf(const RWCollectable* a) const
 {
   RWPRECONDITION2(a!=rwnil,"RWBinaryTree::occurrencesOf(const RWCollectable*): nil pointer");
+  return countMatches(root, a);
+}
+
+/*
+ * Protected function to count the items in the subtree rooted at
+ * "t" that compare equal to "a".  Rotations can leave duplicates on
+ * either side of an equal item, so both branches must be searched
+ * below a match.
+ */
+size_t
+RWBinaryTree::countMatches(const RWTreeNode* t, const RWCollectable* a) const
+{
   size_t count = 0;
-  RWTreeNode* t = root;
   while(t) {
     int compare = -t->e->compareTo(a);
     if ( compare < 0 )
       t = t->left;		// Branch left.
+    else if ( compare > 0 )
+      t = t->right;		// Branch right.
     else {
-      // Branch right.  Check to see if we found one.
-      if (compare == 0) count++;	// Found one.
+      count += 1 + countMatches(t->left, a);	// Found one.
       t = t->right;
     }
   }
@@ -396,56 +404,119 @@ RWCollectable*
 RWBinaryTree::remove(const RWCollectable* a)
 {
   RWPRECONDITION2(a!=rwnil,"RWBinaryTree::remove(const RWCollectable*): nil pointer");
+  RWCollectable* ret = rwnil;
+  root = removeChild(root, a, ret);
+  return ret;
+}
 
-  RWTreeNode* p = rwnil;		// Parent of victim.
-  RWTreeNode* x = root;		// Start of search.
+/*
+ * Protected function to remove the first item matching "a" from the
+ * subtree rooted at "t".  The removed item is returned in "ret" (which
+ * is left alone if there is no match).  Returns the new root of the
+ * subtree.
+ */
+RWTreeNode*
+RWBinaryTree::removeChild(RWTreeNode* t, const RWCollectable* a, RWCollectable*& ret)
+{
+  if (t == rwnil) return rwnil;		// Not found.
+  int compare = -t->e->compareTo(a);
+  if (compare < 0)
+    t->left = removeChild(t->left, a, ret);
+  else if (compare > 0)
+    t->right = removeChild(t->right, a, ret);
+  else {
+    RWTreeNode* d = t;		// Remember node to be deleted.
+    ret = d->e;
+    if (d->right == rwnil)	// Three possibilities...
+      t = d->left;
+    else if (d->left == rwnil)
+      t = d->right;
+    else {
+      // Replace it with the smallest node of its right branch:
+      RWTreeNode* r = removeLeftmost(d->right, t);
+      t->left  = d->left;
+      t->right = r;
+    }
+    delete d;
+    if (t == rwnil) return rwnil;
+  }
+  return t->rebalance();
+}
 
-  /* Search for the node, remembering its parent: */
-  while (x) {
-    int compare = -x->e->compareTo(a);
-    if ( compare == 0 )		// Find it?
-      return deleteNode(x, p);
-    p = x;			// Remember parent.
-    x = compare < 0 ? x->left : x->right; // Take proper branch.
+/*
+ * Protected function to unlink the leftmost node of the subtree
+ * rooted at "t", returning it in "least".  Returns the new root
+ * of the subtree.
+ */
+RWTreeNode*
+RWBinaryTree::removeLeftmost(RWTreeNode* t, RWTreeNode*& least)
+{
+  if (t->left == rwnil) {
+    least = t;
+    return t->right;
   }
-  return rwnil;			// Not found.
+  t->left = removeLeftmost(t->left, least);
+  return t->rebalance();
 }
 
-/* Delete node "x" with parent "p": */
-RWCollectable*
-RWBinaryTree::deleteNode(RWTreeNode* x, RWTreeNode* p)
+/****************************************************************
+ *								*
+ *			RWTreeNode				*
+ *								*
+ ****************************************************************/
+
+void
+RWTreeNode::fixHeight()
 {
-  RWTreeNode* d = x;		// Remember node to be deleted.
+  unsigned hl = heightOf(left);
+  unsigned hr = heightOf(right);
+  height = (hl > hr ? hl : hr) + 1;
+}
 
-  // Rearrange tree nodes:
-  if (x->right == rwnil)		// Three possibilities...
-    x = x->left;		// Note: if deleting the last node, x->left == nil.
-  else if (x->right->left == rwnil) {
-    x = x->right;
-    x->left = d->left;
-  } 
-  else {
-    RWTreeNode* c = x->right;
-    while (c->left->left) c = c->left; // Descend down left branch.
-    x = c->left;
-    c->left = x->right;
-    x->left = d->left;
-    x->right = d->right;
+/*
+ * Restore the AVL condition at this node, assuming that both
+ * children satisfy it and that their heights differ by at most two.
+ * Returns the new root of the subtree.
+ */
+RWTreeNode*
+RWTreeNode::rebalance()
+{
+  unsigned hl = heightOf(left);
+  unsigned hr = heightOf(right);
+  if (hl > hr + 1) {
+    if (heightOf(left->left) < heightOf(left->right))
+      left = left->rotateLeft();
+    return rotateRight();
   }
-
-  // If it has a parent (it is not the root node), attach to it properly.
-  if (p!=rwnil)	{
-    if ( d->e->compareTo(p->e) <  0) 
-      p->left = x;
-    else
-      p->right = x;
+  if (hr > hl + 1) {
+    if (heightOf(right->right) < heightOf(right->left))
+      right = right->rotateRight();
+    return rotateLeft();
   }
-  else		// Replace the root node. 
-    root = x;	// If deleting the last remaining node, this leaves root == nil.
+  height = (hl > hr ? hl : hr) + 1;
+  return this;
+}
 
-  RWCollectable* ret = d->e;
-  delete d;                             // Delete node
-  return ret;
+RWTreeNode*
+RWTreeNode::rotateLeft()
+{
+  RWTreeNode* r = right;
+  right = r->left;
+  r->left = this;
+  fixHeight();
+  r->fixHeight();
+  return r;
+}
+
+RWTreeNode*
+RWTreeNode::rotateRight()
+{
+  RWTreeNode* l = left;
+  left = l->right;
+  l->right = this;
+  fixHeight();
+  l->fixHeight();
+  return l;
 }
 
 /************************************************
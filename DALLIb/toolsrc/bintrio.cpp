@@ -89,14 +89,17 @@
 #include "rw/bintree.h"
 #include "rw/rwfile.h"
 #include "rw/vstream.h"
+#include "rwstore.h"
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: bintrio.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/19 01:15:10 $");
 
 void
 RWBinaryTree::saveGuts(RWvostream& os) const
 {
-  os << entries();
+  size_t N = entries();
+  os << N;
   if( os.good() ) { // cast away const to avoid warnings
+    rwReserveStoreTable(N);
 #ifdef __SC__
     ((RWBinaryTree*)this)->levelApply( RWCollection::saveObjToStream, &os);
 #else
@@ -110,6 +113,7 @@ RWBinaryTree::saveGuts(RWFile& f) const
 {
   size_t N = entries();
   f.Write(N);
+  rwReserveStoreTable(N);
   // cast away const to avoid const warnings
 #ifdef __SC__
   ((RWBinaryTree*)this)->levelApply( RWCollection::saveObjToRWFile, &f);
@@ -104,20 +104,11 @@ RWBinaryTreeIterator::findNext(const RWCollectable* a)
 {
   RWPRECONDITION2(a!=rwnil,"RWBinaryTreeIterator::findNext(const RWCollectable*): nil pointer");
 
-  int compare;
-  
   if ( tree->isEmpty() )return rwnil;
   
-  /* Test for first time through: */
-  if ( here == rwnil ) {
-restart: ;
-    stack.clear();		// Make sure stack is cleared.
-    here = tree->root;		// Initialize "here" to root.
-    compare = -here->e->compareTo(a);
-    if ( compare == 0 )return here->e; // Is root the target?
-  } else {			    
+  if ( here != rwnil ) {
     /* Not first time through.  Do a test. */
-    compare = -here->e->compareTo(a);
+    int compare = -here->e->compareTo(a);
     /* Three possiblities...
      *   the given value is less than the current value; it won't
      *   be found.  Just return. */
@@ -126,32 +117,36 @@ restart: ;
       return rwnil;
     }
 
-    /*   the give value is greater than the current value, start all over.*/
-    if ( compare > 0 ) goto restart;
-
-    /*   else, the given value is the same as the current value;
-     *   If you think about it, it must be in the right-hand branch.
-     *   Just carry on.  If it exists, we'll find it. */
+    /*   the given value is the same as the current value;
+     *   any further matches immediately follow it. */
+    if ( compare == 0 ) {
+      if ( (*this)() && here->e->compareTo(a) == 0 ) return here->e;
+      reset();
+      return rwnil;
+    }
 
+    /*   else, the given value is greater than the current value;
+     *   start all over. */
   }
-  
-  
+
   /*
-   * The objective is to advance to the next node that compares to zero.
+   * Because the tree rotates to stay balanced, equal items can be on
+   * either side of each other.  Find the first one in sorted order,
+   * then retrace the path to it so that the stack is set up exactly
+   * as operator()() would have left it.
    */
-  
-  do {
+  const RWTreeNode* target = lowerBound(a);
+  if ( target == rwnil || target->e->compareTo(a) != 0 ) {
+    reset();
+    return rwnil;
+  }
+
+  stack.clear();
+  here = tree->root;
+  while ( here != target ) {
     stack.push((RWTreeNode*)here);
-    // Which way do we branch?
-    here = compare < 0 ? here->left : here->right;
-    // Is there a "next object" at all?
-    if ( here==rwnil ) {
-      reset();
-      return rwnil;
-    }
-    compare = -here->e->compareTo(a);
-  } while (compare);
-  
+    here = here->e->compareTo(a) < 0 ? here->right : here->left;
+  }
   return here->e;
 }
 
@@ -222,6 +217,27 @@ RWBinaryTreeIterator::reset()
 
 /**************** RWBinaryTreeIterator Utilities ******************/
 
+/*
+ * Return the first node, in sorted order, that is not less
+ * than "a", or nil if there is none.
+ */
+
+const RWTreeNode*
+RWBinaryTreeIterator::lowerBound(const RWCollectable* a) const
+{
+  const RWTreeNode* bound = rwnil;
+  const RWTreeNode* t = tree->root;
+  while ( t ) {
+    if ( t->e->compareTo(a) < 0 )
+      t = t->right;
+    else {
+      bound = t;
+      t = t->left;
+    }
+  }
+  return bound;
+}
+
 /*
  * Descend the left branch as far as we can go.
  * Leaves "here" pointing to the leaf and all parents
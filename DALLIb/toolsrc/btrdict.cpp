@@ -113,6 +113,8 @@ RWDEFINE_COLLECTABLE2(RWBTreeDictionary, __RWBTREEDICTIONARY)
 
 RWBTreeDictionary::RWBTreeDictionary() : RWBTree() { }                        
 
+RWBTreeDictionary::RWBTreeDictionary(unsigned order) : RWBTree(order) { }
+
 /*
  * Dictionary copy constructor.  Start with an empty RWBTree.
  * Then add copies of all items in the base class of self to it.
@@ -121,7 +123,7 @@ RWBTreeDictionary::RWBTreeDictionary() : RWBTree() { }
  */
 
 RWBTreeDictionary::RWBTreeDictionary(const RWBTreeDictionary& btrdict)
- : RWBTree()
+ : RWBTree(btrdict.order())
 {
   RWPRECONDITION(entries()==0);
   btrdict.RWBTree::copyContentsTo(this);
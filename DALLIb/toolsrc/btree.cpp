@@ -115,19 +115,71 @@
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: btree.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/18 20:51:00 $");
 
+/*
+ * Node blocks come from the memory pool, as the nodes of the other
+ * collections do; one bigger than its largest size class, as for the
+ * default order, is passed on to the global operator new.  These come
+ * ahead of the definition of new below: under RWMEMCK it would add a
+ * file and line to the calls.
+ */
+static char*
+rwBTreeAlloc(size_t sz)
+{
+#ifdef RW_DONT_USE_MEMORY_POOL
+  return new char[sz];
+#else
+  return (char*)RWMemoryPool::operator new(sz);
+#endif
+}
+
+static void
+rwBTreeFree(char* p, size_t sz)
+{
+#ifdef RW_DONT_USE_MEMORY_POOL
+  RWVECTOR_DELETE(sz) p;
+#else
+  RWMemoryPool::operator delete(p, sz);
+#endif
+}
+
 #ifndef RW_NO_CPP_RECURSION
 # define new rwnew
 #endif
 
 enum returnStatus {more, success, ignored};
 
+// Nodes are sized to, and aligned on, multiples of this:
+const unsigned rwcacheline = 64;
+
+// Whole cache lines for the header, 2*order keys and 2*order+1 sons.
+static size_t
+rwBTreeNodeSize(unsigned order)
+{
+  unsigned n = 2*order;
+  size_t hdr  = (sizeof(RWBTreeNode) + sizeof(RWBTreeKey) - 1) / sizeof(RWBTreeKey);
+  size_t size = (hdr + n) * sizeof(RWBTreeKey) + (n+1) * sizeof(RWBTreeNode*);
+  return (size + rwcacheline - 1) / rwcacheline * rwcacheline;
+}
+
 RWDEFINE_COLLECTABLE2(RWBTree, __RWBTREE)
 
 RWBTree::RWBTree()
 {
   root = rwnil;
+  order_ = rworder;
+  prefixed_ = TRUE;
   tempNode = rwnil;
-  tempKey = rwnil;
+  tempKey.item = rwnil;
+}                                           
+
+RWBTree::RWBTree(unsigned order)
+{
+  RWPRECONDITION2(order>0, "RWBTree::RWBTree(unsigned): order must be at least one");
+  root = rwnil;
+  order_ = order;
+  prefixed_ = TRUE;
+  tempNode = rwnil;
+  tempKey.item = rwnil;
 }                                           
 
 /*********************************************************
@@ -136,27 +188,44 @@ RWBTree::RWBTree()
 *							  *
 **********************************************************/
 
-RWBTreeNode::RWBTreeNode(RWCollectable* k)
+RWBTreeNode*
+RWBTreeNode::create(unsigned order)
 {
-  initialize();
-  key[0]  = k;
-  counter = 1;
+  unsigned n = 2*order;
+  size_t hdr  = (sizeof(RWBTreeNode) + sizeof(RWBTreeKey) - 1) / sizeof(RWBTreeKey);
+
+  char* block = rwBTreeAlloc(rwBTreeNodeSize(order) + rwcacheline - 1);
+  char* start = block + (rwcacheline - (unsigned long)block % rwcacheline) % rwcacheline;
+  RWBTreeNode* b = (RWBTreeNode*)start;
+  b->block   = block;
+  b->counter = 0;
+  b->key     = (RWBTreeKey*)b + hdr;
+  b->next    = (RWBTreeNode**)(b->key + n);
+  for (register unsigned i = 0; i < n; i++) {
+    b->next[i]     = rwnil;
+    b->key[i].item = rwnil;
+  }
+  b->next[n] = rwnil;  
+  return b;
 }
 
-RWBTreeNode::RWBTreeNode()
+void
+RWBTreeNode::destroy(RWBTreeNode* b, unsigned order)
 {
-  initialize();
+  rwBTreeFree(b->block, rwBTreeNodeSize(order) + rwcacheline - 1);
 }
 
-void
-RWBTreeNode::initialize()
+/*
+ * Compare key[i] with k, returning <0, 0 or >0 as key[i] is less
+ * than, equal to, or greater than k.  If usePrefix is set, the
+ * prefixes are trusted to order the two whenever they differ.
+ */
+int
+RWBTreeNode::compare(unsigned i, const RWBTreeKey& k, RWBoolean usePrefix) const
 {
-  counter = 0;
-  for (register unsigned i = 0; i< rworder2; i++) {
-    next[i] = rwnil;
-    key[i]  = rwnil;
-  }
-  next[rworder2] = rwnil;  
+  if (usePrefix && key[i].prefix != k.prefix)
+    return key[i].prefix < k.prefix ? -1 : 1;
+  return key[i].item->compareTo(k.item);
 }
 
 // binary search of node for key a
@@ -164,16 +233,16 @@ RWBTreeNode::initialize()
 //		1 for a > all keys
 //		r, where  key[r-1] < a <= key[r]
 unsigned
-RWBTreeNode::binarySearch(const RWCollectable* a)	const
+RWBTreeNode::binarySearch(const RWBTreeKey& a, RWBoolean usePrefix)	const
 {
   unsigned n = counter-1;
-  if ( key[0]->compareTo(a) >= 0 ) return 0;
-  if ( key[n]->compareTo(a) < 0 ) return counter;
+  if ( compare(0, a, usePrefix) >= 0 ) return 0;
+  if ( compare(n, a, usePrefix) < 0 ) return counter;
   unsigned l = 0;
   unsigned r = n;
   while (r-l > 1) {
     unsigned i = r+l >> 1;     // bitwise divide by two
-    if ( key[i]->compareTo(a) >= 0 )
+    if ( compare(i, a, usePrefix) >= 0 )
       r=i;
     else
       l=i;
@@ -208,7 +277,7 @@ RWBTreeNode::subSetOf(const RWBTree& bt) const
 
   // Check all keys:
   for(i=0; i<counter; i++)
-    if( !bt.contains(key[i]) ) return FALSE;
+    if( !bt.contains(key[i].item) ) return FALSE;
 
   return TRUE;
 }
@@ -222,8 +291,10 @@ RWBTreeNode::subSetOf(const RWBTree& bt) const
 RWBTree::RWBTree(const RWBTree& bt)
 {
   root = rwnil;
+  order_ = bt.order_;
+  prefixed_ = TRUE;
   tempNode = rwnil;
-  tempKey = rwnil;
+  tempKey.item = rwnil;
   *this += bt;
 }
   
@@ -280,6 +351,7 @@ RWBTree::clear()
 {
    del(root);
    root=rwnil;
+   prefixed_ = TRUE;
 }
 
 // Number of items in tree:
@@ -292,18 +364,21 @@ RWBTree::entries() const
 }
 
 /*
- * Find an item that compares equal.  Uses the
- * virtual function compareTo() to zero in on the item.
+ * Find an item that compares equal.  Uses the cached ordering
+ * prefixes, then the virtual function compareTo(), to zero in
+ * on the item.
  */
 RWCollectable*
 RWBTree::find(const RWCollectable* k) const
 {
   unsigned i;
+  RWBTreeKey a;
+  RWBoolean usePrefix = probe(k, a);
   RWBTreeNode* temp = root; 
   while ( temp != rwnil ) {
-    i = temp->binarySearch(k);	// Search current node.
-    if (i < temp->counter && temp->key[i]->compareTo(k) == 0 )
-       return temp->key[i];	// Found it!
+    i = temp->binarySearch(a, usePrefix);	// Search current node.
+    if (i < temp->counter && temp->compare(i, a, usePrefix) == 0 )
+       return temp->key[i].item;	// Found it!
     temp = temp->next[i];	// Follow tree to next node.
   }
   return rwnil;	// not found.
@@ -316,10 +391,15 @@ RWBTree::find(const RWCollectable* k) const
 RWCollectable*
 RWBTree::insert(RWCollectable* k)
 {
-  int status = ins(k, root);	    // Recursive function to attempt insertion.
+  RWBTreeKey a;
+  a.item = k;
+  if (!k->orderingPrefix(a.prefix)) prefixed_ = FALSE;
+  int status = ins(a, root);	    // Recursive function to attempt insertion.
   if (status == success) return k;  // Successful uncomplicated insertion.
-  else if (status == ignored) return tempKey;	// Item already present--ignore
-  RWBTreeNode* newNode = new RWBTreeNode(tempKey); // Create new root node.
+  else if (status == ignored) return tempKey.item;	// Item already present--ignore
+  RWBTreeNode* newNode = RWBTreeNode::create(order_); // Create new root node.
+  newNode->key[0]  = tempKey;
+  newNode->counter = 1;
   newNode->next[0] = root;			// Assign pointers to children.
   newNode->next[1] = tempNode;
   root = newNode;
@@ -343,12 +423,14 @@ RWCollectable*
 RWBTree::remove(const RWCollectable* k)
 {
   RWCollectable* victim = 0;
+  RWBTreeKey a;
+  RWBoolean usePrefix = probe(k, a);
   
   // Check for uncomplicated removal:
-  if ( rem(k, root, victim) == more ){
+  if ( rem(a, usePrefix, root, victim) == more ){
     // If underflow, decrease the height of the tree:
     RWBTreeNode* newRoot = root->next[0];
-    delete root; 
+    RWBTreeNode::destroy(root, order_); 
     root = newRoot;
   }
   return victim;
@@ -360,6 +442,18 @@ RWBTree::remove(const RWCollectable* k)
 *							*
 *********************************************************/
 
+/*
+ * Set up a search key for item k.  Returns TRUE if its prefix
+ * can be compared against those of the keys in the tree.
+ */
+RWBoolean
+RWBTree::probe(const RWCollectable* k, RWBTreeKey& a) const
+{
+  a.item = (RWCollectable*)k;
+  a.prefix = 0;
+  return prefixed_ && k->orderingPrefix(a.prefix);
+}
+
 // Recursive function to examine all member items:
 void 
 RWBTree::apl(RWBTreeNode* t, RWapplyCollectable ap, void* x) 
@@ -367,7 +461,7 @@ RWBTree::apl(RWBTreeNode* t, RWapplyCollectable ap, void* x)
    if(t) {
      for (unsigned i=0; i < t->counter; i++){
        apl(t->next[i], ap, x);	// First examine all children to left...
-       (*ap)(t->key[i], x);	//    then the key.
+       (*ap)(t->key[i].item, x);	//    then the key.
      }
      apl(t->next[t->counter], ap, x); // Finally, do the last daughter.
    }
@@ -380,16 +474,17 @@ RWBTree::del(RWBTreeNode* t)
   if (t) { 
     unsigned n = t->counter+1;
     for (i=0; i<n; i++) del(t->next[i]);
-    delete t;
+    RWBTreeNode::destroy(t, order_);
   }
 }
 
 // Recursive function to insert "k" in tree rooted at b:
 int
-RWBTree::ins(RWCollectable* k, RWBTreeNode* b)
+RWBTree::ins(const RWBTreeKey& k, RWBTreeNode* b)
 {
   unsigned i, j;
   int status;
+  const unsigned order2 = 2*order_;
 
   /*
    * Check if b is a pointer in a leaf.  
@@ -401,9 +496,9 @@ RWBTree::ins(RWCollectable* k, RWBTreeNode* b)
     return more;
   }
 
-  i = b->binarySearch(k);		// Search node.
+  i = b->binarySearch(k, prefixed_);		// Search node.
 
-  if (i < b->counter && b->key[i]->compareTo(k)==0 ){
+  if (i < b->counter && b->compare(i, k, prefixed_)==0 ){
     tempKey = b->key[i];		// Duplicate key found.  Remember where it is.
     return ignored;			// Signal the problem.
   }
@@ -415,12 +510,12 @@ RWBTree::ins(RWCollectable* k, RWBTreeNode* b)
    * Insertion in subtree did not completely succeed;
    * try to insert the overflow in the current node:
    */
-  if (b->counter < rworder2) {
+  if (b->counter < order2) {
     /*
      * There's room in this node.  Figure out where to put the
      * overflow, then slide everything over.
      */
-    i = b->binarySearch(tempKey);
+    i = b->binarySearch(tempKey, prefixed_);
     for (j=b->counter; j>i; j--) {
        b->key[j]    = b->key[j-1];
        b->next[j+1] = b->next[j];
@@ -434,21 +529,21 @@ RWBTree::ins(RWCollectable* k, RWBTreeNode* b)
 
   /*
    * No room in current node.  We'll have to split it.
-   * Pass item key[rworder] (which is in the middle of the augmented
+   * Pass item key[order] (which is in the middle of the augmented
    * sequence) back up the tree for someone else to deal with it.
    * Also, pass the address of the new node back up. 
    */
-  RWCollectable* lastKey;
+  RWBTreeKey lastKey;
   RWBTreeNode* lastPointer;
 
-  if (i == rworder2) {
+  if (i == order2) {
      lastKey     = tempKey;
      lastPointer = tempNode;
   } 
   else {
-     lastKey     = b->key[rworder2-1];
-     lastPointer = b->next[rworder2];
-     for (j=rworder2-1; j>i; j--) {
+     lastKey     = b->key[order2-1];
+     lastPointer = b->next[order2];
+     for (j=order2-1; j>i; j--) {
 	 b->key[j]    = b->key[j-1];
 	 b->next[j+1] = b->next[j];
      }
@@ -456,55 +551,54 @@ RWBTree::ins(RWCollectable* k, RWBTreeNode* b)
      b->next[i+1] = tempNode;
   }
 
-  tempNode = new RWBTreeNode();	// Get a new node.
-  tempNode->counter = rworder;	// Set its counter.
-  tempKey = b->key[rworder];	// Get the key that will get passed back up.
-  b->counter = rworder;		// Set the new counter.
+  tempNode = RWBTreeNode::create(order_);	// Get a new node.
+  tempNode->counter = order_;	// Set its counter.
+  tempKey = b->key[order_];	// Get the key that will get passed back up.
+  b->counter = order_;		// Set the new counter.
 
   /* Transfer the info over to the new node: */
-  for (j=0; j<rworder-1; j++) {
-    tempNode->key[j]  = b->key[j+rworder+1];
-    tempNode->next[j] = b->next[j+rworder+1];
+  for (j=0; j<order_-1; j++) {
+    tempNode->key[j]  = b->key[j+order_+1];
+    tempNode->next[j] = b->next[j+order_+1];
   }
 
-  tempNode->next[rworder-1] = b->next[rworder2];
-  tempNode->key[rworder-1]  = lastKey;
-  tempNode->next[rworder]   = lastPointer;
+  tempNode->next[order_-1] = b->next[order2];
+  tempNode->key[order_-1]  = lastKey;
+  tempNode->next[order_]   = lastPointer;
   return more;
 }
   
 /* Recursive function to remove key "a" from tree rooted at b: */
 int 
-RWBTree::rem(const RWCollectable* a, RWBTreeNode* b, RWCollectable*& victim)
+RWBTree::rem(const RWBTreeKey& a, RWBoolean usePrefix, RWBTreeNode* b, RWCollectable*& victim)
 {
   if (b == rwnil) return ignored;	// No node.
   
   unsigned     		i,j;
   unsigned     		leftCounter, rightCounter;
-  RWCollectable*	temp;
+  RWBTreeKey		temp;
   RWBTreeNode* 		leftNode;
   RWBTreeNode* 		rightNode;
   
-  i = b->binarySearch(a);	// Search current node.
+  i = b->binarySearch(a, usePrefix);	// Search current node.
   
   if (b->next[0] == rwnil) {	// b is a terminal node.
-    if (i == b->counter || b->key[i]->compareTo(a) > 0 )
+    if (i == b->counter || b->compare(i, a, usePrefix) > 0 )
       return ignored;                                   
-    victim = b->key[i];
+    victim = b->key[i].item;
     for (j=i+1; j<b->counter; j++) {	// Remove item.
       b->key[j-1]  = b->key[j];    
       b->next[j]   = b->next[j+1];
     }
     --b->counter;	// decrement field index
-    return b->counter >= (b==root ? 1 : rworder);
+    return b->counter >= (b==root ? 1 : order_);
   }
   
   // b is not a terminal node.
   
-  temp        =  b->key[i];
   leftNode    =  b->next[i];
   leftCounter =  leftNode->counter;
-  if( i < b->counter && temp->compareTo(a) == 0 ) { // found it!
+  if( i < b->counter && b->compare(i, a, usePrefix) == 0 ) { // found it!
     
     // Go to left child, then follow rightmost branches to a terminal node.
     
@@ -518,14 +612,15 @@ RWBTree::rem(const RWCollectable* a, RWBTreeNode* b, RWCollectable*& victim)
     
     // Exchange item in b with last item in terminal node.
     
+    temp        =  b->key[i];
     b->key[i]   =  tempNode1->key[tempCounter-1];
     tempNode1->key[tempCounter-1]  =  temp;
-    temp    =  b->key[i];
   }
+  if (i < b->counter) temp = b->key[i];
   
   // Now find and remove a.
   
-  int status = rem(a, leftNode, victim);    // Recursive function to attempt removal.
+  int status = rem(a, usePrefix, leftNode, victim);    // Recursive function to attempt removal.
   if (status != more) return status;      // Successful removal.
   
   // Underflow:  Borrow item from right sibling if possible, otherwise borrow 
@@ -553,12 +648,12 @@ RWBTree::rem(const RWCollectable* a, RWBTreeNode* b, RWCollectable*& victim)
     rightNode->next[0] = leftNode->next[leftCounter];
     b->key[i-1]  = leftNode->key[leftCounter-1];
     temp         = leftNode->key[leftCounter-1];
-    if (--leftNode->counter >= rworder) return success;
+    if (--leftNode->counter >= order_) return success;
   }  
   else {      // Borrow from right sibling.
-     if (rightCounter > rworder)	{     // Merging not necessary.
-         leftNode->key[rworder-1]  = temp;
-	  leftNode->next[rworder]   = rightNode->next[0];
+     if (rightCounter > order_)	{     // Merging not necessary.
+         leftNode->key[order_-1]  = temp;
+	  leftNode->next[order_]   = rightNode->next[0];
 	  b->key[i]   = rightNode->key[0];
 	  temp        = rightNode->key[0];
 	  ++leftNode->counter;
@@ -574,20 +669,19 @@ RWBTree::rem(const RWCollectable* a, RWBTreeNode* b, RWCollectable*& victim)
   }
 
   // If you get to here, nodes must be merged.
-  leftNode->key[rworder-1]  = temp;
-  leftNode->next[rworder]   = rightNode->next[0];
-  for (j=0; j<rworder; j++) {
-      leftNode->next[rworder+j+1] =  rightNode->next[j+1];
-      leftNode->key[rworder+j]   =  rightNode->key[j];
+  leftNode->key[order_-1]  = temp;
+  leftNode->next[order_]   = rightNode->next[0];
+  for (j=0; j<order_; j++) {
+      leftNode->next[order_+j+1] =  rightNode->next[j+1];
+      leftNode->key[order_+j]   =  rightNode->key[j];
   }
 
-  leftNode->counter =  rworder2;
-  delete rightNode;
+  leftNode->counter =  2*order_;
+  RWBTreeNode::destroy(rightNode, order_);
 
   for (j=i+1; j<b->counter; j++) {  // fix up parent node
       b->key[j-1]  = b->key[j];
       b->next[j]   = b->next[j+1];
   }
-  return --b->counter >= (b==root ? 1 : rworder);
+  return --b->counter >= (b==root ? 1 : order_);
 }
-
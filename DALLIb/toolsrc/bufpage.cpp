@@ -116,61 +116,73 @@ RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: bufpage.cpp,v $ $Revis
 # define new rwnew
 #endif
 
+/*
+ * What a buffer holds.  Kept together so that a lookup touches one
+ * place in memory.
+ */
+class RWPageBuffer
+{
+public:
+  char*			buffer;		// pageSize() bytes
+  RWHandle		handle;		// Zero if the slot is unused
+  size_t		next;		// Hash chain, or chain of unused slots
+  short			lockCount;	// Number of outstanding locks
+  char			referenced;	// Used since the clock hand passed
+  char			dirty;		// Changed since swap in
+};
+
 RWBufferedPageHeap::RWBufferedPageHeap(unsigned pgsize, unsigned nbufs) :
   RWVirtualPageHeap(pgsize),
-  nBuffers_(nbufs)
+  nBuffers_(nbufs),
+  buckets_(rwnil),
+  nbuckets_(1),
+  unused_(RW_NPOS),
+  hand_(0)
 {
   RWPRECONDITION2(nbufs, "RWBufferedPageHeap::RWBufferedPageHeap(): Number of buffers must be greater than zero");
   RWPRECONDITION2(pgsize,"RWBufferedPageHeap::RWBufferedPageHeap(): Page size must be greater than zero");
 
-  buffers_    = new RWvoid[nbufs];
-  handles_    = new RWHandle[nbufs];
-  lockCounts_ = new short[nbufs];
-  age_        = new unsigned[nbufs];
-  dirty_      = new RWBoolean[nbufs];
+  slots_ = new RWPageBuffer[nbufs];
+  if (slots_ == rwnil) return;
 
-  if (buffers_ && handles_ && lockCounts_ && age_) {
-    for (unsigned i=0; i<nbufs; i++) {
-      // Here's where the actual buffer space is allocated:
-      buffers_[i] = new char[pgsize];	
-      if (!buffers_[i]) {
-        nBuffers_ = i;		// If no memory, reduce the number of buffers
-	break;
-      }
-      handles_[i]    = 0;	// Zero handle is never valid; use to mark an unused slot
-      lockCounts_[i] = 0;	// Number of outstanding locks
-      age_[i]        = 0;	// Age in use counts
-      dirty_[i]      = FALSE;	// Initially, buffer is not dirty; avoids initial swap
+  register unsigned i;
+  for (i=0; i<nbufs; i++) {
+    // Here's where the actual buffer space is allocated:
+    slots_[i].buffer = new char[pgsize];
+    if (!slots_[i].buffer) {
+      nBuffers_ = i;		// If no memory, reduce the number of buffers
+      break;
     }
+    slots_[i].handle     = 0;	// Zero handle is never valid; use to mark an unused slot
+    slots_[i].lockCount  = 0;
+    slots_[i].referenced = FALSE;
+    slots_[i].dirty      = FALSE; // Initially, buffer is not dirty; avoids initial swap
   }
-  else {
-    delete dirty_;
-    delete age_;
-    delete lockCounts_;
-    delete handles_;
-    delete buffers_;
-    buffers_ = rwnil;
+  for (i=nBuffers_; i>0; i--) {
+    slots_[i-1].next = unused_;
+    unused_ = i-1;
   }
+
+  // Hash table of handle to slot, with a load factor under 1:
+  while (nbuckets_ < nBuffers_) nbuckets_ <<= 1;
+  buckets_ = new size_t[nbuckets_];
+  for (i=0; i<nbuckets_; i++) buckets_[i] = RW_NPOS;
 }
 
 RWBufferedPageHeap::~RWBufferedPageHeap()
 {
-  for (unsigned i=0; i<nBuffers_; i++) {
-    if (lockCounts_[i] > 0) {
+  if (slots_ == rwnil) return;
+  register unsigned i;
+  for (i=0; i<nBuffers_; i++) {
+    if (slots_[i].lockCount > 0) {
       RWTHROW(RWInternalErr(RWMessage(RWTOOL_LOCK)));
     }
   }
 
-  if (buffers_) {
-    for (unsigned j=0; j<nBuffers_; j++) {
-      delete buffers_[j];
-    }
-  }
-  delete dirty_;
-  delete age_;
-  delete lockCounts_;
-  delete handles_;
-  delete buffers_;
+  for (i=0; i<nBuffers_; i++)
+    RWVECTOR_DELETE(pageSize()) slots_[i].buffer;
+  RWVECTOR_DELETE(nbuckets_) buckets_;
+  RWVECTOR_DELETE(nBuffers_) slots_;
 }
 
 /*
@@ -181,7 +193,13 @@ void
 RWBufferedPageHeap::deallocate(RWHandle h)
 {
   size_t islot = findHandle(h);
-  if (islot!=RW_NPOS) handles_[islot] = 0;
+  if (islot!=RW_NPOS) {
+    hashRemove(islot);
+    slots_[islot].handle = 0;
+    slots_[islot].dirty  = FALSE;
+    slots_[islot].next   = unused_;
+    unused_ = islot;
+  }
 }
 
 /*
@@ -196,10 +214,10 @@ RWBufferedPageHeap::dirty(RWHandle h)
   RWPRECONDITION2(isValid(), "RWBufferedPageHeap::dirty(RWHandle): RWBufferedPageHeap is invalid");
   RWPRECONDITION2(h, "RWBufferedPageHeap::dirty(RWHandle): Handle must be nonzero");
   size_t islot = findHandle(h);
-  if (islot==RW_NPOS || lockCounts_[islot]==0) {
+  if (islot==RW_NPOS || slots_[islot].lockCount==0) {
     RWTHROW(RWInternalErr(RWMessage(RWTOOL_UNLOCK)));
   }
-  dirty_[islot] = TRUE;
+  slots_[islot].dirty = TRUE;
 }
 
 /*
@@ -212,13 +230,17 @@ RWBufferedPageHeap::lock(RWHandle h)
   RWPRECONDITION2(isValid(), "RWBufferedPageHeap::lock(RWHandle): RWBufferedPageHeap is invalid");
   RWPRECONDITION2(h, "RWBufferedPageHeap::lock(RWHandle): Handle must be nonzero");
 
-  size_t islot = ageAndFindHandle(h);
+  stats_.locks++;
+  size_t islot = findHandle(h);
   if (islot == RW_NPOS) {
-    if ( (islot = swapPageIn(h)) ==RW_NPOS ) return NULL;
+    if ( (islot = swapPageIn(h)) ==RW_NPOS ) return rwnil;
   }
-  lockCounts_[islot]++;
-  age_[islot] = 0;
-  return buffers_[islot];
+  else
+    stats_.lockHits++;
+  RWPageBuffer& slot = slots_[islot];
+  slot.lockCount++;
+  slot.referenced = TRUE;
+  return slot.buffer;
 }
 
 /*
@@ -231,10 +253,10 @@ RWBufferedPageHeap::unlock(RWHandle h)
   RWPRECONDITION2(isValid(), "RWBufferedPageHeap::unlock(RWHandle): RWBufferedPageHeap is invalid");
   RWPRECONDITION2(h, "RWBufferedPageHeap::unlock(RWHandle): Handle must be nonzero");
   size_t islot = findHandle(h);
-  if (islot==RW_NPOS || lockCounts_[islot]==0) {
+  if (islot==RW_NPOS || slots_[islot].lockCount==0) {
     RWTHROW(RWInternalErr(RWMessage(RWTOOL_UNLOCK)));
   }
-  lockCounts_[islot]--;
+  slots_[islot].lockCount--;
 }
 
 /************************************************
@@ -243,75 +265,111 @@ RWBufferedPageHeap::unlock(RWHandle h)
  *						*
  ************************************************/
 
-size_t
-RWBufferedPageHeap::ageAndFindHandle(RWHandle h)
-{
-  size_t islot = RW_NPOS;
-  for (register unsigned i=0; i<nBuffers_; i++){
-    if (handles_[i]==h) islot = i;
-    age_[i]++;		// Age all buffers
-  }
-  return islot;
-}
-
 size_t
 RWBufferedPageHeap::findHandle(register RWHandle h)
 {
-  for (register unsigned islot=0; islot<nBuffers_; islot++)
-    if (handles_[islot]==h) return islot;
-  return RW_NPOS;
+  register size_t islot = buckets_[hashHandle(h)];
+  while (islot != RW_NPOS && slots_[islot].handle != h)
+    islot = slots_[islot].next;
+  return islot;
 }
 
+// Take a slot off the chain of those holding no page.
 size_t
 RWBufferedPageHeap::findUnusedSlot()
 {
-  for (register unsigned islot=0; islot<nBuffers_; islot++)
-    if (handles_[islot]==0) return islot;
-  return RW_NPOS;
+  size_t islot = unused_;
+  if (islot != RW_NPOS) unused_ = slots_[islot].next;
+  return islot;
 }
 
 size_t
 RWBufferedPageHeap::swapPageIn(RWHandle h)
 {
   size_t islot = findUnusedSlot();
-  if (islot==RW_NPOS)  islot = swapOutLRUSlot();
+  if (islot==RW_NPOS)  islot = swapOutVictim();
 
   if (islot!=RW_NPOS) {
-    swapIn(h, buffers_[islot]);		// Virtual function provided by specializing class
-    handles_[islot]    = h;
-    dirty_[islot]      = FALSE;
-    lockCounts_[islot] = 0;
-    age_[islot]        = 0;
+    stats_.swapIns++;
+    RWPageBuffer& slot = slots_[islot];
+    swapIn(h, slot.buffer);		// Virtual function provided by specializing class
+    slot.handle     = h;
+    slot.dirty      = FALSE;
+    slot.lockCount  = 0;
+    slot.referenced = TRUE;
+    hashInsert(islot);
   }
   return islot;
 }
 
 /*
- * Search for the least recently used slot.  If the buffer in it is
- * "dirty", then it should be swapped out before being used.
- *
- * Under some circumstances, this algorithm could be improved by 
- * preferring "clean" slots, even though they might not be as old
- * as some other "dirty" slots.  This would avoid the swap out.
+ * Move the clock hand on to a slot which is not locked and has not
+ * been used since the hand last passed it, taking away the second
+ * chance of those which have.  Two turns find one unless every slot
+ * is locked.  If the page in it is "dirty", it is swapped out before
+ * the slot is handed back, empty.
  */
 
 size_t
-RWBufferedPageHeap::swapOutLRUSlot()
+RWBufferedPageHeap::swapOutVictim()
 {
-  if (nBuffers_==0) return RW_NPOS;
+  for (register unsigned n = 2*nBuffers_; n > 0; n--) {
+    size_t islot = hand_;
+    if (++hand_ == nBuffers_) hand_ = 0;
+    RWPageBuffer& slot = slots_[islot];
+    if (slot.lockCount) continue;
+    if (slot.referenced) {
+      slot.referenced = FALSE;
+      continue;
+    }
+    stats_.evictions++;
+    hashRemove(islot);
+    if (slot.dirty) {
+      stats_.swapOuts++;
+      swapOut(slot.handle, slot.buffer);
+    }
+    slot.handle = 0;
+    slot.dirty  = FALSE;
+    return islot;
+  }
+  return RW_NPOS;
+}
 
-  size_t islot  = RW_NPOS;
-  unsigned maxAge = 0;
+/************************************************
+ *						*
+ *		PRIVATE FUNCTIONS		*
+ *						*
+ ************************************************/
 
-  for (register unsigned i=0; i<nBuffers_; i++) {
-    if (lockCounts_[i]==0 && age_[i] >= maxAge)
-      {maxAge=age_[islot=i];}
-  }
+/*
+ * Handles are usually given out in sequence.  Multiplying by an odd
+ * constant keeps a run of them in distinct buckets.
+ */
+unsigned
+RWBufferedPageHeap::hashHandle(RWHandle h) const
+{
+  return (unsigned)((unsigned long)h * 2654435761UL) & (nbuckets_-1);
+}
 
-  if (islot!=RW_NPOS && dirty_[islot]) 
-    swapOut(handles_[islot], buffers_[islot]);
+void
+RWBufferedPageHeap::hashInsert(size_t islot)
+{
+  size_t& bucket = buckets_[hashHandle(slots_[islot].handle)];
+  slots_[islot].next = bucket;
+  bucket = islot;
+}
 
-  return islot;
+void
+RWBufferedPageHeap::hashRemove(size_t islot)
+{
+  size_t* p = &buckets_[hashHandle(slots_[islot].handle)];
+  while (*p != RW_NPOS) {
+    if (*p == islot) {
+      *p = slots_[islot].next;
+      return;
+    }
+    p = &slots_[*p].next;
+  }
 }
 
 
@@ -111,25 +111,392 @@ ENDWRAP
 # define new rwnew
 #endif
 
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                           RWCacheReplacer                            //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Abstract base class for the block replacement policies.  The cache
+ * manager tells the policy whenever a slot is filled or referenced, and
+ * asks it for a victim when all slots are in use.  Every operation is
+ * constant time.
+ */
+class RWCacheReplacer
+{
+  RW_DECLARE_HOME(RWCacheReplacer)
+public:
+
+  RWCacheReplacer(unsigned nslots, const RWoffset* addrs)
+    : nslots_(nslots), addrs_(addrs) {;}
+  virtual ~RWCacheReplacer() {;}
+
+  virtual void		inserted(size_t)	= 0; // Slot was just filled
+  virtual void		touched(size_t)		= 0; // Slot was just referenced
+  virtual size_t	victim()		= 0; // Choose and release a slot
+  virtual void		reset()			= 0; // Forget all slots
+
+protected:
+
+  unsigned		nslots_;
+  const RWoffset*	addrs_;		// Disk address of each slot
+};
+
+  RW_DEFINE_HOME(RWCacheReplacer)
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                            RWLRUReplacer                             //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Exact LRU.  The slots are kept on a doubly linked list, threaded
+ * through the arrays prev_ and next_, most recently used at the head.
+ */
+class RWLRUReplacer : public RWCacheReplacer
+{
+
+public:
+
+  RWLRUReplacer(unsigned nslots, const RWoffset* addrs);
+  virtual ~RWLRUReplacer();
+
+  virtual void		inserted(size_t s)	{link(s, head_, tail_);}
+  virtual void		touched(size_t s);
+  virtual size_t	victim();
+  virtual void		reset()			{head_ = tail_ = RW_NPOS;}
+
+protected:
+
+  void			link(size_t, size_t& head, size_t& tail);
+  void			unlink(size_t, size_t& head, size_t& tail);
+
+  size_t*		prev_;
+  size_t*		next_;
+  size_t		head_;		// Most recently used
+  size_t		tail_;		// Least recently used
+};
+
+RWLRUReplacer::RWLRUReplacer(unsigned nslots, const RWoffset* addrs)
+ : RWCacheReplacer(nslots, addrs),
+   head_(RW_NPOS),
+   tail_(RW_NPOS)
+{
+  prev_ = new size_t[nslots_];
+  next_ = new size_t[nslots_];
+}
+
+RWLRUReplacer::~RWLRUReplacer()
+{
+  RWVECTOR_DELETE(nslots_) next_;
+  RWVECTOR_DELETE(nslots_) prev_;
+}
+
+void
+RWLRUReplacer::touched(size_t s)
+{
+  if (s != head_)
+  {
+    unlink(s, head_, tail_);
+    link(s, head_, tail_);
+  }
+}
+
+size_t
+RWLRUReplacer::victim()
+{
+  size_t s = tail_;
+  RWPRECONDITION(s != RW_NPOS);
+  unlink(s, head_, tail_);
+  return s;
+}
+
+// Put slot s at the head of the list:
+void
+RWLRUReplacer::link(size_t s, size_t& head, size_t& tail)
+{
+  prev_[s] = RW_NPOS;
+  next_[s] = head;
+  if (head != RW_NPOS) prev_[head] = s;
+  head = s;
+  if (tail == RW_NPOS) tail = s;
+}
+
+void
+RWLRUReplacer::unlink(size_t s, size_t& head, size_t& tail)
+{
+  if (prev_[s] != RW_NPOS) next_[prev_[s]] = next_[s];
+  else                     head = next_[s];
+  if (next_[s] != RW_NPOS) prev_[next_[s]] = prev_[s];
+  else                     tail = prev_[s];
+}
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                           RWClockReplacer                            //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * CLOCK (second chance).  Each slot has a reference bit which is set
+ * on every use.  The hand sweeps the slots, clearing set bits, and
+ * evicts the first slot whose bit is already clear.  Cheaper than exact
+ * LRU on a hit: no list manipulation at all.
+ */
+class RWClockReplacer : public RWCacheReplacer
+{
+
+public:
+
+  RWClockReplacer(unsigned nslots, const RWoffset* addrs);
+  virtual ~RWClockReplacer();
+
+  virtual void		inserted(size_t s)	{ref_[s] = 1;}
+  virtual void		touched(size_t s)	{ref_[s] = 1;}
+  virtual size_t	victim();
+  virtual void		reset()			{hand_ = 0;}
+
+private:
+
+  char*			ref_;		// Reference bits
+  size_t		hand_;		// Next slot to be examined
+};
+
+RWClockReplacer::RWClockReplacer(unsigned nslots, const RWoffset* addrs)
+ : RWCacheReplacer(nslots, addrs),
+   hand_(0)
+{
+  ref_ = new char[nslots_];
+  memset(ref_, 0, nslots_);
+}
+
+RWClockReplacer::~RWClockReplacer()
+{
+  RWVECTOR_DELETE(nslots_) ref_;
+}
+
+size_t
+RWClockReplacer::victim()
+{
+  // Terminates within two sweeps: the first clears every bit.
+  while (ref_[hand_])
+  {
+    ref_[hand_] = 0;
+    if (++hand_ == nslots_) hand_ = 0;
+  }
+  size_t s = hand_;
+  if (++hand_ == nslots_) hand_ = 0;
+  return s;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                           RWTwoQReplacer                             //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Simplified 2Q (Johnson & Shasha).  New blocks enter a FIFO queue,
+ * "A1in", which holds about a quarter of the slots.  Blocks falling out
+ * of A1in have their disk address remembered on a "ghost" queue, A1out.
+ * A block which is read again while on A1out has proven itself and goes
+ * to the LRU queue "Am".  Hence a long sequential scan (for instance, an
+ * applyToKeyAndValue() over a B-Tree) only ever flushes A1in and cannot
+ * push hot blocks, such as the upper levels of a tree, out of Am.
+ */
+class RWTwoQReplacer : public RWLRUReplacer
+{
+
+public:
+
+  RWTwoQReplacer(unsigned nslots, const RWoffset* addrs);
+  virtual ~RWTwoQReplacer();
+
+  virtual void		inserted(size_t);
+  virtual void		touched(size_t);
+  virtual size_t	victim();
+  virtual void		reset();
+
+private:
+
+  unsigned		ghostHash(RWoffset) const;
+  size_t		ghostFind(RWoffset) const;
+  void			ghostAdd(RWoffset);
+  void			ghostRemove(size_t);
+
+  char*			inAm_;		// TRUE if the slot is on Am
+  size_t		inHead_;	// A1in queue (Am uses head_, tail_)
+  size_t		inTail_;
+  unsigned		inCount_;	// Number of slots on A1in
+  unsigned		inMax_;		// Target size of A1in
+
+  RWoffset*		ghost_;		// Ring of remembered addresses
+  unsigned		ghostMax_;	// Size of the ring
+  unsigned		ghostNext_;	// Next position to be overwritten
+  unsigned		nghostBuckets_;	// Power of 2
+  size_t*		ghostBuckets_;	// Hash chains over the ring
+  size_t*		ghostLink_;
+};
+
+RWTwoQReplacer::RWTwoQReplacer(unsigned nslots, const RWoffset* addrs)
+ : RWLRUReplacer(nslots, addrs),
+   inHead_(RW_NPOS),
+   inTail_(RW_NPOS),
+   inCount_(0),
+   ghostNext_(0)
+{
+  inMax_    = nslots_/4    ? nslots_/4 : 1;
+  ghostMax_ = nslots_/2    ? nslots_/2 : 1;
+  nghostBuckets_ = 1;
+  while (nghostBuckets_ < ghostMax_) nghostBuckets_ <<= 1;
+
+  inAm_         = new char[nslots_];
+  ghost_        = new RWoffset[ghostMax_];
+  ghostLink_    = new size_t[ghostMax_];
+  ghostBuckets_ = new size_t[nghostBuckets_];
+  reset();
+}
+
+RWTwoQReplacer::~RWTwoQReplacer()
+{
+  RWVECTOR_DELETE(nghostBuckets_) ghostBuckets_;
+  RWVECTOR_DELETE(ghostMax_) ghostLink_;
+  RWVECTOR_DELETE(ghostMax_) ghost_;
+  RWVECTOR_DELETE(nslots_) inAm_;
+}
+
+void
+RWTwoQReplacer::inserted(size_t s)
+{
+  size_t g = ghostFind(addrs_[s]);
+  if (g != RW_NPOS)
+  {
+    // Seen recently: it has earned a place on Am.
+    ghostRemove(g);
+    inAm_[s] = TRUE;
+    link(s, head_, tail_);
+  }
+  else
+  {
+    inAm_[s] = FALSE;
+    link(s, inHead_, inTail_);
+    inCount_++;
+  }
+}
+
+void
+RWTwoQReplacer::touched(size_t s)
+{
+  // References while on A1in are assumed to be correlated and ignored.
+  if (inAm_[s]) RWLRUReplacer::touched(s);
+}
+
+size_t
+RWTwoQReplacer::victim()
+{
+  size_t s;
+  if (inCount_ > inMax_ || tail_ == RW_NPOS)
+  {
+    s = inTail_;
+    RWPRECONDITION(s != RW_NPOS);
+    unlink(s, inHead_, inTail_);
+    inCount_--;
+    ghostAdd(addrs_[s]);
+  }
+  else
+    s = RWLRUReplacer::victim();
+  return s;
+}
+
+void
+RWTwoQReplacer::reset()
+{
+  RWLRUReplacer::reset();
+  inHead_ = inTail_ = RW_NPOS;
+  inCount_ = 0;
+  ghostNext_ = 0;
+  register unsigned i;
+  for (i=0; i<ghostMax_; i++)      ghost_[i] = RWNIL;
+  for (i=0; i<nghostBuckets_; i++) ghostBuckets_[i] = RW_NPOS;
+}
+
+unsigned
+RWTwoQReplacer::ghostHash(RWoffset locn) const
+{
+  unsigned long h = (unsigned long)locn;
+  h ^= h >> 15;
+  h *= 2654435761UL;
+  h ^= h >> 13;
+  return (unsigned)(h & (nghostBuckets_-1));
+}
+
+size_t
+RWTwoQReplacer::ghostFind(RWoffset locn) const
+{
+  if (locn == RWNIL) return RW_NPOS;
+  size_t g = ghostBuckets_[ghostHash(locn)];
+  while (g != RW_NPOS && ghost_[g] != locn)
+    g = ghostLink_[g];
+  return g;
+}
+
+// Remember a block that fell out of A1in, forgetting the oldest one:
+void
+RWTwoQReplacer::ghostAdd(RWoffset locn)
+{
+  if (locn == RWNIL) return;
+  size_t g = ghostNext_;
+  if (++ghostNext_ == ghostMax_) ghostNext_ = 0;
+  if (ghost_[g] != RWNIL) ghostRemove(g);
+  ghost_[g] = locn;
+  size_t& bucket = ghostBuckets_[ghostHash(locn)];
+  ghostLink_[g] = bucket;
+  bucket = g;
+}
+
+void
+RWTwoQReplacer::ghostRemove(size_t g)
+{
+  size_t* p = &ghostBuckets_[ghostHash(ghost_[g])];
+  while (*p != g)
+    p = &ghostLink_[*p];
+  *p = ghostLink_[g];
+  ghost_[g] = RWNIL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                      RWCacheManager definitions                      //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
 /*
  * Construct a cache manager for blocks of size blocksz and mxblks buffers
  */
-RWCacheManager::RWCacheManager(RWFile* file, unsigned blocksz, unsigned mxblks)
+RWCacheManager::RWCacheManager(RWFile* file, unsigned blocksz, unsigned mxblks,
+			       policyMode policy)
 {
+  RWPRECONDITION( mxblks > 0 );
   theFile_ = file;
   maxblocks_ = mxblks;
-  nused_ = 0;
   blocksize_ = blocksz;
+  policy_ = policy;
   buff_ = new char[blocksize_*maxblocks_];
-  diskAddrs_ = new RWoffset[maxblocks_];
-  useCounts_ = new unsigned[maxblocks_];
+  keepMax_ = 0;
+  allocSlots();
+
+  ahead_    = 0;
+  nextMiss_ = RWNIL;
+  stage_    = rwnil;
 }
 
 RWCacheManager::~RWCacheManager()
 {
   flush();
-  RWVECTOR_DELETE(maxblocks_) useCounts_;
-  RWVECTOR_DELETE(maxblocks_) diskAddrs_;
+  freeSlots();
+  RWVECTOR_DELETE(ahead_*blocksize_) stage_;
   RWVECTOR_DELETE(blocksize_*maxblocks_) buff_;
 }
 
@@ -148,26 +515,297 @@ void
 RWCacheManager::invalidate()
 {
   nused_ = 0;
+  nextMiss_ = RWNIL;
+  register unsigned i;
+  for (i=0; i<nbuckets_; i++)  buckets_[i] = RW_NPOS;
+  for (i=0; i<maxblocks_; i++) pins_[i] = 0;
+  memset(kept_, 0, maxblocks_);
+  keepHead_ = keepTail_ = RW_NPOS;
+  nkept_ = 0;
+  replacer_->reset();
+}
+
+unsigned
+RWCacheManager::keep(unsigned blocks)
+{
+  unsigned old = keepMax_;
+  keepMax_ = blocks < maxblocks_/2 ? blocks : maxblocks_/2;
+  while (nkept_ > keepMax_)
+  {
+    // Drop the least recently retained block back among the others.
+    size_t s = keepTail_;
+    keepUnlink(s);
+    kept_[s] = FALSE;
+    pins_[s]--;
+  }
+  return old;
+}
+
+/*
+ * Hint the blocks in locns[0..n-1] which are not cached to the file.
+ * They are put in order first so that neighbours can go as one run.
+ */
+void
+RWCacheManager::prefetch(const RWoffset* locns, size_t n)
+{
+  register size_t i, j;
+  size_t nwant = 0;
+  for (i=0; i<n; i++)
+    if (locns[i] != RWNIL && findSlot(locns[i]) == RW_NPOS) nwant++;
+  if (nwant == 0) return;
+
+  RWoffset* want = new RWoffset[nwant];
+  nwant = 0;
+  for (i=0; i<n; i++)
+  {
+    RWoffset locn = locns[i];
+    if (locn == RWNIL || findSlot(locn) != RW_NPOS) continue;
+    // Insertion sort: n is the fan out of a node, not large.
+    for (j=nwant++; j>0 && want[j-1] > locn; j--) want[j] = want[j-1];
+    want[j] = locn;
+  }
+
+  for (i=0; i<nwant; i=j)
+  {
+    for (j=i+1; j<nwant && want[j] <= want[j-1]+(RWoffset)blocksize_; j++)
+      ;
+    theFile_->Prefetch(want[i], want[j-1] - want[i] + (long)blocksize_);
+  }
+  stats_.prefetches += nwant;
+  RWVECTOR_DELETE(nwant) want;
+}
+
+unsigned
+RWCacheManager::readahead(unsigned blocks)
+{
+  unsigned old = ahead_;
+  if (blocks > maxblocks_/2) blocks = maxblocks_/2;
+  if (blocks < 2) blocks = 0;
+  if (blocks != ahead_)
+  {
+    RWVECTOR_DELETE(ahead_*blocksize_) stage_;
+    ahead_ = blocks;
+    stage_ = ahead_ ? new char[ahead_*blocksize_] : rwnil;
+  }
+  return old;
+}
+
+const char*
+RWCacheManager::address(RWoffset locn)
+{
+  size_t islot = findSlot(locn);
+  if(islot != RW_NPOS){
+    stats_.reads++;
+    stats_.readHits++;
+    replacer_->touched(islot);
+    return buff_+islot*blocksize_;
+  }
+  const char* p = theFile_->MappedAddress(locn, blocksize_);
+  if(p){
+    stats_.reads++;
+    stats_.mappedReads++;
+  }
+  return p;
+}
+
+const char*
+RWCacheManager::pin(RWoffset locn)
+{
+  stats_.reads++;
+  size_t islot = findSlot(locn);
+  if(islot == RW_NPOS){
+    if( (islot = getFreeSlot()) == RW_NPOS ) return rwnil;
+    if( !fileRead(locn, buff_+islot*blocksize_, blocksize_) )
+    {
+      diskAddrs_[islot] = RWNIL;
+      replacer_->inserted(islot);
+      return rwnil;
+    }
+    diskAddrs_[islot] = locn;
+    hashInsert(islot);
+    replacer_->inserted(islot);
+  }
+  else {
+    stats_.readHits++;
+    replacer_->touched(islot);
+  }
+  pins_[islot]++;
+  return buff_+islot*blocksize_;
+}
+
+void
+RWCacheManager::unpin(RWoffset locn)
+{
+  // The hold of a kept block is the cache's own, not the caller's.
+  size_t islot = findSlot(locn);
+  if(islot != RW_NPOS && pins_[islot] > (unsigned)kept_[islot]) pins_[islot]--;
+}
+
+void
+RWCacheManager::resize(unsigned mxblks)
+{
+  RWPRECONDITION( mxblks > 0 );
+  if (mxblks == maxblocks_) return;
+
+  // Gather the blocks to be carried over, those held first:
+  char*     nbuff  = new char[blocksize_*mxblks];
+  RWoffset* naddrs = new RWoffset[mxblks];
+  unsigned* npins  = new unsigned[mxblks];
+  size_t*   nkeep  = new size_t[mxblks];	// Least recently retained first
+  size_t*   moved  = new size_t[maxblocks_];
+  register unsigned i;
+  unsigned n = 0, nk = 0;
+  for (i=0; i<maxblocks_; i++) moved[i] = RW_NPOS;
+  for (int held = 1; held >= 0; held--)
+    for (i=0; i<nused_ && n<mxblks; i++)
+      if (diskAddrs_[i] != RWNIL && (pins_[i] != 0) == held)
+      {
+	memcpy(nbuff+n*blocksize_, buff_+i*blocksize_, blocksize_);
+	naddrs[n] = diskAddrs_[i];
+	npins[n]  = pins_[i] - kept_[i];
+	moved[i]  = n++;
+      }
+  for (size_t s = keepTail_; s != RW_NPOS; s = keepPrev_[s])
+    if (moved[s] != RW_NPOS) nkeep[nk++] = moved[s];
+  RWVECTOR_DELETE(maxblocks_) moved;
+
+  // Start again with the new number of slots, and put them back:
+  freeSlots();
+  RWVECTOR_DELETE(blocksize_*maxblocks_) buff_;
+  maxblocks_ = mxblks;
+  buff_ = nbuff;
+  allocSlots();
+  for (i=0; i<n; i++)
+  {
+    diskAddrs_[i] = naddrs[i];
+    pins_[i] = npins[i];
+    hashInsert(i);
+    replacer_->inserted(i);
+  }
+  nused_ = n;
+  for (i=0; i<nk; i++)
+  {
+    kept_[nkeep[i]] = TRUE;
+    pins_[nkeep[i]]++;
+    keepLink(nkeep[i]);
+  }
+  keep(keepMax_);		// There may be fewer slots now
+  readahead(ahead_);
+  nextMiss_ = RWNIL;
+
+  RWVECTOR_DELETE(mxblks) nkeep;
+  RWVECTOR_DELETE(mxblks) npins;
+  RWVECTOR_DELETE(mxblks) naddrs;
+}
+
+void
+RWCacheManager::retain(RWoffset locn)
+{
+  if (keepMax_ == 0) return;
+  size_t islot = findSlot(locn);
+  if (islot == RW_NPOS) return;
+  if (kept_[islot])
+  {
+    if (islot == keepHead_) return;
+    keepUnlink(islot);
+  }
+  else
+  {
+    kept_[islot] = TRUE;
+    pins_[islot]++;
+  }
+  keepLink(islot);
+  if (nkept_ > keepMax_) keep(keepMax_);
+}
+
+RWBoolean
+RWCacheManager::lookup(RWoffset locn, void* dat)
+{
+  RWPRECONDITION( dat!=rwnil );
+  stats_.reads++;
+  size_t islot = findSlot(locn);
+  if(islot != RW_NPOS){
+    stats_.readHits++;
+    replacer_->touched(islot);
+    memcpy(dat, buff_+islot*blocksize_, blocksize_);
+    return TRUE;
+  }
+  const char* p = theFile_->MappedAddress(locn, blocksize_);
+  if(p){
+    stats_.mappedReads++;
+    memcpy(dat, p, blocksize_);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Touches nothing of the cache's, so that it can be called unlocked.
+RWBoolean
+RWCacheManager::fetch(RWoffset locn, void* dat)
+{
+  RWPRECONDITION( dat!=rwnil );
+  return theFile_->ReadAt(locn, dat, blocksize_);
+}
+
+// A block just fetch()ed; another caller may have installed it first.
+void
+RWCacheManager::install(RWoffset locn, const void* dat)
+{
+  stats_.fileReads++;
+  stats_.bytesRead += blocksize_;
+  if(findSlot(locn) != RW_NPOS) return;
+  size_t islot = getFreeSlot();
+  if(islot == RW_NPOS) return;
+  memcpy(buff_+islot*blocksize_, dat, blocksize_);
+  diskAddrs_[islot] = locn;
+  hashInsert(islot);
+  replacer_->inserted(islot);
 }
 
 RWBoolean
 RWCacheManager::read(RWoffset locn, void* dat)
 {
   RWPRECONDITION( dat!=rwnil );
-  size_t islot = ageAndFindSlot(locn);
+  stats_.reads++;
+  size_t islot = findSlot(locn);
+
+  if(islot == RW_NPOS && theFile_->isMapped()){
+    // The mapping is as good as a cache slot:
+    const char* p = theFile_->MappedAddress(locn, blocksize_);
+    if(p){
+      stats_.mappedReads++;
+      memcpy(dat, p, blocksize_);
+      return TRUE;
+    }
+  }
 
   if(islot == RW_NPOS){
     /*
      * Not in buffer;  we'll have to read it in from disk.
-     * Get a free slot.
+     * If it continues a scan, take a whole window at once; otherwise
+     * get a free slot.
      */
-    if( (islot = getFreeSlot()) == RW_NPOS ) return FALSE;
-    diskAddrs_[islot] = locn;
-    if( !theFile_->SeekTo(locn) || 
-        !theFile_->Read( buff_+islot*blocksize_, blocksize_ ) )
+    if(locn == nextMiss_ && readWindow(locn, dat))
+      return TRUE;
+    nextMiss_ = locn + (RWoffset)blocksize_;
+
+    if( (islot = getFreeSlot()) == RW_NPOS )
+      return fileRead(locn, dat, blocksize_);
+    if( !fileRead(locn, buff_+islot*blocksize_, blocksize_) )
+    {
+      // Give the slot back to the policy, holding nothing:
+      diskAddrs_[islot] = RWNIL;
+      replacer_->inserted(islot);
       return FALSE;
+    }
+    diskAddrs_[islot] = locn;
+    hashInsert(islot);
+    replacer_->inserted(islot);
+  }
+  else {
+    stats_.readHits++;
+    replacer_->touched(islot);
   }
-  useCounts_[islot] = 0;
   memcpy(dat, buff_+islot*blocksize_, blocksize_);
   return TRUE;
 }
@@ -176,38 +814,53 @@ RWBoolean
 RWCacheManager::write(RWoffset locn, void* dat)
 {
   RWPRECONDITION( dat!=rwnil );
-  size_t islot = ageAndFindSlot(locn);
+  stats_.writes++;
+  size_t islot = findSlot(locn);
+
+  if(theFile_->isMapped() && !theFile_->isReadOnly()){
+    // Write straight into the mapping, keeping any cached copy current:
+    if(islot != RW_NPOS){
+      stats_.writeHits++;
+      replacer_->touched(islot);
+      memcpy(buff_+islot*blocksize_, dat, blocksize_);
+    }
+    return fileWrite(locn, dat, blocksize_);
+  }
 
   if(islot == RW_NPOS){
     /*
      * Not in buffer; find a free slot.
      */
-    if( (islot = getFreeSlot()) == RW_NPOS ) return FALSE;
+    if( (islot = getFreeSlot()) == RW_NPOS )
+      return theFile_->isReadOnly() ||
+	fileWrite(locn, dat, blocksize_);
     diskAddrs_[islot] = locn;
+    hashInsert(islot);
+    replacer_->inserted(islot);
+  }
+  else {
+    stats_.writeHits++;
+    replacer_->touched(islot);
   }
 
-  useCounts_[islot] = 0;
   memcpy(buff_+islot*blocksize_, dat, blocksize_);
 
   // Don't write if openend in RO mode.
   if(theFile_->isReadOnly())
     return TRUE;
   else
-    return theFile_->SeekTo(locn) &&
-      theFile_->Write( buff_+islot*blocksize_, blocksize_ );
+    return fileWrite(locn, buff_+islot*blocksize_, blocksize_);
 }
 
 /************************************************
  *		Private functions		*
  ************************************************/
 size_t
-RWCacheManager::ageAndFindSlot(RWoffset locn)
+RWCacheManager::findSlot(RWoffset locn) const
 {
-  size_t islot = RW_NPOS;
-  for(register unsigned i = 0; i<nused_; i++){
-    if(diskAddrs_[i] == locn) islot = i;
-    useCounts_[i]++;		// Age the blocks
-  }
+  size_t islot = buckets_[hashOffset(locn)];
+  while (islot != RW_NPOS && diskAddrs_[islot] != locn)
+    islot = hashNext_[islot];
   return islot;
 }
 
@@ -231,20 +884,187 @@ RWCacheManager::getFreeSlot()
     islot = nused_++;		// Found an unused slot.
   }
   else {
-    // No free slots; get the Least Recently Used block
-    islot = LRU();
-    if( !flush(islot) ) islot = RW_NPOS;
+    /*
+     * No free slots; ask the replacement policy for a victim.  A pinned
+     * one is handed back as though just used, and we ask again.
+     */
+    unsigned tries = 0;
+    while( pins_[islot = replacer_->victim()] ){
+      replacer_->inserted(islot);
+      if( ++tries == maxblocks_ ) return RW_NPOS;	// All pinned
+    }
+    hashRemove(islot);
+    stats_.evictions++;
+    if( !flush(islot) ){
+      diskAddrs_[islot] = RWNIL;	// Give the unlinked slot back, empty
+      replacer_->inserted(islot);
+      islot = RW_NPOS;
+    }
   }
   return islot;
 }
 
-size_t
-RWCacheManager::LRU() const
+// All transfers to and from the file, so that they are counted.
+RWBoolean
+RWCacheManager::fileRead(RWoffset locn, void* dat, size_t n)
 {
-  size_t islot = 0;
-  unsigned maxCount = useCounts_[0];
-  for(register unsigned i=1; i<nused_; i++){
-    if(useCounts_[i] > maxCount){ maxCount=useCounts_[islot=i]; }
+  stats_.fileReads++;
+  stats_.bytesRead += n;
+  return theFile_->ReadAt(locn, dat, n);
+}
+
+RWBoolean
+RWCacheManager::fileWrite(RWoffset locn, const void* dat, size_t n)
+{
+  stats_.fileWrites++;
+  stats_.bytesWritten += n;
+  return theFile_->WriteAt(locn, dat, n);
+}
+
+/*
+ * A miss continuing a sequential scan.  Read the run of uncached
+ * blocks starting at locn, up to the readahead window, with a single
+ * read, put them all in the cache, and advise the system of the window
+ * after this one.  Returns FALSE, having done nothing useful, if there
+ * is no run or it cannot be read (it may run past the end of file);
+ * the caller then reads the one block as usual.
+ */
+RWBoolean
+RWCacheManager::readWindow(RWoffset locn, void* dat)
+{
+  register unsigned i;
+  unsigned k = 1;
+  while (k < ahead_ && findSlot(locn + (RWoffset)k*blocksize_) == RW_NPOS)
+    k++;
+  if (k < 2) return FALSE;
+  if( !fileRead(locn, stage_, k*blocksize_) )
+    return FALSE;
+  stats_.readahead += k-1;
+
+  memcpy(dat, stage_, blocksize_);
+  for (i=0; i<k; i++)
+  {
+    size_t islot = getFreeSlot();
+    if (islot == RW_NPOS) break;
+    diskAddrs_[islot] = locn + (RWoffset)i*blocksize_;
+    memcpy(buff_+islot*blocksize_, stage_+i*blocksize_, blocksize_);
+    hashInsert(islot);
+    replacer_->inserted(islot);
   }
-  return islot;
+
+  nextMiss_ = locn + (RWoffset)k*blocksize_;
+  theFile_->Prefetch(nextMiss_, (long)ahead_*blocksize_);
+  return TRUE;
+}
+
+/*
+ * Disk addresses are usually multiples of the block size, so the
+ * low order bits carry little information.  Mix them in from above.
+ */
+unsigned
+RWCacheManager::hashOffset(RWoffset locn) const
+{
+  unsigned long h = (unsigned long)locn;
+  h ^= h >> 15;
+  h *= 2654435761UL;
+  h ^= h >> 13;
+  return (unsigned)(h & (nbuckets_-1));
+}
+
+void
+RWCacheManager::hashInsert(size_t islot)
+{
+  size_t& bucket = buckets_[hashOffset(diskAddrs_[islot])];
+  hashNext_[islot] = bucket;
+  bucket = islot;
+}
+
+// Put a slot at the head of the kept list:
+void
+RWCacheManager::keepLink(size_t islot)
+{
+  keepPrev_[islot] = RW_NPOS;
+  keepNext_[islot] = keepHead_;
+  if (keepHead_ != RW_NPOS) keepPrev_[keepHead_] = islot;
+  keepHead_ = islot;
+  if (keepTail_ == RW_NPOS) keepTail_ = islot;
+  nkept_++;
+}
+
+void
+RWCacheManager::keepUnlink(size_t islot)
+{
+  if (keepPrev_[islot] != RW_NPOS) keepNext_[keepPrev_[islot]] = keepNext_[islot];
+  else				   keepHead_ = keepNext_[islot];
+  if (keepNext_[islot] != RW_NPOS) keepPrev_[keepNext_[islot]] = keepPrev_[islot];
+  else				   keepTail_ = keepPrev_[islot];
+  nkept_--;
+}
+
+/*
+ * Set up the bookkeeping for maxblocks_ empty slots (the blocks
+ * themselves are in buff_), and the replacement policy over them.
+ */
+void
+RWCacheManager::allocSlots()
+{
+  nused_ = 0;
+  diskAddrs_ = new RWoffset[maxblocks_];
+
+  // Hash table of disk address to slot, with a load factor under 1:
+  nbuckets_ = 1;
+  while (nbuckets_ < maxblocks_) nbuckets_ <<= 1;
+  buckets_  = new size_t[nbuckets_];
+  hashNext_ = new size_t[maxblocks_];
+  pins_     = new unsigned[maxblocks_];
+  kept_     = new char[maxblocks_];
+  keepPrev_ = new size_t[maxblocks_];
+  keepNext_ = new size_t[maxblocks_];
+  register unsigned i;
+  for (i=0; i<nbuckets_; i++)  buckets_[i] = RW_NPOS;
+  for (i=0; i<maxblocks_; i++) pins_[i] = 0;
+  memset(kept_, 0, maxblocks_);
+  keepHead_ = keepTail_ = RW_NPOS;
+  nkept_ = 0;
+
+  switch (policy_)
+  {
+    case ClockPolicy:
+      replacer_ = new RWClockReplacer(maxblocks_, diskAddrs_);
+      break;
+    case TwoQPolicy:
+      replacer_ = new RWTwoQReplacer(maxblocks_, diskAddrs_);
+      break;
+    default:
+      replacer_ = new RWLRUReplacer(maxblocks_, diskAddrs_);
+  }
+}
+
+void
+RWCacheManager::freeSlots()
+{
+  delete replacer_;
+  RWVECTOR_DELETE(maxblocks_) keepNext_;
+  RWVECTOR_DELETE(maxblocks_) keepPrev_;
+  RWVECTOR_DELETE(maxblocks_) kept_;
+  RWVECTOR_DELETE(maxblocks_) pins_;
+  RWVECTOR_DELETE(maxblocks_) hashNext_;
+  RWVECTOR_DELETE(nbuckets_) buckets_;
+  RWVECTOR_DELETE(maxblocks_) diskAddrs_;
+}
+
+void
+RWCacheManager::hashRemove(size_t islot)
+{
+  size_t* p = &buckets_[hashOffset(diskAddrs_[islot])];
+  while (*p != RW_NPOS)
+  {
+    if (*p == islot)
+    {
+      *p = hashNext_[islot];
+      return;
+    }
+    p = &hashNext_[*p];
+  }
+  // Not found: the slot was never entered (failed read).
 }
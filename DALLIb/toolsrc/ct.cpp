@@ -108,6 +108,16 @@ RWCollectable::compareTo(const RWCollectable* c) const
   return this==c ? 0 : (this>c ? 1 : -1);
 }
 
+/*
+ * An ordering prefix is a number that agrees with compareTo():
+ * if a's prefix is less than b's then a->compareTo(b) must be
+ * negative.  Equal prefixes say nothing.  Sorted collections use
+ * prefixes to avoid calling compareTo().  A class that cannot
+ * provide one returns FALSE.
+ */
+RWBoolean
+RWCollectable::orderingPrefix(unsigned long&) const { return FALSE; }
+
 RWBoolean rwexport
 rwIsEqualFun(const void* a, const void* b)
 {
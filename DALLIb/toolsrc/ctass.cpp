@@ -165,6 +165,12 @@ RWCollectableAssociation::isEqual(const RWCollectable* a) const
   return a->isEqual(ky);
 }
 
+RWBoolean
+RWCollectableAssociation::orderingPrefix(unsigned long& p) const
+{
+  return ky->orderingPrefix(p);		// Ordered by key
+}
+
 /***************** RWCollectableIDAssociation members ****************/
 
 unsigned
@@ -189,3 +195,10 @@ RWCollectableIDAssociation::isEqual(const RWCollectable* a) const
      return a == ky;
 }
 
+// Ordered by address, which nothing else can match:
+RWBoolean
+RWCollectableIDAssociation::orderingPrefix(unsigned long&) const
+{
+  return FALSE;
+}
+
@@ -86,20 +86,24 @@
 #include "rw/colclass.h"
 #include "rw/vstream.h"
 #include "rw/rwfile.h"
+#include "rwstore.h"
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: ctclassi.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/18 20:51:00 $");
 
 /*
  * Virtual function to store all the members of an
- * arbitrary collection to output:
+ * arbitrary collection to output.  The store table is sized
+ * for them up front, rather than growing as they are added.
  */
 
 void
 RWCollection::saveGuts(RWvostream& s) const
 {
-  s << entries();
+  size_t N = entries();
+  s << N;
 
   if( s.good() ){
+    rwReserveStoreTable(N);
     // "this" cast used to suppress warnings.
     ((RWCollection*)this)->apply(&RWCollection::saveObjToStream, &s);
   }
@@ -110,6 +114,7 @@ RWCollection::saveGuts(RWFile& file) const
 {
   size_t N = entries();
   file.Write(N);
+  rwReserveStoreTable(N);
 
   // Cast done to suppress unfounded "const" warnings:
   ((RWCollection*)this)->apply(&RWCollection::saveObjToRWFile, &file);
@@ -108,3 +108,12 @@ RWCollectableDate::isEqual(const RWCollectable* c) const
   return *this == *(const RWCollectableDate*)c;
 }
 
+// The Julian day number:
+RWBoolean
+RWCollectableDate::orderingPrefix(unsigned long& p) const
+{
+  if( isA() != RWCollectableDate::isA() ) return FALSE;	// May be reordered
+  p = *this - RWDate((unsigned long)0);
+  return TRUE;
+}
+
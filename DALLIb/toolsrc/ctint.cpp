@@ -105,3 +105,12 @@ RWCollectableInt::isEqual(const RWCollectable* c) const
   return  value() ==  ((const RWCollectableInt*)c)->value();
 }
 
+// The value, with its sign bit flipped so that it sorts unsigned:
+RWBoolean
+RWCollectableInt::orderingPrefix(unsigned long& p) const
+{
+  if( isA() != RWCollectableInt::isA() ) return FALSE;	// May be reordered
+  p = (unsigned long)(long)value() ^ ~(~0UL >> 1);
+  return TRUE;
+}
+
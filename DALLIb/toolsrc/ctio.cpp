@@ -184,13 +184,19 @@ RWCollectableP rwexport getRWNilCollectable()
  *							*
  ********************************************************/
 
+/*
+ * The static store table outlives each save so that its slots can be
+ * reused; it is open only while a save is in progress.  A per-thread
+ * or per-task table is freed after each save, as its owner may not
+ * save again.
+ */
 static RWStoreTable* rwnear
 getStoreTable()
 {
 #if (defined(__DLL__) && defined(__WIN16__)) || defined(RW_MULTI_THREAD)
   RWStoreTable* theStoreTable = rwStoreManager.currentStoreTable();
 #endif
-  return theStoreTable;
+  return theStoreTable && theStoreTable->isOpen() ? theStoreTable : rwnil;
 }
 
 static RWStoreTable* rwnear
@@ -199,8 +205,10 @@ newStoreTable()
 #if (defined(__DLL__) && defined(__WIN16__)) || defined(RW_MULTI_THREAD)
   RWStoreTable* theStoreTable = rwStoreManager.newStoreTable();
 #else
-  theStoreTable = new RWStoreTable;
+  if (theStoreTable == rwnil)
+    theStoreTable = new RWStoreTable;
 #endif
+  theStoreTable->open();
   return theStoreTable;
 }
 
@@ -210,11 +218,17 @@ freeStoreTable()
 #if (defined(__DLL__) && defined(__WIN16__)) || defined(RW_MULTI_THREAD)
   rwStoreManager.freeValue();
 #else
-  delete theStoreTable;
-  theStoreTable = rwnil;
+  theStoreTable->close();
 #endif
 }
 
+void
+rwReserveStoreTable(size_t n)
+{
+  RWStoreTable* storeTable = getStoreTable();
+  if (storeTable) storeTable->reserve(storeTable->entries() + n);
+}
+
 static RWReadTable* rwnear
 getReadTable()
 {
@@ -556,50 +570,119 @@ operator<<(RWFile& file, const RWCollectable* p)
  ****************************************************************/
 
 
-RWStoreTable::RWStoreTable()
+/*
+ * Fibonacci hashing: multiply by 2**32 divided by the golden ratio
+ * and keep the top bits of the low 32.  Wide addresses are folded
+ * first.
+ */
+inline size_t
+RWStoreTable::homeSlot(const RWCollectable* p) const
 {
-  int dummy = 0;
-  add(RWnilCollectable, dummy);	// Add the nil object.
+  unsigned long a = (unsigned long)p;
+  a ^= a >> 16 >> 16;
+  a = (a * 2654435769UL) & 0xFFFFFFFFUL;
+  return (size_t)(a >> (32 - bits_));
+}
+
+RWStoreTable::RWStoreTable(size_t expected)
+{
+  table_  = rwnil;
+  bits_   = 0;
+  nslots_ = 0;
+  nitems_ = 0;
+  open_   = FALSE;
+  reserve(expected);
+  addNil();
 }
 
 RWStoreTable::~RWStoreTable()
 {
-  clearAndDestroy();		// Will delete all the RWStoreEntry entries
+  RWVECTOR_DELETE(nslots_) table_;
 }
 
 RWBoolean
 RWStoreTable::add(const RWCollectable* item, int& objectNum)
 {
-  RWStoreEntry temp(item, 0);	// Dummy to use as key.
-  const RWCollectable* v = find(&temp);
-  if(v){
-    objectNum = ((const RWStoreEntry*)v)->objectNumber;
-    return FALSE;
+  RWPRECONDITION( item!=rwnil );
+  register size_t mask = nslots_ - 1;
+  register size_t i = homeSlot(item);
+  while (table_[i].item) {
+    if (table_[i].item == item) {
+      objectNum = table_[i].objectNumber;
+      return FALSE;
+    }
+    i = (i+1) & mask;
+  }
+
+  objectNum = (int)nitems_++;
+  table_[i].item = item;
+  table_[i].objectNumber = objectNum;
+  if (2*nitems_ > nslots_) rehash(bits_+1);	// Keep it at most half full
+  return TRUE;
+}
+
+/*
+ * Make room for "expected" objects without further rehashing.
+ */
+void
+RWStoreTable::reserve(size_t expected)
+{
+  unsigned bits = bits_ ? bits_ : 1;
+  while (((size_t)1 << bits) < 2*expected) bits++;
+  if (bits > bits_) rehash(bits);
+}
+
+/*
+ * Forget all objects but the nil object, ready for the next save.
+ */
+void
+RWStoreTable::close()
+{
+  if (nslots_ > RWSTOREKEEP) {
+    RWVECTOR_DELETE(nslots_) table_;
+    table_  = rwnil;
+    bits_   = 0;
+    nslots_ = 0;
+    nitems_ = 0;
+    reserve(RWDEFAULT_CAPACITY);
   }
   else {
-    objectNum = entries();
-    insert(new RWStoreEntry(item, objectNum));
-    return TRUE;
+    for (register size_t i = 0; i < nslots_; i++)
+      table_[i].item = rwnil;
+    nitems_ = 0;
   }
+  addNil();
+  open_ = FALSE;
 }
 
- /***************************************************************
- *								*
- *		 	RWStoreEntry definitions		*
- *								*
- ****************************************************************/
-
-unsigned
-RWStoreEntry::hash() const
+void
+RWStoreTable::addNil()
 {
-  return RWhashAddress((void*)item);
+  int dummy = 0;
+  add(RWnilCollectable, dummy);	// Add the nil object.
 }
 
-RWBoolean
-RWStoreEntry::isEqual(const RWCollectable* c) const
+void
+RWStoreTable::rehash(unsigned bits)
 {
-  RWPRECONDITION( c!=rwnil );
-  return item==((const RWStoreEntry*)c)->item;
+  RWStoreSlot* old = table_;
+  size_t oldSlots  = nslots_;
+
+  bits_   = bits;
+  nslots_ = (size_t)1 << bits;
+  table_  = new RWStoreSlot[nslots_];
+  for (register size_t i = 0; i < nslots_; i++)
+    table_[i].item = rwnil;
+
+  register size_t mask = nslots_ - 1;
+  for (register size_t j = 0; j < oldSlots; j++) {
+    if (old[j].item) {
+      register size_t k = homeSlot(old[j].item);
+      while (table_[k].item) k = (k+1) & mask;
+      table_[k] = old[j];
+    }
+  }
+  RWVECTOR_DELETE(oldSlots) old;
 }
 
 
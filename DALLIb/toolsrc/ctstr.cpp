@@ -112,3 +112,19 @@ RWCollectableString::isEqual(const RWCollectable* c) const
   return RWCString::compareTo(*(const RWCollectableString*)c)==0;
 }
 
+/*
+ * The leading bytes, most significant first, padded with nulls.
+ * This agrees with the memcmp() ordering used by compareTo().
+ */
+RWBoolean
+RWCollectableString::orderingPrefix(unsigned long& p) const
+{
+  if( isA() != RWCollectableString::isA() ) return FALSE;	// May be reordered
+  const unsigned char* s = (const unsigned char*)data();
+  size_t len = length();
+  p = 0;
+  for (register size_t i = 0; i < sizeof(unsigned long); i++)
+    p = (p << 8) | (i < len ? s[i] : 0);
+  return TRUE;
+}
+
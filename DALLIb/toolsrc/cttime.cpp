@@ -113,3 +113,11 @@ RWCollectableTime::isEqual(const RWCollectable* c) const
   return *this ==  *(const RWCollectableTime*)c;
 }
 
+RWBoolean
+RWCollectableTime::orderingPrefix(unsigned long& p) const
+{
+  if( isA() != RWCollectableTime::isA() ) return FALSE;	// May be reordered
+  p = seconds();
+  return TRUE;
+}
+
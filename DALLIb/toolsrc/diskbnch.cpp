@@ -0,0 +1,608 @@
+/*
+ * diskbench: benchmarks of the disk based classes, built on RWBench.
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ *
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ *
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ * Not part of the library: "make diskbench" builds it against it.
+ *
+ * Runs insert, lookup, scan and delete workloads against an
+ * RWBTreeOnDisk kept by an RWFileManager, then write, read and scan
+ * workloads against an RWTValVirtualArray<long> swapped to an
+ * RWDiskPageHeap.  Keys are visited in ascending order, or in a random
+ * order fixed by the seed, so that runs can be compared.  Each workload
+ * makes one pass of -keys operations and reports, besides what RWBench
+ * does (operations per second of processor time):
+ *
+ *	the operations per second of elapsed time;
+ *	the mean and the 50th, 90th, 99th and 99.9th percentile latency,
+ *	  each an upper bound in microseconds (see RWLatencyHistogram);
+ *	the reads and writes of the file, the hits, evictions and file
+ *	  traffic of the cache, and the node reads, writes, splits and
+ *	  merges of the tree; or the lock hits, swaps and evictions of
+ *	  the page heap.
+ *
+ * Options, with their defaults:
+ *
+ *	-keys n		Number of keys, or array elements	(100000)
+ *	-keylen n	Key length, at least 10			(16)
+ *	-order n	Order of the tree			(10)
+ *	-packed		Use RWBTreeOnDisk::PackedStyle nodes
+ *	-cache n	Nodes in the tree's cache		(10)
+ *	-cachebytes n	As -cache, as a budget in bytes
+ *	-policy p	Cache policy: lru, clock or 2q		(lru)
+ *	-bloom		Give the tree a Bloom filter
+ *	-pagesize n	Page size of the page heap		(512)
+ *	-buffers n	Buffers of the page heap		(10)
+ *	-sequential	Visit keys in ascending order		(random)
+ *	-seed n		Seed of the random order		(1)
+ *	-file name	File for the tree			(diskbnch.dat)
+ *	-memory		Keep the tree in memory, not in a file
+ *	-tree, -array	Run only the tree, or the array, workloads
+ *	-machine name	Machine name for the report
+ *
+ * The file is removed afterwards.
+ */
+
+#include "rw/bench.h"
+#include "rw/disktree.h"
+#include "rw/diskpage.h"
+#include "rw/filemgr.h"
+#include "rw/iostats.h"
+#include "rw/tvrtarry.h"
+#include "rw/rstream.h"
+STARTWRAP
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+ENDWRAP
+
+RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile$ $Revision$ $Date$");
+
+/****************************************************************
+ *								*
+ *			Options and keys			*
+ *								*
+ ****************************************************************/
+
+struct DiskBenchOptions
+{
+  unsigned long		keys;
+  unsigned		keylen;
+  unsigned		order;
+  RWBoolean		packed;
+  unsigned		cache;
+  unsigned long		cacheBytes;	// 0: use cache
+  RWCacheManager::policyMode policy;
+  RWBoolean		bloom;
+  unsigned		pagesize;
+  unsigned		buffers;
+  RWBoolean		sequential;
+  unsigned long		seed;
+  const char*		file;
+  RWBoolean		memory;
+  RWBoolean		tree;
+  RWBoolean		array;
+  const char*		machine;
+};
+
+static const char*
+policyName(RWCacheManager::policyMode p)
+{
+  switch (p) {
+    case RWCacheManager::ClockPolicy:	return "clock";
+    case RWCacheManager::TwoQPolicy:	return "2q";
+    default:				return "lru";
+  }
+}
+
+static void
+usage(const char* prog)
+{
+  cerr << "usage: " << prog << " [-keys n] [-keylen n] [-order n] [-packed]\n"
+       << "\t[-cache n | -cachebytes n] [-policy lru|clock|2q] [-bloom]\n"
+       << "\t[-pagesize n] [-buffers n] [-sequential] [-seed n]\n"
+       << "\t[-file name | -memory] [-tree | -array] [-machine name]\n";
+  exit(1);
+}
+
+static void
+parseOptions(int argc, char* argv[], DiskBenchOptions& o)
+{
+  o.keys	= 100000L;
+  o.keylen	= 16;
+  o.order	= 10;
+  o.packed	= FALSE;
+  o.cache	= 10;
+  o.cacheBytes	= 0;
+  o.policy	= RWCacheManager::LRUPolicy;
+  o.bloom	= FALSE;
+  o.pagesize	= 512;
+  o.buffers	= 10;
+  o.sequential	= FALSE;
+  o.seed	= 1;
+  o.file	= "diskbnch.dat";
+  o.memory	= FALSE;
+  o.tree	= TRUE;
+  o.array	= TRUE;
+  o.machine	= rwnil;
+
+  for (register int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i+1 < argc ? argv[i+1] : rwnil;
+    if      (strcmp(a, "-packed") == 0)	    o.packed = TRUE;
+    else if (strcmp(a, "-bloom") == 0)	    o.bloom = TRUE;
+    else if (strcmp(a, "-sequential") == 0) o.sequential = TRUE;
+    else if (strcmp(a, "-memory") == 0)	    o.memory = TRUE;
+    else if (strcmp(a, "-tree") == 0)	    o.array = FALSE;
+    else if (strcmp(a, "-array") == 0)	    o.tree = FALSE;
+    else if (v == rwnil)		    usage(argv[0]);
+    else {
+      i++;
+      if      (strcmp(a, "-keys") == 0)	      o.keys = (unsigned long)atol(v);
+      else if (strcmp(a, "-keylen") == 0)     o.keylen = (unsigned)atoi(v);
+      else if (strcmp(a, "-order") == 0)      o.order = (unsigned)atoi(v);
+      else if (strcmp(a, "-cache") == 0)      o.cache = (unsigned)atoi(v);
+      else if (strcmp(a, "-cachebytes") == 0) o.cacheBytes = (unsigned long)atol(v);
+      else if (strcmp(a, "-pagesize") == 0)   o.pagesize = (unsigned)atoi(v);
+      else if (strcmp(a, "-buffers") == 0)    o.buffers = (unsigned)atoi(v);
+      else if (strcmp(a, "-seed") == 0)	      o.seed = (unsigned long)atol(v);
+      else if (strcmp(a, "-file") == 0)	      o.file = v;
+      else if (strcmp(a, "-machine") == 0)    o.machine = v;
+      else if (strcmp(a, "-policy") == 0) {
+	if      (strcmp(v, "lru") == 0)	  o.policy = RWCacheManager::LRUPolicy;
+	else if (strcmp(v, "clock") == 0) o.policy = RWCacheManager::ClockPolicy;
+	else if (strcmp(v, "2q") == 0)	  o.policy = RWCacheManager::TwoQPolicy;
+	else usage(argv[0]);
+      }
+      else usage(argv[0]);
+    }
+  }
+  if (o.keys == 0 || o.keylen < 10 || o.order < 2) usage(argv[0]);
+}
+
+/*
+ * Key k is its decimal digits, zero filled to one less than the key
+ * length, so that keys sort in numeric order and the tree keeps the
+ * terminating null.
+ */
+static void
+makeKey(char* buf, unsigned long k, unsigned keylen)
+{
+  sprintf(buf, "%0*lu", (int)keylen-1, k);
+}
+
+// 0..n-1, shuffled unless sequential, by a generator of our own
+// so that the order is the same everywhere.
+static unsigned long*
+makeOrder(unsigned long n, RWBoolean sequential, unsigned long seed)
+{
+  unsigned long* order = new unsigned long[n];
+  register unsigned long i;
+  for (i = 0; i < n; i++) order[i] = i;
+  if (!sequential) {
+    unsigned long x = seed;
+    for (i = n; i > 1; i--) {
+      x = (x * 1103515245UL + 12345UL) & 0xffffffffUL;
+      unsigned long j = ((x >> 8) * 256UL + (x & 0xff)) % i;
+      unsigned long t = order[i-1]; order[i-1] = order[j]; order[j] = t;
+    }
+  }
+  return order;
+}
+
+/****************************************************************
+ *								*
+ *			DiskBench				*
+ *								*
+ ****************************************************************/
+
+/*
+ * One pass of ops operations, each timed.  The specializing class
+ * supplies op(i), for i = 0..ops-1, and the I/O counts.
+ */
+class DiskBench : public RWBench
+{
+
+public:
+
+  DiskBench(const char* name, unsigned long ops, const DiskBenchOptions& o,
+	    RWBoolean scan);
+
+  virtual void		doLoop(unsigned long n);
+  virtual void		go();
+  virtual void		report(ostream&) const;
+  virtual void		what(ostream&) const;
+
+protected:
+
+  virtual void		op(unsigned long i) = 0;
+  virtual void		reportIO(ostream&) const = 0;
+  virtual void		resetIO() = 0;
+
+  const char*		name_;
+  const DiskBenchOptions& opts_;
+  RWBoolean		scan_;		// Visits in key order regardless
+  unsigned long		next_;		// Next operation
+  unsigned long		wall_;		// Elapsed microseconds
+  RWLatencyHistogram	latency_;
+};
+
+DiskBench::DiskBench(const char* name, unsigned long ops, const DiskBenchOptions& o,
+		     RWBoolean scan) :
+  RWBench(0, ops, o.machine),
+  name_(name),
+  opts_(o),
+  scan_(scan),
+  next_(0),
+  wall_(0)
+{
+}
+
+void
+DiskBench::doLoop(unsigned long n)
+{
+  while (n--) {
+    unsigned long t = RWLatencyHistogram::now();
+    op(next_++);
+    latency_.record(RWLatencyHistogram::now() - t);
+  }
+}
+
+void
+DiskBench::go()
+{
+  resetIO();
+  latency_.reset();
+  next_ = 0;
+  unsigned long t = RWLatencyHistogram::now();
+  RWBench::go();
+  wall_ = RWLatencyHistogram::now() - t;
+}
+
+void
+DiskBench::what(ostream& s) const
+{
+  s << name_ << ": " << innerLoops() << " operations in "
+    << (scan_ || opts_.sequential ? "ascending" : "random") << " order\n";
+}
+
+void
+DiskBench::report(ostream& s) const
+{
+  RWBench::report(s);
+  if (wall_)
+    s << "Operations per second (elapsed): "
+      << (double)outerLoops() * innerLoops() * 1.0e6 / wall_ << endl;
+  s << "Latency, microseconds:      mean " << latency_.mean()
+    << "  50% " << latency_.percentile(0.5)
+    << "  90% " << latency_.percentile(0.9)
+    << "  99% " << latency_.percentile(0.99)
+    << "  99.9% " << latency_.percentile(0.999) << endl;
+  reportIO(s);
+  s << endl << flush;
+}
+
+/****************************************************************
+ *								*
+ *		    Workloads on RWBTreeOnDisk			*
+ *								*
+ ****************************************************************/
+
+class DiskTreeBench : public DiskBench
+{
+
+public:
+
+  enum workload { insertLoad, lookupLoad, scanLoad, removeLoad };
+
+  DiskTreeBench(workload w, RWBTreeOnDisk& tree, RWFileManager& fmgr,
+		const unsigned long* order, const DiskBenchOptions& o);
+  ~DiskTreeBench();
+
+  unsigned long		failures() const {return failures_;}
+
+protected:
+
+  virtual void		op(unsigned long i);
+  virtual void		reportIO(ostream&) const;
+  virtual void		resetIO();
+
+private:
+
+  static const char*	workloadName(workload);
+
+  workload		load_;
+  RWBTreeOnDisk&	tree_;
+  RWFileManager&	fmgr_;
+  const unsigned long*	order_;
+  char*			key_;
+  RWBTreeOnDiskCursor*	cursor_;	// For the scan
+  unsigned long		failures_;	// Operations that did not succeed
+};
+
+DiskTreeBench::DiskTreeBench(workload w, RWBTreeOnDisk& tree, RWFileManager& fmgr,
+			     const unsigned long* order, const DiskBenchOptions& o) :
+  DiskBench(workloadName(w), o.keys, o, w == scanLoad),
+  load_(w),
+  tree_(tree),
+  fmgr_(fmgr),
+  order_(order),
+  key_(new char[o.keylen+1]),
+  cursor_(rwnil),
+  failures_(0)
+{
+}
+
+DiskTreeBench::~DiskTreeBench()
+{
+  delete cursor_;
+  RWVECTOR_DELETE(opts_.keylen+1) key_;
+}
+
+const char*
+DiskTreeBench::workloadName(workload w)
+{
+  switch (w) {
+    case insertLoad:	return "RWBTreeOnDisk insert";
+    case lookupLoad:	return "RWBTreeOnDisk lookup";
+    case scanLoad:	return "RWBTreeOnDisk scan";
+    default:		return "RWBTreeOnDisk delete";
+  }
+}
+
+void
+DiskTreeBench::op(unsigned long i)
+{
+  RWstoredValue v;
+  switch (load_) {
+    case insertLoad:
+      makeKey(key_, order_[i], opts_.keylen);
+      if (!tree_.insertKeyAndValue(key_, (RWstoredValue)order_[i])) failures_++;
+      break;
+    case lookupLoad:
+      makeKey(key_, order_[i], opts_.keylen);
+      if (tree_.findValue(key_) != (RWstoredValue)order_[i]) failures_++;
+      break;
+    case scanLoad:
+      if (cursor_ == rwnil) cursor_ = new RWBTreeOnDiskCursor(tree_);
+      if (!(*cursor_)() || cursor_->value() != (RWstoredValue)i) failures_++;
+      break;
+    default:
+      makeKey(key_, order_[i], opts_.keylen);
+      if (!tree_.removeKeyAndValue(key_, v)) failures_++;
+  }
+}
+
+void
+DiskTreeBench::resetIO()
+{
+  tree_.resetStatistics();
+  fmgr_.resetStatistics();
+}
+
+void
+DiskTreeBench::reportIO(ostream& s) const
+{
+  const RWFileStatistics& fs = fmgr_.statistics();
+  const RWCacheStatistics& cs = tree_.cacheStatistics();
+  const RWDiskTreeStatistics& ts = tree_.statistics();
+  s << "File:   " << fs.reads << " reads (" << fs.bytesRead << " bytes), "
+    << fs.writes << " writes (" << fs.bytesWritten << " bytes)\n";
+  s << "Cache:  " << tree_.cacheCount() << " nodes, "
+    << policyName(tree_.cachePolicy()) << "; "
+    << cs.reads << " reads, " << cs.readHits << " hits, "
+    << cs.evictions << " evictions, " << cs.readahead << " read ahead, "
+    << cs.fileReads << " file reads, " << cs.fileWrites << " file writes\n";
+  s << "Tree:   " << ts.nodeReads << " node reads, " << ts.nodeWrites
+    << " node writes, " << ts.splits << " splits, " << ts.merges
+    << " merges, " << ts.lookupVisits << " nodes visited";
+  if (tree_.bloomFilter()) s << ", " << ts.filterRejects << " filtered";
+  s << endl;
+  if (failures_) s << "*** " << failures_ << " operations failed ***\n";
+}
+
+/****************************************************************
+ *								*
+ *		Workloads on RWTValVirtualArray			*
+ *								*
+ ****************************************************************/
+
+class VirtualArrayBench : public DiskBench
+{
+
+public:
+
+  enum workload { writeLoad, readLoad, scanLoad };
+
+  VirtualArrayBench(workload w, RWTValVirtualArray<long>& array, RWDiskPageHeap& heap,
+		    const unsigned long* order, const DiskBenchOptions& o);
+
+  unsigned long		failures() const {return failures_;}
+
+protected:
+
+  virtual void		op(unsigned long i);
+  virtual void		reportIO(ostream&) const;
+  virtual void		resetIO();
+
+private:
+
+  static const char*	workloadName(workload);
+
+  workload		load_;
+  RWTValVirtualArray<long>& array_;
+  RWDiskPageHeap&	heap_;
+  const unsigned long*	order_;
+  unsigned long		failures_;
+};
+
+VirtualArrayBench::VirtualArrayBench(workload w, RWTValVirtualArray<long>& array,
+				     RWDiskPageHeap& heap, const unsigned long* order,
+				     const DiskBenchOptions& o) :
+  DiskBench(workloadName(w), o.keys, o, w == scanLoad),
+  load_(w),
+  array_(array),
+  heap_(heap),
+  order_(order),
+  failures_(0)
+{
+}
+
+const char*
+VirtualArrayBench::workloadName(workload w)
+{
+  switch (w) {
+    case writeLoad:	return "RWTValVirtualArray write";
+    case readLoad:	return "RWTValVirtualArray read";
+    default:		return "RWTValVirtualArray scan";
+  }
+}
+
+void
+VirtualArrayBench::op(unsigned long i)
+{
+  switch (load_) {
+    case writeLoad:
+      array_.set((long)order_[i], (long)order_[i]);
+      break;
+    case readLoad:
+      if (array_.val((long)order_[i]) != (long)order_[i]) failures_++;
+      break;
+    default:
+      if (array_.val((long)i) != (long)i) failures_++;
+  }
+}
+
+void
+VirtualArrayBench::resetIO()
+{
+  heap_.resetStatistics();
+}
+
+void
+VirtualArrayBench::reportIO(ostream& s) const
+{
+  const RWPageHeapStatistics& ps = heap_.statistics();
+  s << "Heap:   " << opts_.buffers << " buffers of " << opts_.pagesize
+    << " bytes; " << ps.locks << " locks, " << ps.lockHits << " hits, "
+    << ps.evictions << " evictions, " << ps.swapIns << " swap ins, "
+    << ps.swapOuts << " swap outs\n";
+  if (failures_) s << "*** " << failures_ << " operations failed ***\n";
+}
+
+/****************************************************************
+ *								*
+ *				main				*
+ *								*
+ ****************************************************************/
+
+static unsigned long
+runTree(const DiskBenchOptions& o, const unsigned long* order)
+{
+  unsigned long failures = 0;
+  if (!o.memory) remove(o.file);
+  RWFileManager fmgr(o.memory ? rwnil : o.file);
+  if (!fmgr.isValid()) {
+    cerr << "diskbench: cannot open " << o.file << endl;
+    return 1;
+  }
+  RWBTreeOnDisk tree(fmgr, o.cache, RWBTreeOnDisk::create, o.keylen, FALSE,
+		     RWNIL, o.packed ? RWBTreeOnDisk::PackedStyle
+				     : RWBTreeOnDisk::V6Style, o.order, o.order);
+  if (o.cacheBytes) tree.cacheBytes(o.cacheBytes);
+  tree.cachePolicy(o.policy);
+  if (o.bloom) tree.bloomFilter(TRUE);
+
+  static const DiskTreeBench::workload loads[] = {
+    DiskTreeBench::insertLoad, DiskTreeBench::lookupLoad,
+    DiskTreeBench::scanLoad, DiskTreeBench::removeLoad
+  };
+  for (register size_t i = 0; i < sizeof(loads)/sizeof(loads[0]); i++) {
+    DiskTreeBench b(loads[i], tree, fmgr, order, o);
+    b.go();
+    b.report(cout);
+    failures += b.failures();
+  }
+  return failures;
+}
+
+static unsigned long
+runArray(const DiskBenchOptions& o, const unsigned long* order)
+{
+  unsigned long failures = 0;
+  RWDiskPageHeap heap(rwnil, o.buffers, o.pagesize);
+  if (!heap.isValid()) {
+    cerr << "diskbench: cannot open the page heap's swap file" << endl;
+    return 1;
+  }
+  RWTValVirtualArray<long> array((long)o.keys, &heap);
+
+  static const VirtualArrayBench::workload loads[] = {
+    VirtualArrayBench::writeLoad, VirtualArrayBench::readLoad,
+    VirtualArrayBench::scanLoad
+  };
+  for (register size_t i = 0; i < sizeof(loads)/sizeof(loads[0]); i++) {
+    VirtualArrayBench b(loads[i], array, heap, order, o);
+    b.go();
+    b.report(cout);
+    failures += b.failures();
+  }
+  return failures;
+}
+
+int
+main(int argc, char* argv[])
+{
+  DiskBenchOptions o;
+  parseOptions(argc, argv, o);
+  unsigned long* order = makeOrder(o.keys, o.sequential, o.seed);
+  unsigned long failures = 0;
+
+  cout << "diskbench: " << o.keys << " keys of " << o.keylen
+       << " bytes, order " << o.order << (o.packed ? " packed" : "")
+       << (o.bloom ? ", Bloom filter" : "") << (o.memory ? ", in memory" : "")
+       << "\n\n";
+  if (o.tree)  failures += runTree(o, order);
+  if (o.array) failures += runArray(o, order);
+  if (o.tree && !o.memory) remove(o.file);
+
+  RWVECTOR_DELETE(o.keys) order;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * RWBTreeOnDisk::sortAndLoad(): external merge sort in front of bulkLoad().
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+#include "rw/disktree.h"
+#include "rw/rwerr.h"
+#include "rw/toolerr.h"
+STARTWRAP
+#include <stdio.h>
+#include <string.h>
+ENDWRAP
+
+RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile$ $Revision$ $Date$");
+
+#ifndef RW_NO_CPP_RECURSION
+# define new rwnew
+#endif
+
+/*
+ * Sorts (key, value) records too numerous to hold in memory.  Records
+ * are collected in a buffer of the requested size; each time it fills
+ * it is sorted and written to a temporary file as a run.  The runs are
+ * then merged through a heap, the buffer being divided among them.
+ * Sorting is stable and ties between runs go to the earlier run, so of
+ * several equal keys the first one supplied comes out first.
+ */
+class RWDiskTreeSorter {
+public:
+  RWDiskTreeSorter(unsigned keylen, RWBoolean ignoreNull,
+		   RWdiskTreeCompare cmp, unsigned long memory);
+  ~RWDiskTreeSorter();
+
+  void		add(const char* key, RWstoredValue val);
+  void		done();				// ready to read back
+  static RWBoolean next(const char*& key, RWstoredValue& val, void*);
+
+private:
+  const char*	keyOf(const char* rec) const
+	{ return rec + sizeof(RWstoredValue); }
+  RWBoolean	before(unsigned r, unsigned s) const;	// heap order
+  RWBoolean	nextRecord(const char*& key, RWstoredValue& val);
+  void		refill(unsigned r);
+  void		siftDown(unsigned i);
+  void		sortRecords();
+  void		writeRun();
+
+  unsigned	keylen;
+  RWBoolean	ignoreNull;
+  RWdiskTreeCompare cmp;
+  size_t	recLen;			// value followed by key
+  unsigned long	cap;			// records that fit in memory
+  unsigned long	nrecs;			// records now in memory
+  unsigned long	pos;			// next to hand out, no runs
+  char*		space;			// the records themselves
+  unsigned long	spaceRecs;		// ... and how many it holds
+  char**	recs;			// sorted into this order
+  char**	aux;			// merge sort scratch
+  char*		outRec;			// last record handed out
+  FILE*		fp;			// temporary file of runs
+  unsigned	nruns;
+  unsigned	maxRuns;
+  RWoffset*	runStart;		// next unread record of run
+  unsigned long* runLeft;		// records of run still on file
+  unsigned long	bufRecs;		// per run buffer, while merging
+  unsigned long* runHave;		// records in run's buffer
+  unsigned long* runCur;		// next one in the buffer
+  unsigned*	heap;			// runs ordered by current key
+  unsigned	hsize;
+};
+
+RWDiskTreeSorter::RWDiskTreeSorter(unsigned kl, RWBoolean ign,
+				   RWdiskTreeCompare c, unsigned long memory) :
+  keylen(kl),
+  ignoreNull(ign),
+  cmp(c),
+  nrecs(0),
+  pos(0),
+  fp(0),
+  nruns(0),
+  maxRuns(16),
+  runHave(rwnil),
+  runCur(rwnil),
+  heap(rwnil),
+  hsize(0)
+{
+  recLen = sizeof(RWstoredValue) + keylen;
+  cap = memory / (recLen + 2*sizeof(char*));
+  if (cap < 64) cap = 64;
+  space    = new char[cap*recLen];
+  spaceRecs = cap;
+  recs     = new char*[cap];
+  aux      = new char*[cap];
+  outRec   = new char[recLen];
+  runStart = new RWoffset[maxRuns];
+  runLeft  = new unsigned long[maxRuns];
+}
+
+RWDiskTreeSorter::~RWDiskTreeSorter()
+{
+  if (fp) fclose(fp);
+  RWVECTOR_DELETE(spaceRecs*recLen) space;
+  RWVECTOR_DELETE(cap) recs;
+  RWVECTOR_DELETE(cap) aux;
+  RWVECTOR_DELETE(recLen) outRec;
+  RWVECTOR_DELETE(maxRuns) runStart;
+  RWVECTOR_DELETE(maxRuns) runLeft;
+  RWVECTOR_DELETE(nruns) runHave;
+  RWVECTOR_DELETE(nruns) runCur;
+  RWVECTOR_DELETE(nruns) heap;
+}
+
+void
+RWDiskTreeSorter::add(const char* key, RWstoredValue val)
+{
+  if (nrecs == cap)
+  {
+    sortRecords();
+    writeRun();
+  }
+  char* rec = space + nrecs*recLen;
+  memcpy(rec, &val, sizeof(RWstoredValue));
+  if (ignoreNull)
+    memcpy(rec + sizeof(RWstoredValue), key, keylen);
+  else
+    strncpy(rec + sizeof(RWstoredValue), key, keylen);
+  recs[nrecs++] = rec;
+}
+
+/*
+ * If everything fit in memory it is simply sorted in place.  Otherwise
+ * the last run goes out too and the merge is primed: each run gets an
+ * equal share of the record buffer.
+ */
+void
+RWDiskTreeSorter::done()
+{
+  sortRecords();
+  if (nruns == 0) return;
+  writeRun();
+
+  bufRecs = cap / nruns;
+  if (bufRecs == 0)		// more runs than records fit: one apiece
+  {
+    RWVECTOR_DELETE(spaceRecs*recLen) space;
+    space = new char[nruns*recLen];
+    spaceRecs = nruns;
+    bufRecs = 1;
+  }
+  runHave = new unsigned long[nruns];
+  runCur  = new unsigned long[nruns];
+  heap    = new unsigned[nruns];
+  for (register unsigned r = 0; r < nruns; r++)
+  {
+    refill(r);
+    heap[hsize++] = r;
+  }
+  for (unsigned i = hsize/2; i-- > 0; )
+    siftDown(i);
+}
+
+RWBoolean
+RWDiskTreeSorter::next(const char*& key, RWstoredValue& val, void* x)
+{
+  return ((RWDiskTreeSorter*)x)->nextRecord(key, val);
+}
+
+RWBoolean
+RWDiskTreeSorter::nextRecord(const char*& key, RWstoredValue& val)
+{
+  const char* rec;
+  if (nruns == 0)
+  {
+    if (pos >= nrecs) return FALSE;
+    rec = recs[pos++];
+  }
+  else
+  {
+    if (hsize == 0) return FALSE;
+    unsigned r = heap[0];
+    // Copy out: refilling the run's buffer would overwrite it.
+    memcpy(outRec, space + (r*bufRecs + runCur[r])*recLen, recLen);
+    rec = outRec;
+    if (++runCur[r] == runHave[r])
+    {
+      if (runLeft[r])
+	refill(r);
+      else
+	heap[0] = heap[--hsize];
+    }
+    if (hsize) siftDown(0);
+  }
+  memcpy(&val, rec, sizeof(RWstoredValue));
+  key = keyOf(rec);
+  return TRUE;
+}
+
+RWBoolean
+RWDiskTreeSorter::before(unsigned r, unsigned s) const
+{
+  int c = (*cmp)(keyOf(space + (r*bufRecs + runCur[r])*recLen),
+		 keyOf(space + (s*bufRecs + runCur[s])*recLen), keylen);
+  return c < 0 || (c == 0 && r < s);
+}
+
+void
+RWDiskTreeSorter::refill(unsigned r)
+{
+  unsigned long n = rwmin(bufRecs, runLeft[r]);
+  if (fseek(fp, runStart[r], 0))
+    RWTHROW(RWFileErr(RWMessage(RWTOOL_SEEKERR), fp, RWFileErr::seekErr));
+  if (fread(space + r*bufRecs*recLen, recLen, (size_t)n, fp) != n)
+    RWTHROW(RWFileErr(RWMessage(RWTOOL_READERR), fp, RWFileErr::readErr));
+  runStart[r] += n*recLen;
+  runLeft[r]  -= n;
+  runHave[r]   = n;
+  runCur[r]    = 0;
+}
+
+void
+RWDiskTreeSorter::siftDown(unsigned i)
+{
+  unsigned r = heap[i];
+  for (;;)
+  {
+    unsigned c = 2*i + 1;
+    if (c >= hsize) break;
+    if (c+1 < hsize && before(heap[c+1], heap[c])) c++;
+    if (!before(heap[c], r)) break;
+    heap[i] = heap[c];
+    i = c;
+  }
+  heap[i] = r;
+}
+
+// Bottom up merge sort of recs[]: stable, and no recursion.
+void
+RWDiskTreeSorter::sortRecords()
+{
+  char** from = recs;
+  char** to   = aux;
+  for (unsigned long width = 1; width < nrecs; width *= 2)
+  {
+    for (unsigned long lo = 0; lo < nrecs; lo += 2*width)
+    {
+      unsigned long mid = rwmin(lo + width, nrecs);
+      unsigned long hi  = rwmin(lo + 2*width, nrecs);
+      register unsigned long i = lo, j = mid, o = lo;
+      while (i < mid && j < hi)
+	to[o++] = (*cmp)(keyOf(from[j]), keyOf(from[i]), keylen) < 0 ?
+		  from[j++] : from[i++];
+      while (i < mid) to[o++] = from[i++];
+      while (j < hi)  to[o++] = from[j++];
+    }
+    char** t = from; from = to; to = t;
+  }
+  if (from != recs)
+    memcpy(recs, from, (size_t)nrecs*sizeof(char*));
+}
+
+void
+RWDiskTreeSorter::writeRun()
+{
+  if (fp == 0 && (fp = tmpfile()) == 0)
+    RWTHROW(RWFileErr(RWMessage(RWTOOL_WRITEERR), fp, RWFileErr::openErr));
+  if (nruns == maxRuns)
+  {
+    RWoffset*      newStart = new RWoffset[2*maxRuns];
+    unsigned long* newLeft  = new unsigned long[2*maxRuns];
+    memcpy(newStart, runStart, maxRuns*sizeof(RWoffset));
+    memcpy(newLeft,  runLeft,  maxRuns*sizeof(unsigned long));
+    RWVECTOR_DELETE(maxRuns) runStart;
+    RWVECTOR_DELETE(maxRuns) runLeft;
+    runStart = newStart;
+    runLeft  = newLeft;
+    maxRuns *= 2;
+  }
+  if (fseek(fp, 0L, 2))
+    RWTHROW(RWFileErr(RWMessage(RWTOOL_SEEKERR), fp, RWFileErr::seekErr));
+  runStart[nruns] = ftell(fp);
+  runLeft[nruns]  = nrecs;
+  for (register unsigned long i = 0; i < nrecs; i++)
+    if (fwrite(recs[i], recLen, 1, fp) != 1)
+      RWTHROW(RWFileErr(RWMessage(RWTOOL_WRITEERR), fp, RWFileErr::writeErr));
+  nruns++;
+  nrecs = 0;
+}
+
+/****************************************************************
+ *								*
+ *		RWBTreeOnDisk::sortAndLoad			*
+ *								*
+ ****************************************************************/
+
+/*
+ * Load keys supplied in any order, using no more than about memory
+ * bytes to sort them.  See bulkLoad().
+ */
+unsigned long
+RWBTreeOnDisk::sortAndLoad(RWdiskTreeSource src, void* x,
+			   unsigned long memory, double fill)
+{
+  RWDiskTreeSorter sorter(baseInfo.keylen, ignoreNulls(), compareKeys, memory);
+  const char* key;
+  RWstoredValue val;
+  while ((*src)(key, val, x))
+    sorter.add(key, val);
+  sorter.done();
+  return bulkLoad(RWDiskTreeSorter::next, &sorter, fill);
+}
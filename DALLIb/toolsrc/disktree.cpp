@@ -184,6 +184,9 @@
 # include "rw/cstring.h"
 # include <rw/rstream.h>
 #endif
+#ifdef RW_MULTI_THREAD
+# include "rw/mutex.h"
+#endif
 STARTWRAP
 #include <string.h> /* looking for strncmp and memcmp */
 ENDWRAP
@@ -202,16 +205,26 @@ RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: disktree.cpp,v $ $Revi
 
 class RWExport RWDiskTreeNode {
 friend class RWExport RWBTreeOnDisk;
+friend class RWExport RWDiskTreeLoader;
+friend class RWExport RWBTreeOnDiskCursor;
+friend class RWDiskTreeRun;
 private:
 // private constructors
   RWDiskTreeNode(unsigned size, RWBTreeOnDisk* tree);
   RWDiskTreeNode(unsigned size, RWBTreeOnDisk* tree, const char* key, 
                  RWstoredValue n);
-  ~RWDiskTreeNode() { delete[] nodeRef; }
+  RWDiskTreeNode(RWBTreeOnDisk* tree);	// View onto someone else's data
+  ~RWDiskTreeNode() { if(ownsRef) delete[] nodeRef; delete[] page; }
 
   int		binarySearch(const char* key, RWdiskTreeCompare) const;
   void		initialize();
   void		insert(const char* key, const RWstoredValue, int, RWoffset);
+// PackedStyle: the node as it is on disk
+  unsigned	entrySize(const char* key, const char* prev) const;
+  unsigned	keySize(const char* key) const;
+  void		pack(char*) const;
+  unsigned	packedSize() const;
+  void		unpack(const char*);
 #ifdef RDEBUG
   void		showOff(RWoffset);
 #endif
@@ -229,6 +242,8 @@ private:
 private:  //data
   RWBTreeOnDisk* tree;
   void*		 nodeRef;
+  RWBoolean	 ownsRef;		// FALSE for a view
+  char*		 page;			// PackedStyle: read into here
 };
 
 
@@ -338,6 +353,18 @@ RWDiskTreeNode::keys(int i) const	{
 #define ORDER2   (2*baseInfo.order)
 const size_t	 oplussv = sizeof(RWoffset)+sizeof(RWstoredValue);
 
+/*
+ * A PackedStyle node on disk is its count and a leaf flag, then, for
+ * all but leaves, sons(0); then for each key, its right son (again,
+ * not in leaves), its item, how many bytes it shares with the key
+ * before it, how many more follow, and those bytes.  Keys are stored
+ * only up to the first null, or with trailing nulls dropped if nulls
+ * are not ignored, and are padded again when read.
+ */
+typedef unsigned short	 RWpackedLength;
+const size_t	 packedEntryBytes = sizeof(RWstoredValue)+2*sizeof(RWpackedLength);
+const size_t	 packedHeaderBytes = 2*sizeof(unsigned);
+
 
 /*********************************************************
 *					 		  *
@@ -346,7 +373,7 @@ const size_t	 oplussv = sizeof(RWoffset)+sizeof(RWstoredValue);
 **********************************************************/
 
 RWDiskTreeNode::RWDiskTreeNode(unsigned size, RWBTreeOnDisk* t) :
-	  tree(t)
+	  tree(t), ownsRef(TRUE), page(rwnil)
 {
   nodeRef = new char[size];
   initialize();
@@ -354,7 +381,7 @@ RWDiskTreeNode::RWDiskTreeNode(unsigned size, RWBTreeOnDisk* t) :
 
 RWDiskTreeNode::RWDiskTreeNode(unsigned size, RWBTreeOnDisk* t,
 			       const char* key, RWstoredValue n)  :
-	tree(t)
+	tree(t), ownsRef(TRUE), page(rwnil)
 {
   nodeRef = new char[size];
   initialize();
@@ -366,6 +393,16 @@ RWDiskTreeNode::RWDiskTreeNode(unsigned size, RWBTreeOnDisk* t,
   counter() = 1;
 } 
 
+/*
+ * A view has no data of its own: nodeRef is pointed at a block held
+ * by the cache manager, or at a memory mapped file, and must only be
+ * read.
+ */
+RWDiskTreeNode::RWDiskTreeNode(RWBTreeOnDisk* t) :
+	tree(t), nodeRef(rwnil), ownsRef(FALSE), page(rwnil)
+{
+}
+
 /*
  * Binary search of node for key a in node with counter keys. Returns
  *		0  where	     a <  every key
@@ -429,6 +466,133 @@ RWDiskTreeNode::insert(const char* k, const RWstoredValue v, int loc,
   ++(counter());
 }
 
+// Bytes key takes in a packed node, following prev (rwnil for none).
+unsigned
+RWDiskTreeNode::entrySize(const char* key, const char* prev) const
+{
+  unsigned len = keySize(key);
+  unsigned shared = 0;
+  if(prev)
+  {
+    unsigned plen = keySize(prev);
+    while(shared < len && shared < plen && key[shared] == prev[shared])
+      shared++;
+  }
+  return packedEntryBytes + len - shared
+	 + (sons(0) == RWNIL ? 0 : sizeof(RWoffset));
+}
+
+// Significant length of key: up to a null, or to trailing nulls.
+unsigned
+RWDiskTreeNode::keySize(const char* key) const
+{
+  register unsigned len = nKEYLEN;
+  if(tree->ignoreNulls())
+  {
+    while(len > 0 && key[len-1] == 0)
+      len--;
+  }
+  else
+  {
+    const char* z = (const char*)memchr(key, 0, len);
+    if(z) len = z - key;
+  }
+  return len;
+}
+
+void
+RWDiskTreeNode::pack(char* p) const
+{
+  char* q = p;
+  unsigned u = counter();
+  memcpy(q, &u, sizeof(unsigned));		q += sizeof(unsigned);
+  RWBoolean leaf = (sons(0) == RWNIL);
+  u = leaf ? 1 : 0;
+  memcpy(q, &u, sizeof(unsigned));		q += sizeof(unsigned);
+  if(!leaf)
+  {
+    RWoffset o = sons(0);
+    memcpy(q, &o, sizeof(RWoffset));		q += sizeof(RWoffset);
+  }
+  const char* prev = rwnil;
+  unsigned plen = 0;
+  for(register int i = 0; i < counter(); i++)
+  {
+    const char* k = keys(i);
+    unsigned len = keySize(k);
+    RWpackedLength shared = 0;
+    while(shared < len && shared < plen && k[shared] == prev[shared])
+      shared++;
+    RWpackedLength rest = len - shared;
+    if(!leaf)
+    {
+      RWoffset o = sons(i+1);
+      memcpy(q, &o, sizeof(RWoffset));		q += sizeof(RWoffset);
+    }
+    RWstoredValue v = items(i);
+    memcpy(q, &v, sizeof(RWstoredValue));	q += sizeof(RWstoredValue);
+    memcpy(q, &shared, sizeof(RWpackedLength));	q += sizeof(RWpackedLength);
+    memcpy(q, &rest, sizeof(RWpackedLength));	q += sizeof(RWpackedLength);
+    memcpy(q, k + shared, rest);		q += rest;
+    prev = k;
+    plen = len;
+  }
+  RWPOSTCONDITION(q - p <= tree->diskNodeSize);
+  memset(q, 0, tree->diskNodeSize - (q - p));
+}
+
+unsigned
+RWDiskTreeNode::packedSize() const
+{
+  unsigned size = packedHeaderBytes;
+  if(sons(0) != RWNIL) size += sizeof(RWoffset);
+  for(register int i = 0; i < counter(); i++)
+    size += entrySize(keys(i), i ? keys(i-1) : rwnil);
+  return size;
+}
+
+void
+RWDiskTreeNode::unpack(const char* p)
+{
+  const char* q = p;
+  unsigned count, leaf;
+  memcpy(&count, q, sizeof(unsigned));		q += sizeof(unsigned);
+  memcpy(&leaf, q, sizeof(unsigned));		q += sizeof(unsigned);
+  RWPRECONDITION(count <= 2*tree->baseInfo.order);
+  if(leaf)
+    sons(0) = RWNIL;
+  else
+  {
+    memcpy(&sons(0), q, sizeof(RWoffset));	q += sizeof(RWoffset);
+  }
+  register unsigned klen = nKEYLEN;
+  for(register unsigned i = 0; i < count; i++)
+  {
+    if(leaf)
+      sons(i+1) = RWNIL;
+    else
+    {
+      memcpy(&sons(i+1), q, sizeof(RWoffset));	q += sizeof(RWoffset);
+    }
+    memcpy(&items(i), q, sizeof(RWstoredValue));	q += sizeof(RWstoredValue);
+    RWpackedLength shared, rest;
+    memcpy(&shared, q, sizeof(RWpackedLength));	q += sizeof(RWpackedLength);
+    memcpy(&rest, q, sizeof(RWpackedLength));	q += sizeof(RWpackedLength);
+    char* k = keys(i);
+    if(shared) memcpy(k, keys(i-1), shared);
+    memcpy(k + shared, q, rest);		q += rest;
+    unsigned len = shared + rest;
+    if(len < klen)
+    {
+      if(tree->ignoreNulls())
+	memset(k + len, 0, klen - len);
+      else
+	k[len] = 0;
+    }
+  }
+  counter() = count;
+}
+
 #ifdef RDEBUG
 void
 RWDiskTreeNode::showOff(RWoffset l)
@@ -459,6 +623,716 @@ RWDiskTreeNode::showOff(RWoffset l)
 }
 #endif    
 
+/****************************************************************
+ *								*
+ *			RWDiskTreeLoader			*
+ *								*
+ ****************************************************************/
+
+/*
+ * Builds a tree bottom up from keys arriving in ascending order.  Each
+ * level is a stream of keys and child offsets, cut into nodes of fill
+ * keys; the key that follows a full node goes up a level as separator.
+ * The last full node of each level is held back until the stream ends,
+ * then merged with, or split evenly against, the partial node after it
+ * so that every node but the root keeps at least minorder keys.  Packed
+ * nodes are filled to fill bytes instead, and have no minimum.
+ */
+class RWExport RWDiskTreeLoader {
+public:
+  RWDiskTreeLoader(RWBTreeOnDisk* tree, unsigned fill);
+  ~RWDiskTreeLoader();
+
+  void		push(int lev, const char* key, RWstoredValue val, RWoffset left);
+  RWoffset	finish(int lev, RWoffset last);	// returns the root
+private:
+  RWoffset	emit(RWDiskTreeNode*);
+  RWBoolean	room(int lev, const char* key);
+
+  enum { maxLevels = 8*sizeof(unsigned long) + 1 };
+
+  RWBTreeOnDisk* tree;
+  unsigned	fill;			// keys per packed node
+  int		levels;			// levels started so far
+  RWDiskTreeNode* cur[maxLevels];	// node being filled
+  unsigned	size[maxLevels];	// its packed size so far
+  RWDiskTreeNode* held[maxLevels];	// last full node, not yet written
+  char*		heldKey[maxLevels];	// separator following held[]
+  RWstoredValue	heldItem[maxLevels];
+};
+
+RWDiskTreeLoader::RWDiskTreeLoader(RWBTreeOnDisk* t, unsigned f) :
+	tree(t), fill(f), levels(0)
+{
+}
+
+RWDiskTreeLoader::~RWDiskTreeLoader()
+{
+  for (register int i = 0; i < levels; i++)
+  {
+    delete cur[i];
+    delete held[i];
+    RWVECTOR_DELETE(tree->baseInfo.keylen) heldKey[i];
+  }
+}
+
+RWoffset
+RWDiskTreeLoader::emit(RWDiskTreeNode* n)
+{
+  RWoffset off = tree->allocNode();
+  tree->writecache(off, n);
+  return off;
+}
+
+/*
+ * Append key to level lev.  Left is the offset of the node holding
+ * everything between key and its predecessor (RWNIL for leaves).
+ */
+void
+RWDiskTreeLoader::push(int lev, const char* key, RWstoredValue val, RWoffset left)
+{
+  unsigned klen = tree->baseInfo.keylen;
+  if (lev == levels)
+  {
+    RWPRECONDITION(levels < maxLevels);
+    cur[lev]     = new RWDiskTreeNode(tree->nodeRefSize, tree);
+    held[lev]    = rwnil;
+    heldKey[lev] = new char[klen];
+    levels++;
+  }
+  RWDiskTreeNode* n = cur[lev];
+  n->sons(n->counter()) = left;
+  if (room(lev, key))
+  {
+    n->insert(key, val, n->counter(), RWNIL);
+    return;
+  }
+
+  // n is full; key separates it from whatever comes next.
+  if (held[lev] != rwnil)
+  {
+    RWoffset off = emit(held[lev]);
+    push(lev+1, heldKey[lev], heldItem[lev], off);
+    cur[lev] = held[lev];
+    cur[lev]->initialize();
+  }
+  else
+    cur[lev] = new RWDiskTreeNode(tree->nodeRefSize, tree);
+  held[lev] = n;
+  memcpy(heldKey[lev], key, klen);
+  heldItem[lev] = val;
+}
+
+/*
+ * Is there room for key in the node being filled at level lev?  If so
+ * its bytes are counted as taken.  A node takes at least one key.
+ */
+RWBoolean
+RWDiskTreeLoader::room(int lev, const char* key)
+{
+  RWDiskTreeNode* n = cur[lev];
+  if (!tree->packedKeys())
+    return n->counter() < fill;
+  if (n->counter() == 0)
+    size[lev] = n->packedSize();
+  unsigned e = n->entrySize(key, n->counter() ? n->keys(n->counter()-1) : rwnil);
+  if (n->counter() > 0 && size[lev] + e > fill)
+    return FALSE;
+  size[lev] += e;
+  return TRUE;
+}
+
+/*
+ * End level lev, whose rightmost child is last.  Whatever remains of
+ * the level is written and its own end passed upward.
+ */
+RWoffset
+RWDiskTreeLoader::finish(int lev, RWoffset last)
+{
+  if (lev == levels)		// nothing came up this far: last is the root
+    return last;
+
+  RWDiskTreeNode* n = cur[lev];
+  RWDiskTreeNode* h = held[lev];
+  n->sons(n->counter()) = last;
+  if (h == rwnil)		// top level: n is the root
+    return emit(n);
+
+  unsigned total = h->counter() + 1 + n->counter();
+  RWBoolean fits = (total <= 2*tree->baseInfo.order);
+  if (tree->packedKeys())
+    fits = h->packedSize() + n->packedSize() + sizeof(RWoffset)
+	   + packedEntryBytes + tree->baseInfo.keylen <= tree->packLimit;
+  if (fits)
+  {
+    // Both fit in one node: append the separator and n to h.
+    h->insert(heldKey[lev], heldItem[lev], h->counter(), n->sons(0));
+    for (register unsigned i = 0; i < n->counter(); i++)
+      h->insert(n->keys(i), n->items(i), h->counter(), n->sons(i+1));
+    return finish(lev+1, emit(h));
+  }
+  if (tree->packedKeys())
+  {
+    push(lev+1, heldKey[lev], heldItem[lev], emit(h));
+    return finish(lev+1, emit(n));
+  }
+
+  // Rotate keys from h through the separator into n until even.
+  unsigned klen = tree->baseInfo.keylen;
+  unsigned keep = (total - 1) / 2;
+  while (h->counter() > keep)
+  {
+    unsigned big = h->counter() - 1;
+    n->insert(heldKey[lev], heldItem[lev], 0, n->sons(0));
+    n->sons(0) = h->sons(big+1);
+    memcpy(heldKey[lev], h->keys(big), klen);
+    heldItem[lev] = h->items(big);
+    h->sons(big+1) = RWNIL;
+    (h->counter())--;
+  }
+  push(lev+1, heldKey[lev], heldItem[lev], emit(h));
+  return finish(lev+1, emit(n));
+}
+
+/****************************************************************
+ *								*
+ *			RWDiskTreeRun				*
+ *								*
+ ****************************************************************/
+
+/*
+ * The keys of a node, or of two siblings and the key in their parent
+ * between them, seen as one run.  son(i) is the son to the left of
+ * key i.  Packed nodes are split and rebalanced by bytes through it.
+ */
+class RWDiskTreeRun {
+public:
+  RWDiskTreeRun(RWDiskTreeNode* a, RWDiskTreeNode* parent = rwnil,
+		int sep = 0, RWDiskTreeNode* b = rwnil);
+
+  void		copy(RWDiskTreeNode* to, int from, int upto) const;
+  int		entries() const { return n_; }
+  const char*	key(int i) const;
+  RWstoredValue	item(int i) const;
+  int		middle(unsigned& whole) const;
+  RWoffset	son(int i) const;
+private:
+  RWDiskTreeNode* a_;
+  RWDiskTreeNode* p_;
+  RWDiskTreeNode* b_;
+  int		sep_;			// p_->keys(sep_) follows a_
+  int		na_;
+  int		n_;
+};
+
+RWDiskTreeRun::RWDiskTreeRun(RWDiskTreeNode* a, RWDiskTreeNode* p,
+			     int sep, RWDiskTreeNode* b) :
+	a_(a), p_(p), b_(b), sep_(sep), na_(a->counter())
+{
+  n_ = b ? na_ + 1 + b->counter() : na_;
+}
+
+// Make to hold keys [from, upto) of the run, and the sons about them.
+void
+RWDiskTreeRun::copy(RWDiskTreeNode* to, int from, int upto) const
+{
+  to->initialize();
+  to->sons(0) = son(from);
+  for(register int i = from; i < upto; i++)
+    to->insert(key(i), item(i), to->counter(), son(i+1));
+}
+
+const char*
+RWDiskTreeRun::key(int i) const
+{
+  if(i < na_)  return a_->keys(i);
+  if(i == na_) return p_->keys(sep_);
+  return b_->keys(i - na_ - 1);
+}
+
+RWstoredValue
+RWDiskTreeRun::item(int i) const
+{
+  if(i < na_)  return a_->items(i);
+  if(i == na_) return p_->items(sep_);
+  return b_->items(i - na_ - 1);
+}
+
+/*
+ * Sets whole to the packed size of the run in one node, and returns
+ * the key to split it at so that the two halves are closest in size.
+ */
+int
+RWDiskTreeRun::middle(unsigned& whole) const
+{
+  unsigned head = packedHeaderBytes + (son(0) == RWNIL ? 0 : sizeof(RWoffset));
+  unsigned* size = new unsigned[n_ ? n_ : 1];
+  whole = head;
+  register int i;
+  for(i = 0; i < n_; i++)
+    whole += (size[i] = a_->entrySize(key(i), i ? key(i-1) : rwnil));
+  int best = n_ / 2;
+  unsigned bestSize = ~0U;
+  unsigned left = head + (n_ ? size[0] : 0);
+  for(i = 1; i < n_ - 1; i++)
+  {
+    // left holds keys [0, i); the right starts afresh at key i+1
+    unsigned right = whole - left - size[i] - size[i+1]
+		     + a_->entrySize(key(i+1), rwnil);
+    unsigned most = left > right ? left : right;
+    if(most < bestSize)
+    {
+      bestSize = most;
+      best = i;
+    }
+    left += size[i];
+  }
+  RWVECTOR_DELETE(n_ ? n_ : 1) size;
+  return best;
+}
+
+RWoffset
+RWDiskTreeRun::son(int i) const
+{
+  if(i <= na_) return a_->sons(i);
+  return b_->sons(i - na_ - 1);
+}
+
+/****************************************************************
+ *								*
+ *		Copy-on-write support classes			*
+ *								*
+ ****************************************************************/
+
+/*
+ * A small open addressed hash table from RWoffset to RWoffset, with
+ * RWNIL marking an empty slot.  Entries are never removed singly.
+ */
+class RWDiskTreeOffsetMap {
+public:
+  RWDiskTreeOffsetMap();
+  ~RWDiskTreeOffsetMap();
+
+  size_t	capacity() const	{ return n_; }
+  void		clear();
+  size_t	entries() const		{ return used_; }
+  RWoffset	find(RWoffset) const;		// RWNIL if not there
+  void		insert(RWoffset, RWoffset);	// Unless already there
+  RWoffset	keyAt(size_t i) const	{ return keys_[i]; }
+  RWoffset	valueAt(size_t i) const	{ return vals_[i]; }
+private:
+  size_t	slot(RWoffset) const;
+  void		resize(size_t);
+
+  enum { initialSize = 64 };
+  size_t	n_;			// power of 2
+  size_t	used_;
+  RWoffset*	keys_;
+  RWoffset*	vals_;
+};
+
+RWDiskTreeOffsetMap::RWDiskTreeOffsetMap() :
+  n_(0), used_(0), keys_(rwnil), vals_(rwnil)
+{
+  resize(initialSize);
+}
+
+RWDiskTreeOffsetMap::~RWDiskTreeOffsetMap()
+{
+  RWVECTOR_DELETE(n_) keys_;
+  RWVECTOR_DELETE(n_) vals_;
+}
+
+// Shrinks back too, lest one large update slow every later one.
+void
+RWDiskTreeOffsetMap::clear()
+{
+  if (n_ > initialSize)
+  {
+    RWVECTOR_DELETE(n_) keys_;
+    RWVECTOR_DELETE(n_) vals_;
+    keys_ = vals_ = rwnil;
+    n_ = 0;
+    resize(initialSize);
+    return;
+  }
+  for (register size_t i = 0; i < n_; i++) keys_[i] = RWNIL;
+  used_ = 0;
+}
+
+RWoffset
+RWDiskTreeOffsetMap::find(RWoffset k) const
+{
+  size_t i = slot(k);
+  return keys_[i] == k ? vals_[i] : RWNIL;
+}
+
+void
+RWDiskTreeOffsetMap::insert(RWoffset k, RWoffset v)
+{
+  size_t i = slot(k);
+  if (keys_[i] == k) return;
+  keys_[i] = k;
+  vals_[i] = v;
+  if (2 * ++used_ > n_) resize(2*n_);
+}
+
+// The slot holding k, or the empty one where it would go.
+size_t
+RWDiskTreeOffsetMap::slot(RWoffset k) const
+{
+  unsigned long h = (unsigned long)k;
+  h ^= h >> 15;
+  h *= 2654435761UL;
+  h ^= h >> 13;
+  size_t i = (size_t)(h & (n_-1));
+  while (keys_[i] != RWNIL && keys_[i] != k)
+    i = (i+1) & (n_-1);
+  return i;
+}
+
+void
+RWDiskTreeOffsetMap::resize(size_t n)
+{
+  RWoffset* oldKeys = keys_;
+  RWoffset* oldVals = vals_;
+  size_t    oldN    = n_;
+  n_    = n;
+  used_ = 0;
+  keys_ = new RWoffset[n_];
+  vals_ = new RWoffset[n_];
+  register size_t i;
+  for (i = 0; i < n_; i++) keys_[i] = RWNIL;
+  for (i = 0; i < oldN; i++)
+    if (oldKeys[i] != RWNIL) insert(oldKeys[i], oldVals[i]);
+  RWVECTOR_DELETE(oldN) oldKeys;
+  RWVECTOR_DELETE(oldN) oldVals;
+}
+
+/*
+ * Node offsets waiting to be deallocated, each tagged with the first
+ * tree version that can no longer reach it.  Tags never decrease, so
+ * the ones that may go are always at the front.
+ */
+class RWDiskTreeOffsetList {
+public:
+  RWDiskTreeOffsetList() : offs_(rwnil), tags_(rwnil), n_(0), max_(0) {;}
+  ~RWDiskTreeOffsetList();
+
+  void		add(RWoffset, unsigned long tag);
+  void		release(RWFileManager*, unsigned long upto);
+  void		releaseAll(RWFileManager* f)	{ release(f, ~0UL); }
+  size_t	entries() const			{ return n_; }
+  void		truncate(size_t n)		{ if (n < n_) n_ = n; }
+private:
+  RWoffset*	offs_;
+  unsigned long* tags_;
+  size_t	n_;
+  size_t	max_;
+};
+
+RWDiskTreeOffsetList::~RWDiskTreeOffsetList()
+{
+  RWVECTOR_DELETE(max_) offs_;
+  RWVECTOR_DELETE(max_) tags_;
+}
+
+void
+RWDiskTreeOffsetList::add(RWoffset off, unsigned long tag)
+{
+  if (n_ == max_)
+  {
+    size_t newMax = max_ ? 2*max_ : 64;
+    RWoffset*      newOffs = new RWoffset[newMax];
+    unsigned long* newTags = new unsigned long[newMax];
+    if (n_)
+    {
+      memcpy(newOffs, offs_, n_*sizeof(RWoffset));
+      memcpy(newTags, tags_, n_*sizeof(unsigned long));
+    }
+    RWVECTOR_DELETE(max_) offs_;
+    RWVECTOR_DELETE(max_) tags_;
+    offs_ = newOffs;
+    tags_ = newTags;
+    max_  = newMax;
+  }
+  offs_[n_]   = off;
+  tags_[n_++] = tag;
+}
+
+// Caller holds the I/O lock.
+void
+RWDiskTreeOffsetList::release(RWFileManager* fmgr, unsigned long upto)
+{
+  size_t k = 0;
+  while (k < n_ && tags_[k] <= upto)
+    fmgr->deallocate(offs_[k++]);
+  if (k == 0) return;
+  n_ -= k;
+  memmove(offs_, offs_ + k, n_*sizeof(RWoffset));
+  memmove(tags_, tags_ + k, n_*sizeof(unsigned long));
+}
+
+// Lookups in progress that started at the same tree version.
+struct RWDiskTreeEpoch {
+  unsigned long		version;
+  unsigned		readers;
+  RWDiskTreeEpoch*	next;
+};
+
+/*
+ * Everything RWBTreeOnDisk needs in copy-on-write mode.  During an
+ * update the tree code goes on using the offsets nodes had when it
+ * began ("logical" offsets); remap says where a node's new copy is.
+ * The parent map, filled in as nodes are read, lets endUpdate() find
+ * the ancestors that must be copied so as to point at the copies.
+ *
+ * The locks: writeLock is held for a whole update; snapLock guards
+ * the published root and the epochs; ioLock is held around each use
+ * of the cache and file managers, which are shared by all threads.
+ */
+class RWDiskTreeShadow {
+public:
+  RWDiskTreeShadow(RWoffset root);
+  ~RWDiskTreeShadow();
+
+  RWDiskTreeEpoch*	acquire(RWoffset& root);	// start a lookup
+  void			release(RWDiskTreeEpoch*);	// and end it
+  unsigned long		oldest();	// oldest version still in use
+
+  RWBoolean		active;		// an update is in progress
+  RWDiskTreeOffsetMap	remap;		// logical -> copy
+  RWDiskTreeOffsetMap	parent;		// child -> parent, as first read
+  RWDiskTreeOffsetMap	fresh;		// allocated during this update
+  RWDiskTreeOffsetMap	dead;		// freed during this update
+  RWDiskTreeOffsetList	pending;	// free after this update
+  RWDiskTreeOffsetList	garbage;	// free when no reader can see
+  size_t		pendingMark;	// their lengths as the update began
+  size_t		garbageMark;
+
+  unsigned long		version;	// of the published tree
+  RWoffset		published;	// its root
+  RWDiskTreeEpoch*	head;		// oldest epoch
+  RWDiskTreeEpoch*	tail;
+#ifdef RW_MULTI_THREAD
+  RWMutex		writeLock;
+  RWMutex		snapLock;
+  RWMutex		ioLock;
+#endif
+};
+
+RWDiskTreeShadow::RWDiskTreeShadow(RWoffset root) :
+  active(FALSE),
+  pendingMark(0),
+  garbageMark(0),
+  version(0),
+  published(root),
+  head(rwnil),
+  tail(rwnil)
+{
+}
+
+RWDiskTreeShadow::~RWDiskTreeShadow()
+{
+  while (head)
+  {
+    RWDiskTreeEpoch* e = head;
+    head = head->next;
+    delete e;
+  }
+}
+
+RWDiskTreeEpoch*
+RWDiskTreeShadow::acquire(RWoffset& root)
+{
+  RWGUARD(snapLock);
+  if (tail == rwnil || tail->version != version)
+  {
+    RWDiskTreeEpoch* e = new RWDiskTreeEpoch;
+    e->version = version;
+    e->readers = 0;
+    e->next    = rwnil;
+    if (tail) tail->next = e;
+    else      head = e;
+    tail = e;
+  }
+  tail->readers++;
+  root = published;
+  return tail;
+}
+
+void
+RWDiskTreeShadow::release(RWDiskTreeEpoch* e)
+{
+  RWGUARD(snapLock);
+  e->readers--;
+}
+
+// Caller holds snapLock.  Finished epochs are dropped on the way.
+unsigned long
+RWDiskTreeShadow::oldest()
+{
+  while (head && head->readers == 0)
+  {
+    RWDiskTreeEpoch* e = head;
+    head = head->next;
+    delete e;
+  }
+  if (head == rwnil) tail = rwnil;
+  return head ? head->version : version;
+}
+
+// Holds a shadow's ioLock, if there is a shadow, for its lifetime.
+class RWDiskTreeIOGuard {
+public:
+#ifdef RW_MULTI_THREAD
+  RWDiskTreeIOGuard(RWDiskTreeShadow* s) : s_(s)
+	{ if (s_) s_->ioLock.acquire(); }
+  ~RWDiskTreeIOGuard()
+	{ if (s_) s_->ioLock.release(); }
+private:
+  RWDiskTreeShadow* s_;
+#else
+  RWDiskTreeIOGuard(RWDiskTreeShadow*) {;}
+#endif
+};
+
+// Brackets an update: one not ended when it goes out of scope is abandoned.
+class RWDiskTreeUpdate {
+public:
+  RWDiskTreeUpdate(RWBTreeOnDisk* t) : t_(t), ended_(FALSE)
+	{ t_->beginUpdate(); }
+  ~RWDiskTreeUpdate()
+	{ if (!ended_) t_->abandonUpdate(); }
+  void		end()	{ t_->endUpdate(); ended_ = TRUE; }
+private:
+  RWBTreeOnDisk*	t_;
+  RWBoolean		ended_;
+};
+
+/*
+ * A Bloom filter over the keys of a tree: a key which is not in the
+ * filter is certainly not in the tree.  Keys can't be taken out, so
+ * removals leave their bits set; the tree builds a new filter once
+ * more keys have been added than this one was sized for.
+ *
+ * In the file the bits follow the header.  Its clean flag is cleared
+ * there before the first change after a save, so that a filter left
+ * behind by a crash is known to be stale.
+ */
+struct RWDiskTreeFilterHeader {
+  unsigned long		nbits;		// a power of 2
+  unsigned long		capacity;	// keys it was sized for
+  unsigned long		added;		// keys put in since it was built
+  unsigned long		clean;		// the bits in the file are current
+};
+
+class RWDiskTreeFilter {
+public:
+  RWDiskTreeFilter(unsigned long nbits, unsigned keylen, RWBoolean nulls);
+  ~RWDiskTreeFilter();
+
+  static unsigned long	sizeFor(unsigned long capacity);	// in bits
+
+  void			add(const char* key);
+  size_t		bytes() const	{return (size_t)(hdr.nbits/8);}
+  void			clear();
+  RWBoolean		full() const	{return hdr.added > hdr.capacity;}
+  RWBoolean		mayContain(const char* key) const;
+
+  RWDiskTreeFilterHeader hdr;
+  unsigned char*	bits;
+
+private:
+  void			hash(const char*, unsigned long&, unsigned long&) const;
+
+  unsigned		keylen_;
+  RWBoolean		nulls_;		// compared with memcmp()
+};
+
+// Ten bits and seven probes a key: about one false positive in a hundred.
+const unsigned RWDiskTreeFilterBitsPerKey = 10;
+const unsigned RWDiskTreeFilterProbes     = 7;
+
+RWDiskTreeFilter::RWDiskTreeFilter(unsigned long nbits, unsigned keylen,
+				   RWBoolean nulls) :
+  keylen_(keylen),
+  nulls_(nulls)
+{
+  hdr.nbits    = nbits;
+  hdr.capacity = nbits / RWDiskTreeFilterBitsPerKey;
+  hdr.added    = 0;
+  hdr.clean    = FALSE;
+  bits = new unsigned char[bytes()];
+  memset(bits, 0, bytes());
+}
+
+RWDiskTreeFilter::~RWDiskTreeFilter()
+{
+  RWVECTOR_DELETE(bytes()) bits;
+}
+
+unsigned long
+RWDiskTreeFilter::sizeFor(unsigned long capacity)
+{
+  unsigned long nbits = 1024;
+  while (nbits / RWDiskTreeFilterBitsPerKey < capacity) nbits <<= 1;
+  return nbits;
+}
+
+void
+RWDiskTreeFilter::add(const char* key)
+{
+  unsigned long h1, h2;
+  hash(key, h1, h2);
+  for (register unsigned i = 0; i < RWDiskTreeFilterProbes; i++, h1 += h2)
+  {
+    unsigned long b = h1 & (hdr.nbits-1);
+    bits[b >> 3] |= (unsigned char)(1 << (b & 7));
+  }
+  hdr.added++;
+}
+
+void
+RWDiskTreeFilter::clear()
+{
+  memset(bits, 0, bytes());
+  hdr.added = 0;
+}
+
+RWBoolean
+RWDiskTreeFilter::mayContain(const char* key) const
+{
+  unsigned long h1, h2;
+  hash(key, h1, h2);
+  for (register unsigned i = 0; i < RWDiskTreeFilterProbes; i++, h1 += h2)
+  {
+    unsigned long b = h1 & (hdr.nbits-1);
+    if ((bits[b >> 3] & (1 << (b & 7))) == 0) return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Two hashes of the key as the tree compares it (up to a null, unless
+ * nulls are significant), for double hashing.  FNV-1a, then mixed.
+ */
+void
+RWDiskTreeFilter::hash(const char* key, unsigned long& h1, unsigned long& h2) const
+{
+  unsigned long h = 2166136261UL;
+  for (register unsigned i = 0; i < keylen_ && (nulls_ || key[i]); i++)
+  {
+    h ^= (unsigned char)key[i];
+    h  = (h * 16777619UL) & 0xffffffffUL;
+  }
+  h1 = h;
+  h ^= h >> 15;
+  h  = (h * 2654435761UL) & 0xffffffffUL;
+  h ^= h >> 13;
+  h2 = h | 1;		// odd, so that the probes all differ
+}
+
 /*********************************************************
 *					 		  *
 *	  Public methods for Class RWBTreeOnDisk	  *
@@ -480,6 +1354,8 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
 			     unsigned minord )
     :
     baseLoc((smode!=V5Style) ? start : RWNIL), //flag oldStyle if needed
+    shadow(rwnil),
+    filter(rwnil),
     fmgr(&filemgr),
     cacheBlocks(blocks)
 {
@@ -501,7 +1377,9 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
       if(omode == create || (RWNIL == (baseLoc = fmgr->start()))) 
       {
 	// new file: use _ctor args to fill baseInfo
-	infoInit(RWBTreeOnDiskCurrentVersion,keylength,ord,minord,ignoreNull);
+	infoInit(smode == PackedStyle ? RWBTreeOnDiskPackedVersion
+				      : RWBTreeOnDiskCurrentVersion,
+		 keylength,ord,minord,ignoreNull);
 	// Now get some place to put it from file manager
 	baseLoc = fmgr->allocate(sizeof(baseInfo));
 	// and write it where-ever that was
@@ -511,7 +1389,7 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
   }
   // if this is old file: ignore _ctor args. If new, re-read info
   readInfo();
-  if(baseInfo.version != RWBTreeOnDiskCurrentVersion)
+  if(baseInfo.version != RWBTreeOnDiskCurrentVersion && !packedKeys())
   {
     // then assume V5 style
     infoInit(RWNIL,		// RWNIL=="entries() not cached"
@@ -523,6 +1401,17 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
 
 // finally we know enough to build the nodeRef stuff
   nodeRefSize = sizeof(AlignToNodeRef)+(ORDER2-2)*oplussv-16+KEYLEN*ORDER2;
+  diskNodeSize = nodeRefSize;
+  packLimit = 0;
+  if(packedKeys())
+  {
+    /*
+     * A node may go over packLimit by a few keys while it is being
+     * changed, never past the page; see settle().
+     */
+    diskNodeSize = (unsigned)baseInfo.pageSize;
+    packLimit = diskNodeSize - 4*(sizeof(RWoffset)+packedEntryBytes+KEYLEN);
+  }
   // and we know about style
   if(smode == V5Style || ignoreNulls() == FALSE)
   {
@@ -533,6 +1422,8 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
     compareKeys = (RWdiskTreeCompare)memcmp;
   }
   startup();
+  if(baseLoc != RWNIL && hasFilter())
+    filterLoad();
 
 #ifdef RDEBUG
   cout << "==========================================\n";
@@ -554,6 +1445,8 @@ RWBTreeOnDisk::RWBTreeOnDisk(RWFileManager& filemgr,
   cout << "Order:		" << baseInfo.order << endl;
   cout << "Min. Order	" << baseInfo.minorder << endl;
   cout << "Node Size:	" << nodeRefSize << endl;
+  if(packedKeys())
+    cout << "Page Size:	" << diskNodeSize << endl;
   cout << "==========================================\n\n";
 #endif
 }
@@ -567,8 +1460,16 @@ RWBTreeOnDisk::~RWBTreeOnDisk()
 #ifdef RDEBUG
   cout << "deleting RWBTreeOnDisk with " << entries() << " entries." << endl;
 #endif
+  copyOnWrite(FALSE);	// releases space still held for readers
+  if(filter && !filter->hdr.clean)
+    filterSave(TRUE);
+  delete filter;
   writeInfo();		// (== writeRoot, if old version)
   RWVECTOR_DELETE(baseInfo.keylen) moreKey;
+  RWVECTOR_DELETE(baseInfo.keylen) compactKey;
+  RWVECTOR_DELETE(diskNodeSize) pageBuf;
+  delete stats;
+  delete viewNode;
   delete workNode;
   delete root;		
   delete cmgr;		// automatically flushes the cache during _dtor
@@ -581,27 +1482,239 @@ RWBTreeOnDisk::~RWBTreeOnDisk()
  *     that many searches cause disk accesses -- increase the count.
  *  2: Memory is very tight, so that speed is less essential than space,
  *     or the tree is now much smaller than before -- decrease the count.
+ * The cache is resized in place, keeping what it holds.
+ */
+unsigned
+RWBTreeOnDisk::cacheCount(unsigned blocks)
+{
+  unsigned retblocks = cacheBlocks;	// Save old value
+  RWDiskTreeIOGuard guard(shadow);
+  if (blocks == 0) blocks = 1;
+  if (blocks != cacheBlocks) {
+    cmgr->resize(blocks);
+    cmgr->keep(blocks/2);	// room for the interior nodes
+    cacheBlocks = blocks;
+  }
+  return retblocks;
+}
+
+/*
+ * The cache manager is given its policy when it is built, so a new
+ * one is built in its place.  The cache writes through: nothing held
+ * in the old one is lost, but its statistics start afresh.
+ */
+RWCacheManager::policyMode
+RWBTreeOnDisk::cachePolicy(RWCacheManager::policyMode p)
+{
+  RWCacheManager::policyMode retpolicy = cmgr->policy();
+  RWDiskTreeIOGuard guard(shadow);
+  if (p != retpolicy) {
+    unsigned ahead = cmgr->readahead();
+    delete cmgr;
+    cmgr = new RWCacheManager(fmgr,diskNodeSize,cacheBlocks,p);
+    cmgr->keep(cacheBlocks/2);	// room for the interior nodes
+    cmgr->readahead(ahead);
+  }
+  return retpolicy;
+}
+
+// As cacheCount(), but as a budget of memory.
+unsigned long
+RWBTreeOnDisk::cacheBytes(unsigned long bytes)
+{
+  unsigned long retbytes = cacheBytes();
+  cacheCount((unsigned)(bytes / diskNodeSize));
+  return retbytes;
+}
+
+RWBoolean
+RWBTreeOnDisk::bloomFilter(RWBoolean on)
+{
+  RWBoolean old = bloomFilter();
+  if(baseLoc == RWNIL || on == old) return old;	// V5: nowhere to put it
+  RWDiskTreeUpdate update(this);
+  if(on)
+    filterBuild(2*baseInfo.entries + 1);
+  else
+  {
+    RWDiskTreeIOGuard guard(shadow);
+    if(!fmgr->isReadOnly())
+    {
+      fmgr->deallocate(baseInfo.filterLoc);
+      baseInfo.flags &= ~2UL;
+      writeInfo();
+    }
+    delete filter;
+    filter = rwnil;
+  }
+  update.end();
+  return old;
+}
+
+/*
+ * Replace the contents of the tree with the keys delivered by src,
+ * which must come in ascending order.  Keys equal to their predecessor
+ * are skipped.  Should one arrive out of order, the keys before it are
+ * kept as the new contents and an RWExternalErr (RWTOOL_KEYORDER) is
+ * thrown.
+ */
+unsigned long
+RWBTreeOnDisk::bulkLoad(RWdiskTreeSource src, void* x, double fillFactor)
+{
+  RWDiskTreeUpdate update(this);
+  empty();
+  unsigned fill;
+  if (packedKeys())		// in bytes
+  {
+    fill = (unsigned)(fillFactor * packLimit + 0.5);
+    if (fill > packLimit)     fill = packLimit;
+    if (fill < packLimit / 2) fill = packLimit / 2;
+  }
+  else
+  {
+    fill = (unsigned)(fillFactor * ORDER2 + 0.5);
+    if (fill > ORDER2)   fill = ORDER2;
+    if (fill < MINORDER) fill = MINORDER;
+    if (fill == 0)       fill = 1;
+  }
+
+  RWDiskTreeLoader loader(this, fill);
+  char* key  = new char[KEYLEN];
+  char* prev = new char[KEYLEN];
+  unsigned long count = 0;
+  RWBoolean inOrder = TRUE;
+  const char* k;
+  RWstoredValue v;
+  while ((*src)(k, v, x))
+  {
+    if(ignoreNulls())
+      memcpy(key, k, KEYLEN);
+    else
+      strncpy(key, k, KEYLEN);
+    if (count)
+    {
+      int c = (*compareKeys)(prev, key, KEYLEN);
+      if (c == 0) continue;
+      if (c > 0) { inOrder = FALSE; break; }
+    }
+    loader.push(0, key, v, RWNIL);
+    char* t = prev; prev = key; key = t;
+    count++;
+  }
+  RWVECTOR_DELETE(KEYLEN) key;
+  RWVECTOR_DELETE(KEYLEN) prev;
+
+  baseInfo.rootLoc = loader.finish(0, RWNIL);
+  baseInfo.entries = count;
+  writeInfo();
+  readRoot();
+  update.end();
+  if(filter)
+  {
+    // Only now: lookups of the old contents must not see the new filter
+    RWDiskTreeUpdate rebuild(this);
+    filterBuild(2*count + 1);
+    rebuild.end();
+  }
+  if (!inOrder)
+    RWTHROW(RWExternalErr(RWMessage(RWTOOL_KEYORDER)));
+  return count;
+}
+
+struct RWDiskTreeArray {
+  const char* const*	keys;
+  const RWstoredValue*	vals;
+  unsigned long		n;
+  unsigned long		i;
+};
+
+static RWBoolean
+rwDiskTreeArraySource(const char*& key, RWstoredValue& val, void* x)
+{
+  RWDiskTreeArray* a = (RWDiskTreeArray*)x;
+  if (a->i >= a->n) return FALSE;
+  key = a->keys[a->i];
+  val = a->vals[a->i++];
+  return TRUE;
+}
+
+unsigned long
+RWBTreeOnDisk::bulkLoad(const char* const* keys, const RWstoredValue* vals,
+			unsigned long n, double fillFactor)
+{
+  RWDiskTreeArray a;
+  a.keys = keys;
+  a.vals = vals;
+  a.n    = n;
+  a.i    = 0;
+  return bulkLoad(rwDiskTreeArraySource, &a, fillFactor);
+}
+
+void
+RWBTreeOnDisk::applyToKeyAndValue(RWdiskTreeApply ap, void* x)
+{
+  RWDiskTreeUpdate update(this);
+  apl(baseInfo.rootLoc, ap, x);
+  update.end();
+}
+
+void			
+RWBTreeOnDisk::clear()
+{
+  RWDiskTreeUpdate update(this);
+  empty();
+  update.end();
+}
+
+/*
+ * One step of a compaction pass.  The pass visits the nodes in
+ * preorder, moving each down the file if there is room, and notes in
+ * compactKey the largest key of each leaf it finishes; the next step
+ * descends to the first node beyond that key.  A step only stops in
+ * front of a leaf, and not before it has finished one, so each step
+ * makes progress however small maxNodes is.
  */
-unsigned
-RWBTreeOnDisk::cacheCount(unsigned blocks)
+RWBoolean
+RWBTreeOnDisk::compact(unsigned long maxNodes)
 {
-  unsigned retblocks = cacheBlocks;	// Save old value
-  if (blocks != cacheBlocks) {
-    delete cmgr;		// delete automatically flushes
-    cmgr = new RWCacheManager(fmgr,nodeRefSize,blocks);
-    cacheBlocks = blocks;
+  RWBoolean done = TRUE;
+  if(maxNodes == 0) maxNodes = ~0UL;
+  {
+    RWDiskTreeUpdate update(this);
+    if(!isEmpty())
+    {
+      RWBoolean leafDone = FALSE;
+      done = cpt(baseInfo.rootLoc, RWNIL, 0, rwnil, maxNodes, leafDone);
+    }
+    update.end();
   }
-  return retblocks;
+  if(done)
+  {
+    compacting = FALSE;
+    RWDiskTreeIOGuard guard(shadow);
+    fmgr->trim();
+  }
+  return done;
 }
 
-void			
-RWBTreeOnDisk::clear()
+/*
+ * Turn copy-on-write mode on or off.  It must not be turned off while
+ * other threads are using the tree.
+ */
+RWBoolean
+RWBTreeOnDisk::copyOnWrite(RWBoolean on)
 {
-  if(isEmpty() ) return;
-  del(baseInfo.rootLoc);
-  infoReInit();
-  writeInfo();
-  root->initialize();
+  RWBoolean old = copyOnWrite();
+  if (on && !old)
+    shadow = new RWDiskTreeShadow(baseInfo.rootLoc);
+  else if (!on && old)
+  {
+    shadow->pending.releaseAll(fmgr);
+    shadow->garbage.releaseAll(fmgr);
+    delete shadow;
+    shadow = rwnil;
+  }
+  return old;
 }
 
 /* Used by the entries() method */
@@ -641,28 +1754,138 @@ RWBTreeOnDisk::findKeyAndValue(const char* key, RWCString& retK, RWstoredValue&
 {
   // It would be better to unroll the root access here.
   val = RWNIL;
+  unsigned long visits = 0;
+  if(excluded(key))
+  {
+    countLookups(1, 0);
+    return FALSE;
+  }
+  if(shadow)
+  {
+    // Walk the published tree, with a node of our own.
+    RWDiskTreeNode node(nodeRefSize, (RWBTreeOnDisk*)this);
+    RWoffset tOff;
+    RWDiskTreeEpoch* e = shadow->acquire(tOff);
+    RWBoolean found = FALSE;
+    while(tOff != RWNIL)
+    {
+      visits++;
+      snapcache(tOff, &node);
+      int i = node.binarySearch(key, compareKeys);
+      if (    i < node.counter()
+	   && (*compareKeys)(key,node.keys(i),KEYLEN) == 0)
+      {
+	val  = node.items(i);
+	const char* pkey = node.keys(i);
+	if(ignoreNulls())
+	  retK = RWCString(pkey,(unsigned)KEYLEN);
+	else
+	  retK = RWCString(pkey,rwmin((unsigned)KEYLEN,(unsigned)strlen(pkey)));
+	found = TRUE;
+	break;
+      }
+      tOff = node.sons(i);
+    }
+    shadow->release(e);
+    countLookups(1, visits);
+    return found;
+  }
   RWoffset tOff = baseInfo.rootLoc;
   while(tOff != RWNIL)
   {
-    readcache(tOff,workNode);
-    int i = workNode->binarySearch(key, compareKeys);
-    if (    i < workNode->counter()
-	 && (*compareKeys)(key,workNode->keys(i),KEYLEN) == 0)
+    visits++;
+    RWDiskTreeNode* node = viewcache(tOff);
+    int i = node->binarySearch(key, compareKeys);
+    if (    i < node->counter()
+	 && (*compareKeys)(key,node->keys(i),KEYLEN) == 0)
     {			// found it!
-      val  = workNode->items(i);
-      const char* pkey = workNode->keys(i);
+      val  = node->items(i);
+      const char* pkey = node->keys(i);
       if(ignoreNulls())
 	retK = RWCString(pkey,(unsigned)KEYLEN);
       else
 	retK = RWCString(pkey,rwmin((unsigned)KEYLEN,(unsigned)strlen(pkey)));
+      countLookups(1, visits);
       return TRUE;
     }
-    tOff = workNode->sons(i);
+    tOff = node->sons(i);
   }
   // if we ever get here, we have failed to find the key
+  countLookups(1, visits);
   return FALSE;
 }
 
+/*
+ * Lookups may run in several threads at once, and alongside a change,
+ * so their counts are only added under the I/O lock.
+ */
+void
+RWBTreeOnDisk::countLookups(unsigned long lookups, unsigned long visits) const
+{
+  RWDiskTreeIOGuard guard(shadow);
+  stats->lookups      += lookups;
+  stats->lookupVisits += visits;
+}
+
+/*
+ * Look up a batch of keys.  They are put in order, by index, and the
+ * tree walked once over the lot; see fnd().
+ */
+unsigned long
+RWBTreeOnDisk::findValues(const char* const* keys, unsigned long n,
+			  RWstoredValue* vals, RWBoolean* found) const
+{
+  RWPRECONDITION( n == 0 || (keys != rwnil && vals != rwnil) );
+  register unsigned long i;
+  for(i = 0; i < n; i++)
+  {
+    vals[i] = RWNIL;
+    if(found) found[i] = FALSE;
+  }
+  countLookups(n, 0);
+  if(n == 0) return 0;
+
+  // Bottom up merge sort of the indices: stable, and no recursion.
+  unsigned long* from = new unsigned long[n];
+  unsigned long* to   = new unsigned long[n];
+  unsigned long m = 0;			// the keys still in question
+  for(i = 0; i < n; i++)
+    if(!excluded(keys[i])) from[m++] = i;
+  for(unsigned long width = 1; width < m; width *= 2)
+  {
+    for(unsigned long lo = 0; lo < m; lo += 2*width)
+    {
+      unsigned long mid = rwmin(lo + width, m);
+      unsigned long hi  = rwmin(lo + 2*width, m);
+      register unsigned long j = mid, o = lo;
+      i = lo;
+      while(i < mid && j < hi)
+	to[o++] = (*compareKeys)(keys[from[j]], keys[from[i]], KEYLEN) < 0 ?
+		  from[j++] : from[i++];
+      while(i < mid) to[o++] = from[i++];
+      while(j < hi)  to[o++] = from[j++];
+    }
+    unsigned long* t = from; from = to; to = t;
+  }
+
+  unsigned long nfound = 0;
+  if(m == 0)
+    ;
+  else if(shadow)
+  {
+    RWoffset tOff;
+    RWDiskTreeEpoch* e = shadow->acquire(tOff);
+    nfound = fnd(tOff, keys, from, 0, m, vals, found);
+    shadow->release(e);
+  }
+  else
+    nfound = fnd(baseInfo.rootLoc, keys, from, 0, m, vals, found);
+
+  RWVECTOR_DELETE(n) to;
+  RWVECTOR_DELETE(n) from;
+  return nfound;
+}
+
 /*
  * the height of the smallest branch is equal to the height of the
  * tree because in a B Tree, all leaves are at the same level.
@@ -671,12 +1894,25 @@ unsigned
 RWBTreeOnDisk::height() const
 {
   int h = 0;
+  if(shadow)
+  {
+    RWDiskTreeNode node(nodeRefSize, (RWBTreeOnDisk*)this);
+    RWoffset toff;
+    RWDiskTreeEpoch* e = shadow->acquire(toff);
+    while(RWNIL != toff)
+    {
+      ++h;
+      snapcache(toff, &node);
+      toff = node.sons(0);
+    }
+    shadow->release(e);
+    return h;
+  }
   RWoffset toff = baseInfo.rootLoc;
   while(RWNIL != toff)
   {
     ++h;
-    readcache(toff, workNode);
-    toff = workNode->sons(0);
+    toff = viewcache(toff)->sons(0);
   }
   return h;
 }
@@ -687,29 +1923,45 @@ RWBTreeOnDisk::insertKeyAndValue(const char*key, RWstoredValue val)
 #ifdef RDEBUG
   cout << "InsertK&V: Entries = " << entries() << endl;
 #endif
+  stats->inserts++;
+  RWDiskTreeUpdate update(this);
+  if(filter) filterAdd(key);	// before any lookup can find it
   retStatus status = ins(key,val,baseInfo.rootLoc);
   if(more == status)  // new root node. Look in moreXXX for data
-  {
-    memcpy(root->keys(0), moreKey, KEYLEN);
-    root->items(0) = moreItem;
-    root->sons(0) = baseInfo.rootLoc; 
-    root->sons(1) = moreOffset;
-    root->counter() = 1;
-    baseInfo.rootLoc = fmgr->allocate(nodeRefSize);
-    writecache(baseInfo.rootLoc,root);
-    writeInfo();
-  }
+    growRoot();
   baseInfo.entries += (ignored != status);
+  // A logged file commits whole, so keep entries() in step with it:
+  if(ignored != status && fmgr->isLogged())
+    writeInfo();
+  update.end();
   return ignored != status;
 }
 
+void
+RWBTreeOnDisk::resetStatistics()
+{
+  RWDiskTreeIOGuard guard(shadow);
+  stats->reset();
+  cmgr->resetStatistics();
+}
+
+// Bytes a node takes on disk: the page size, for packed nodes.
+unsigned
+RWBTreeOnDisk::nodeSize()
+{
+  return diskNodeSize;
+}
+
 RWBoolean
 RWBTreeOnDisk::removeKeyAndValue(const char* key, RWCString& retKey, RWstoredValue& retVal)
 {
+  stats->removes++;
+  RWDiskTreeUpdate update(this);
   retStatus status = rem(key, baseInfo.rootLoc, retKey, retVal);
   if(more == status) // underflow
   {
-    fmgr->deallocate(baseInfo.rootLoc);
+    readcache(baseInfo.rootLoc,root);	// not left over from an abandoned update
+    freeNode(baseInfo.rootLoc);
     baseInfo.rootLoc = root->sons(0);
     writeInfo();
     if(RWNIL == baseInfo.rootLoc)
@@ -717,13 +1969,15 @@ RWBTreeOnDisk::removeKeyAndValue(const char* key, RWCString& retKey, RWstoredVal
     else
       readcache(baseInfo.rootLoc,root);
   }
+  else if(split == status) // packed root grew too big
+    growRoot();
   if(ignored != status)
   {
     baseInfo.entries--;
-    return TRUE;
+    if(fmgr->isLogged()) writeInfo();
   }
-  else
-    return FALSE;
+  update.end();
+  return ignored != status;
 }
 
 /*
@@ -735,9 +1989,13 @@ RWBTreeOnDisk::replaceValue(const RWCString& key, const RWstoredValue newval, RW
 {
   // see comment at findKeyAndValue per unrolling? the first iter of the loop
   oldVal = RWNIL;
+  RWBoolean found = FALSE;
+  unsigned long visits = 0;
+  RWDiskTreeUpdate update(this);
   workOffset = baseInfo.rootLoc;
   while(workOffset != RWNIL)
   {
+    visits++;
     readcache(workOffset, workNode);
     int i = workNode->binarySearch(key, compareKeys);
     if (   i < workNode->counter()
@@ -746,11 +2004,14 @@ RWBTreeOnDisk::replaceValue(const RWCString& key, const RWstoredValue newval, RW
       oldVal = workNode->items(i);
       workNode->items(i) = newval;
       writecache(workOffset,workNode);
-      return TRUE;
+      found = TRUE;
+      break;
     }
     workOffset = workNode->sons(i);
   }
-  return FALSE;
+  countLookups(1, visits);
+  update.end();
+  return found;
 }
 
 RWdiskTreeCompare
@@ -781,6 +2042,21 @@ RWBTreeOnDisk::infoInit(RWstoredValue ver, unsigned keyl,
   baseInfo.reserved1 = RWNIL;
   // other flags may be or\'ed into flags, but *set* the first one
   baseInfo.flags = ignoreNull ? 1 : 0;
+  if(ver == RWBTreeOnDiskPackedVersion)
+  {
+    /*
+     * The page is what a V6Style node would take, but at least enough
+     * that a node can always be split or merged within it.  The
+     * in-memory node has room for as many keys as could fit.
+     */
+    RWPRECONDITION(keyl < 0x10000);
+    unsigned entry = sizeof(RWoffset) + packedEntryBytes + keyl;
+    unsigned page  = sizeof(AlignToNodeRef)+(2*ord-2)*oplussv-16+keyl*2*ord;
+    if(page < packedHeaderBytes + sizeof(RWoffset) + 12*entry)
+      page = packedHeaderBytes + sizeof(RWoffset) + 12*entry;
+    baseInfo.pageSize = page;
+    baseInfo.order = (page - packedHeaderBytes)/packedEntryBytes/2 + 1;
+  }
 }
 
 
@@ -798,12 +2074,20 @@ RWBTreeOnDisk::infoReInit()
 void
 RWBTreeOnDisk::startup()
 {
-  cmgr        = new RWCacheManager(fmgr,nodeRefSize,cacheBlocks);
+  if (cacheBlocks == 0) cacheBlocks = 1;
+  cmgr        = new RWCacheManager(fmgr,diskNodeSize,cacheBlocks);
+  cmgr->keep(cacheBlocks/2);	// room for the interior nodes
+  cmgr->readahead(cacheBlocks/4 < 8 ? cacheBlocks/4 : 8); // nodes go through cmgr
   root        = new RWDiskTreeNode(nodeRefSize,this);
   workNode    = new RWDiskTreeNode(nodeRefSize,this); // space to work
+  viewNode    = new RWDiskTreeNode(this);		 // for read-only walks
+  pageBuf     = packedKeys() ? new char[diskNodeSize] : rwnil;
+  stats       = new RWDiskTreeStatistics;
   readRoot();
   workOffset  = RWNIL;
   moreKey = new char[baseInfo.keylen];
+  compactKey = new char[baseInfo.keylen];
+  compacting = FALSE;
 }
 
 void
@@ -839,6 +2123,10 @@ RWBTreeOnDisk::writeInfo() const
   // Don't write if openend in RO mode.
   if(fmgr->isReadOnly())
     return;
+  // Nor in the middle of a copy-on-write update: endUpdate() will.
+  if(shadow && shadow->active)
+    return;
+  RWDiskTreeIOGuard guard(shadow);
 
   if(RWNIL == baseLoc) // old version: write rootLoc at start()
   {
@@ -871,12 +2159,107 @@ RWBTreeOnDisk::writeInfo() const
  *							 *
  *********************************************************/
 
+/*
+ * Look up keys[ord[lo..hi-1]], which are in order, in the subtree at
+ * start.  Those not in this node fall into runs, one for each son
+ * they go down to; the sons are then visited in file order, after
+ * telling the cache manager they are coming.  Returns the number found.
+ */
+unsigned long
+RWBTreeOnDisk::fnd(RWoffset start, const char* const* keys,
+		   const unsigned long* ord, unsigned long lo, unsigned long hi,
+		   RWstoredValue* vals, RWBoolean* found) const
+{
+  if(start == RWNIL) return 0;
+  countLookups(0, 1);
+  // A node of our own: the visits below would overwrite a shared one.
+  RWDiskTreeNode node(nodeRefSize, (RWBTreeOnDisk*)this);
+  snapcache(start, &node);
+
+  // The keys for any one son lie together: they fall in one interval.
+  int nsons = node.counter() + 1;
+  int* son = new int[nsons];
+  unsigned long* first = new unsigned long[nsons];
+  unsigned long* last  = new unsigned long[nsons];
+  int nruns = 0;
+  unsigned long nfound = 0;
+  for(unsigned long k = lo; k < hi; k++)
+  {
+    const char* key = keys[ord[k]];
+    int i = node.binarySearch(key, compareKeys);
+    if (    i < node.counter()
+	 && (*compareKeys)(key,node.keys(i),KEYLEN) == 0)
+    {
+      vals[ord[k]] = node.items(i);
+      if(found) found[ord[k]] = TRUE;
+      nfound++;
+    }
+    else if(node.sons(i) != RWNIL)
+    {
+      if(nruns == 0 || son[nruns-1] != i)
+      {
+	son[nruns] = i;
+	first[nruns++] = k;
+      }
+      last[nruns-1] = k+1;
+    }
+  }
+
+  // Put the runs in the order their sons lie in the file:
+  register int r, s;
+  for(r = 1; r < nruns; r++)
+  {
+    int so = son[r];
+    unsigned long f = first[r], l = last[r];
+    for(s = r; s > 0 && node.sons(son[s-1]) > node.sons(so); s--)
+    {
+      son[s] = son[s-1]; first[s] = first[s-1]; last[s] = last[s-1];
+    }
+    son[s] = so; first[s] = f; last[s] = l;
+  }
+  RWoffset* offs = new RWoffset[nsons];
+  for(r = 0; r < nruns; r++) offs[r] = node.sons(son[r]);
+  if(nruns > 1)
+  {
+    RWDiskTreeIOGuard guard(shadow);
+    cmgr->prefetch(offs, nruns);
+  }
+  for(r = 0; r < nruns; r++)
+    nfound += fnd(offs[r], keys, ord, first[r], last[r], vals, found);
+
+  RWVECTOR_DELETE(nsons) offs;
+  RWVECTOR_DELETE(nsons) last;
+  RWVECTOR_DELETE(nsons) first;
+  RWVECTOR_DELETE(nsons) son;
+  return nfound;
+}
+
+// Put the keys in the subtree at start into f.
+void
+RWBTreeOnDisk::flt(RWoffset start, RWDiskTreeFilter* f)
+{
+  if(start == RWNIL) return;
+  RWDiskTreeNode node(nodeRefSize, this);
+  snapcache(start, &node);
+  for(int i = 0; i <= node.counter(); i++)
+  {
+    flt(node.sons(i), f);
+    if(i < node.counter()) f->add(node.keys(i));
+  }
+}
+
 void
 RWBTreeOnDisk::apl(RWoffset start, RWdiskTreeApply ap, void* x)
 {
   if(start != RWNIL) 
   {
     readcache((workOffset = start),workNode);
+    if(workNode->sons(0) != RWNIL)
+    {
+      // Every son is about to be visited: let the reads start now.
+      RWDiskTreeIOGuard guard(shadow);
+      cmgr->prefetch(&workNode->sons(0), workNode->counter()+1);
+    }
     for(int i = 0; i < workNode->counter(); i++)
     {		
       // first do "smaller" subtree
@@ -886,13 +2269,81 @@ RWBTreeOnDisk::apl(RWoffset start, RWdiskTreeApply ap, void* x)
 	readcache((workOffset=start),workNode);    // so put it back after
       }
       (*ap)(workNode->keys(i),workNode->items(i), x); // do this level
-      writecache(workOffset,workNode); // ap may have changed values.
+      if(shadow == rwnil)
+	writecache(workOffset,workNode); // ap may have changed values.
       // and loop back to do everything "larger"
     }
     apl(workNode->sons(workNode->counter()), ap, x); // do very last son too
   }
 }
 
+RWoffset
+RWBTreeOnDisk::allocNode()
+{
+  RWDiskTreeIOGuard guard(shadow);
+  RWoffset off = fmgr->allocate(diskNodeSize);
+  if(shadow && shadow->active)
+    shadow->fresh.insert(off, off);
+  return off;
+}
+
+/*
+ * Every change to the tree is bracketed by beginUpdate() and
+ * endUpdate(), through an RWDiskTreeUpdate so that one which throws is
+ * abandoned.  Outside copy-on-write mode they do nothing.
+ */
+void
+RWBTreeOnDisk::beginUpdate()
+{
+  if(shadow == rwnil) return;
+#ifdef RW_MULTI_THREAD
+  shadow->writeLock.acquire();
+#endif
+  shadow->remap.clear();
+  shadow->parent.clear();
+  shadow->fresh.clear();
+  shadow->dead.clear();
+  shadow->pendingMark = shadow->pending.entries();
+  shadow->garbageMark = shadow->garbage.entries();
+  savedInfo = baseInfo;
+  shadow->active = TRUE;
+}
+
+/*
+ * Give up an update that threw before endUpdate() published it.  The
+ * published tree is still the tree: put back the info, forget what the
+ * update meant to free, and free what it took when the next update
+ * ends.  The filter is left as it is: an update only adds to it, and
+ * the keys it added merely make it less selective.  Nor is the info
+ * about it put back, as it must go on describing the filter in use.
+ * No I/O: this runs while the exception unwinds.
+ */
+void
+RWBTreeOnDisk::abandonUpdate()
+{
+  if(shadow == rwnil) return;
+  RWDiskTreeShadow* s = shadow;
+  if(s->active)
+  {
+    s->active = FALSE;
+    RWoffset filterLoc = baseInfo.filterLoc;
+    unsigned long filterFlag = baseInfo.flags & 2UL;
+    baseInfo = savedInfo;
+    baseInfo.filterLoc = filterLoc;
+    baseInfo.flags = (baseInfo.flags & ~2UL) | filterFlag;
+    s->pending.truncate(s->pendingMark);
+    s->garbage.truncate(s->garbageMark);
+    register size_t i;
+    for(i = 0; i < s->remap.capacity(); i++)
+      if(s->remap.keyAt(i) != RWNIL) s->pending.add(s->remap.valueAt(i), 0);
+    for(i = 0; i < s->fresh.capacity(); i++)
+      if(s->fresh.keyAt(i) != RWNIL) s->pending.add(s->fresh.keyAt(i), 0);
+  }
+#ifdef RW_MULTI_THREAD
+  s->writeLock.release();
+#endif
+}
+
 /*
  * combine this node into its left sibling, along with the value at
  * parent node's topLoc, delete this node from the file manager,
@@ -902,6 +2353,7 @@ void
 RWBTreeOnDisk::combineNodes(int topLoc, RWoffset topOff)
 {
   RWDiskTreeNode *tempNode = new RWDiskTreeNode(nodeRefSize,this);
+  stats->merges++;
   workOffset = topOff;				// work on parent first
   readcache(workOffset, tempNode);
   memcpy(moreKey,tempNode->keys(topLoc),KEYLEN);
@@ -939,11 +2391,338 @@ RWBTreeOnDisk::combineNodes(int topLoc, RWoffset topOff)
   (tempNode->counter()) += workNode->counter();
   writecache(leftOff,tempNode);
   delete tempNode;
-  fmgr->deallocate(killOff);
+  freeNode(killOff);
   // now put parent back into work area
   readcache(workOffset,workNode);
 }
 
+/*
+ * compact() the subtree at off, which is the son'th son of the node at
+ * parent (RWNIL for the root).  Every key in the subtree is greater
+ * than low, if it is not rwnil.  Returns FALSE if the step must stop.
+ * A node whose range reaches back to compactKey was dealt with by an
+ * earlier step, and is not counted or moved again; only its sons which
+ * may hold keys beyond compactKey are visited.  With budget at zero the
+ * step stops in front of the next leaf, once it has finished one.
+ */
+RWBoolean
+RWBTreeOnDisk::cpt(RWoffset off, RWoffset parent, int son, const char* low,
+		   unsigned long& budget, RWBoolean& leafDone)
+{
+  RWBoolean seen = compacting &&
+    (low == rwnil || (*compareKeys)(low, compactKey, KEYLEN) <= 0);
+  RWDiskTreeNode* node = new RWDiskTreeNode(nodeRefSize,this);
+  readcache(off, node);
+  RWBoolean leaf = node->sons(0) == RWNIL;
+  if(leaf && seen)
+  {
+    delete node;
+    return TRUE;
+  }
+  if(leaf && leafDone && budget == 0)
+  {
+    delete node;
+    return FALSE;
+  }
+
+  if(!seen)
+  {
+    if(budget) budget--;
+    off = relocate(off, parent, son);
+  }
+
+  if(leaf)
+  {
+    readcache(off, node);
+    memcpy(compactKey, node->keys(node->counter()-1), KEYLEN);
+    compacting = TRUE;
+    leafDone = TRUE;
+    delete node;
+    return TRUE;
+  }
+
+  // Skip the sons which hold nothing beyond compactKey:
+  int i = 0;
+  if(seen)
+  {
+    i = node->binarySearch(compactKey, compareKeys);
+    if(i < node->counter() && (*compareKeys)(node->keys(i), compactKey, KEYLEN) == 0)
+      i++;
+  }
+  for(; i <= node->counter(); i++)
+  {
+    if(!cpt(node->sons(i), off, i, i ? node->keys(i-1) : low, budget, leafDone))
+    {
+      delete node;
+      return FALSE;
+    }
+  }
+  delete node;
+  return TRUE;
+}
+
+void
+RWBTreeOnDisk::empty()
+{
+  if(isEmpty() ) return;
+  del(baseInfo.rootLoc);
+  infoReInit();
+  writeInfo();
+  root->initialize();
+  if(filter)
+  {
+    RWDiskTreeIOGuard guard(shadow);
+    if(filter->hdr.clean) filterSave(FALSE);
+    // Lookups of the published tree still need its keys in the filter
+    if(shadow == rwnil) filter->clear();
+  }
+}
+
+/*
+ * Finish a copy-on-write update.  The nodes it changed were written to
+ * new space; copy their ancestors too, up to the root, then make the
+ * copies point at one another instead of at the originals, and finally
+ * publish the new root.  The originals are freed once the last lookup
+ * that might be reading them has finished.
+ */
+void
+RWBTreeOnDisk::endUpdate()
+{
+  if(shadow == rwnil) return;
+  RWDiskTreeShadow* s = shadow;
+  unsigned long next = s->version + 1;
+
+  // 1: copy the ancestors of every copied node
+  size_t n = s->remap.entries();
+  RWoffset* changed = new RWoffset[n ? n : 1];
+  size_t j = 0;
+  register size_t i;
+  for(i = 0; i < s->remap.capacity(); i++)
+    if(s->remap.keyAt(i) != RWNIL) changed[j++] = s->remap.keyAt(i);
+  RWDiskTreeNode* node = new RWDiskTreeNode(nodeRefSize, this);
+  for(i = 0; i < n; i++)
+  {
+    RWoffset off = changed[i];
+    if(s->dead.find(off) != RWNIL) continue;
+    s->garbage.add(off, next);
+    RWoffset up;
+    while(off != baseInfo.rootLoc
+	  && (up = s->parent.find(off)) != RWNIL
+	  && s->dead.find(up)  == RWNIL
+	  && s->fresh.find(up) == RWNIL
+	  && s->remap.find(up) == RWNIL)
+    {
+      readcache(up, node);
+      writecache(up, node);
+      s->garbage.add(up, next);
+      off = up;
+    }
+  }
+  RWVECTOR_DELETE(n ? n : 1) changed;
+
+  // 2: point copied and new nodes at the copies
+  for(i = 0; i < s->remap.capacity(); i++)
+  {
+    if(s->remap.keyAt(i) != RWNIL && s->dead.find(s->remap.keyAt(i)) == RWNIL)
+      fixSons(s->remap.valueAt(i), node);
+  }
+  for(i = 0; i < s->fresh.capacity(); i++)
+  {
+    if(s->fresh.keyAt(i) != RWNIL && s->dead.find(s->fresh.keyAt(i)) == RWNIL)
+      fixSons(s->fresh.keyAt(i), node);
+  }
+  delete node;
+
+  // 3: publish
+  RWoffset newRoot = baseInfo.rootLoc;
+  if(newRoot != RWNIL && s->remap.find(newRoot) != RWNIL)
+    newRoot = s->remap.find(newRoot);
+  s->active = FALSE;
+  baseInfo.rootLoc = newRoot;
+  writeInfo();
+  readRoot();
+  unsigned long oldest;
+  {
+    RWGUARD(s->snapLock);
+    s->published = newRoot;
+    s->version   = next;
+    oldest       = s->oldest();
+  }
+  {
+    RWDiskTreeIOGuard guard(s);
+    s->pending.releaseAll(fmgr);
+    s->garbage.release(fmgr, oldest);
+    // With a log, each update is a transaction; sync() makes it durable
+    if(fmgr->isLogged()) fmgr->commit(FALSE);
+  }
+#ifdef RW_MULTI_THREAD
+  s->writeLock.release();
+#endif
+}
+
+/*
+ * TRUE if the filter says the key is not in the tree.  The filter
+ * hashes the key bytes, so it is only asked while the tree compares
+ * them with its own strncmp or memcmp; keys that another comparison
+ * calls equal may hash apart.
+ */
+RWBoolean
+RWBTreeOnDisk::excluded(const char* key) const
+{
+  if(compareKeys != (ignoreNulls() ? (RWdiskTreeCompare)memcmp
+				   : (RWdiskTreeCompare)strncmp))
+    return FALSE;
+  RWDiskTreeIOGuard guard(shadow);
+  if(filter == rwnil || filter->mayContain(key)) return FALSE;
+  stats->filterRejects++;
+  return TRUE;
+}
+
+void
+RWBTreeOnDisk::filterAdd(const char* key)
+{
+  if(filter->full())
+    filterBuild(2*baseInfo.entries + 1);
+  RWDiskTreeIOGuard guard(shadow);
+  if(filter->hdr.clean) filterSave(FALSE);	// the file's copy is stale
+  filter->add(key);
+}
+
+/*
+ * Build a new filter with room for capacity keys from the keys in the
+ * tree, and put it in the file in place of any old one.  Lookups go on
+ * using the old one meanwhile.  In copy-on-write mode the tree it is
+ * built from must hold every key of the published one.
+ */
+void
+RWBTreeOnDisk::filterBuild(unsigned long capacity)
+{
+  RWDiskTreeFilter* f =
+    new RWDiskTreeFilter(RWDiskTreeFilter::sizeFor(capacity), KEYLEN, ignoreNulls());
+  flt(baseInfo.rootLoc, f);
+
+  RWDiskTreeIOGuard guard(shadow);
+  if(!fmgr->isReadOnly() &&
+     (!hasFilter() || filter == rwnil || filter->bytes() != f->bytes()))
+  {
+    if(hasFilter()) fmgr->deallocate(baseInfo.filterLoc);
+    baseInfo.filterLoc = fmgr->allocate(sizeof(f->hdr) + f->bytes());
+    baseInfo.flags |= 2;
+    writeInfo();
+  }
+  delete filter;
+  filter = f;
+  filterSave(TRUE);
+}
+
+// Read the filter; one not saved since it was last changed is rebuilt.
+void
+RWBTreeOnDisk::filterLoad()
+{
+  RWDiskTreeFilterHeader hdr;
+  if(fmgr->SeekTo(baseInfo.filterLoc) == FALSE)
+    RWTHROW(RWFileErr(RWMessage( RWTOOL_SEEKERR ),
+		      fmgr->GetStream(),
+		      RWFileErr::seekErr) );
+  if(fmgr->Read((char*)&hdr, sizeof(hdr)) == FALSE)
+    RWTHROW(RWFileErr(RWMessage( RWTOOL_READERR ),
+		      fmgr->GetStream(),
+		      RWFileErr::readErr) );
+  if(!hdr.clean)
+  {
+    filterBuild(2*baseInfo.entries + 1);
+    return;
+  }
+  filter = new RWDiskTreeFilter(hdr.nbits, KEYLEN, ignoreNulls());
+  filter->hdr = hdr;
+  if(fmgr->Read((char*)filter->bits, filter->bytes()) == FALSE)
+    RWTHROW(RWFileErr(RWMessage( RWTOOL_READERR ),
+		      fmgr->GetStream(),
+		      RWFileErr::readErr) );
+}
+
+/*
+ * Write the filter's header, marked clean or not, and if clean the
+ * bits too.  The caller holds the IO guard.
+ */
+void
+RWBTreeOnDisk::filterSave(RWBoolean clean)
+{
+  filter->hdr.clean = clean;
+  if(fmgr->isReadOnly()) return;
+  if(fmgr->SeekTo(baseInfo.filterLoc) == FALSE)
+    RWTHROW(RWFileErr(RWMessage( RWTOOL_SEEKERR ),
+		      fmgr->GetStream(),
+		      RWFileErr::seekErr) );
+  if(fmgr->Write((const char*)&filter->hdr, sizeof(filter->hdr)) == FALSE
+     || (clean && fmgr->Write((const char*)filter->bits, filter->bytes()) == FALSE))
+    RWTHROW(RWFileErr(RWMessage( RWTOOL_WRITEERR ),
+		      fmgr->GetStream(),
+		      RWFileErr::writeErr) );
+}
+
+// Replace any son of the node at off that has been copied by its copy.
+void
+RWBTreeOnDisk::fixSons(RWoffset off, RWDiskTreeNode* node)
+{
+  snapcache(off, node);
+  RWBoolean changed = FALSE;
+  for(register int i = 0; i <= node->counter(); i++)
+  {
+    RWoffset copy;
+    if(node->sons(i) != RWNIL
+       && (copy = shadow->remap.find(node->sons(i))) != RWNIL)
+    {
+      node->sons(i) = copy;
+      changed = TRUE;
+    }
+  }
+  if(changed)
+  {
+    RWDiskTreeIOGuard guard(shadow);
+    putcache(off, node);
+  }
+}
+
+/*
+ * In copy-on-write mode a node given up during an update may still be
+ * in use by lookups: it is freed later.
+ */
+void
+RWBTreeOnDisk::freeNode(RWoffset a)
+{
+  RWDiskTreeIOGuard guard(shadow);
+  if(shadow == rwnil || !shadow->active)
+  {
+    fmgr->deallocate(a);
+    return;
+  }
+  shadow->dead.insert(a, a);
+  if(shadow->fresh.find(a) != RWNIL)
+    shadow->pending.add(a, 0);		// no reader has seen it
+  else
+  {
+    RWoffset copy = shadow->remap.find(a);
+    if(copy != RWNIL)
+      shadow->pending.add(copy, 0);
+    shadow->garbage.add(a, shadow->version + 1);
+  }
+}
+
+// Put a new root over the old one and moreXXX.
+void
+RWBTreeOnDisk::growRoot()
+{
+  memcpy(root->keys(0), moreKey, KEYLEN);
+  root->items(0) = moreItem;
+  root->sons(0) = baseInfo.rootLoc; 
+  root->sons(1) = moreOffset;
+  root->counter() = 1;
+  baseInfo.rootLoc = allocNode();
+  writecache(baseInfo.rootLoc,root);
+  writeInfo();
+}
+
 void
 RWBTreeOnDisk::del(RWoffset start)
 {
@@ -961,7 +2740,7 @@ RWBTreeOnDisk::del(RWoffset start)
       } /* for */
       del(workNode->sons(workNode->counter()));
     } /* if */
-    fmgr->deallocate(start);
+    freeNode(start);
   } /* if */
 }
 
@@ -1015,6 +2794,18 @@ RWBTreeOnDisk::ins(const char* key, RWstoredValue val, RWoffset start)
     workOffset = start;
     readcache(workOffset,workNode);
   }
+  if(packedKeys())
+  {
+    // insert first, then see whether it still fits
+    workNode->insert(moreKey,moreItem,loc,moreOffset);
+    if(workNode->packedSize() <= packLimit)
+    {
+      writecache(workOffset,workNode);
+      return success;
+    }
+    splitPacked();
+    return more;
+  }
   if(workNode->counter() < ORDER2)
   {
     // easy: room to insert right here
@@ -1112,19 +2903,137 @@ void RWBTreeOnDisk::moveItRight(int topLoc, RWoffset topOff)
 void
 RWBTreeOnDisk::readcache(RWoffset a, RWDiskTreeNode* b) const
 {
-  if(cmgr->read(a,b->nodeRef) == FALSE)
+  RWoffset phys = a;
+  if(shadow && shadow->active)
+  {
+    RWoffset copy = shadow->remap.find(a);
+    if(copy != RWNIL) phys = copy;
+  }
+  snapcache(phys, b);
+  if(shadow && shadow->active)
+  {
+    for(register int i = 0; i <= b->counter(); i++)
+      if(b->sons(i) != RWNIL)
+	shadow->parent.insert(b->sons(i), a);
+  }
+}
+
+/*
+ * Write the node to offset a as it stands, ignoring copy-on-write.
+ * The caller holds the IO guard, which covers pageBuf too.
+ */
+void
+RWBTreeOnDisk::putcache(RWoffset a, RWDiskTreeNode* b) const
+{
+  void* p = b->nodeRef;
+  stats->nodeWrites++;
+  if(packedKeys())
+    b->pack((char*)(p = pageBuf));
+  if(cmgr->write(a,p) == FALSE)
+    RWTHROW(RWFileErr( RWMessage(RWTOOL_WRITEERR ),
+		       fmgr->GetStream(),
+		       RWFileErr::writeErr) );
+}
+
+/*
+ * Read the node actually at offset a, ignoring any copy-on-write update.
+ * In copy-on-write mode the I/O lock is held only to look in the cache:
+ * if the file allows, a miss is read with no lock held, so that lookups
+ * in several threads can wait on the disk at once, and a packed node
+ * is read into its own page and unpacked outside the lock too.
+ */
+void
+RWBTreeOnDisk::snapcache(RWoffset a, RWDiskTreeNode* b) const
+{
+  if(shadow && fmgr->sharesReads())
+  {
+    RWBoolean packed = packedKeys();
+    if(packed && b->page == rwnil) b->page = new char[diskNodeSize];
+    char* p = packed ? b->page : (char*)b->nodeRef;
+    RWBoolean cached;
+    {
+      RWDiskTreeIOGuard guard(shadow);
+      stats->nodeReads++;
+      cached = cmgr->lookup(a, p);
+      if(cached && !packed && b->sons(0) != RWNIL)
+	cmgr->retain(a);	// interior: keep it
+    }
+    if(cached && !packed) return;
+    if(!cached && cmgr->fetch(a, p) == FALSE)
+      RWTHROW(RWFileErr( RWMessage( RWTOOL_READERR ),
+			 fmgr->GetStream(),
+			 RWFileErr::readErr) );
+    if(packed) b->unpack(p);
+    if(!cached || b->sons(0) != RWNIL)
+    {
+      RWDiskTreeIOGuard guard(shadow);
+      if(!cached) cmgr->install(a, p);
+      if(b->sons(0) != RWNIL) cmgr->retain(a);
+    }
+    return;
+  }
+  RWDiskTreeIOGuard guard(shadow);
+  stats->nodeReads++;
+  if(packedKeys())
+  {
+    // Unpack straight from the cache if the node is there.
+    const char* p = cmgr->address(a);
+    if(p == rwnil)
+    {
+      if(cmgr->read(a,pageBuf) == FALSE)
+	RWTHROW(RWFileErr( RWMessage( RWTOOL_READERR ),
+			   fmgr->GetStream(),
+			   RWFileErr::readErr) );
+      p = pageBuf;
+    }
+    b->unpack(p);
+  }
+  else if(cmgr->read(a,b->nodeRef) == FALSE)
       RWTHROW(RWFileErr( RWMessage( RWTOOL_READERR ),
 			 fmgr->GetStream(),
 			 RWFileErr::readErr) );
+  if(b->sons(0) != RWNIL)
+    cmgr->retain(a);		// interior: keep it
+}
+
+/*
+ * Get a read-only look at the node at offset a.  If the cache manager
+ * can hand out the block in place (it is cached, or the file is memory
+ * mapped) and it is suitably aligned, no copy is made.  Otherwise, and
+ * always for packed nodes, the node is read into workNode.
+ */
+RWDiskTreeNode*
+RWBTreeOnDisk::viewcache(RWoffset a) const
+{
+  const char* p = packedKeys() ? rwnil : cmgr->address(a);
+  if(p != rwnil && ((unsigned long)p % sizeof(RWoffset)) == 0)
+  {
+    stats->nodeReads++;
+    viewNode->nodeRef = (void*)p;
+    if(viewNode->sons(0) != RWNIL)
+      cmgr->retain(a);
+    return viewNode;
+  }
+  readcache(a, workNode);
+  return workNode;
 }
 
 void
 RWBTreeOnDisk::writecache(RWoffset a, RWDiskTreeNode* b)
 {
-  if(cmgr->write(a,b->nodeRef) == FALSE)
-    RWTHROW(RWFileErr( RWMessage(RWTOOL_WRITEERR ),
-		       fmgr->GetStream(),
-		       RWFileErr::writeErr) );
+  RWDiskTreeIOGuard guard(shadow);
+  if(shadow && shadow->active && shadow->fresh.find(a) == RWNIL)
+  {
+    // Never overwrite a node a reader may see: write a copy instead.
+    RWoffset copy = shadow->remap.find(a);
+    if(copy == RWNIL)
+    {
+      copy = fmgr->allocate(diskNodeSize);
+      shadow->remap.insert(a, copy);
+    }
+    a = copy;
+  }
+  putcache(a, b);
 }
 
 void
@@ -1138,6 +3047,93 @@ RWBTreeOnDisk::readRoot()
   readcache(baseInfo.rootLoc, root);
 }
 
+/*
+ * Move the node at "from", the son'th son of the node at parent (RWNIL
+ * for the root), to the lowest free space in the file, if that is
+ * lower.  Returns where the node is now.
+ */
+RWoffset
+RWBTreeOnDisk::relocate(RWoffset from, RWoffset parent, int son)
+{
+  RWoffset to;
+  {
+    RWDiskTreeIOGuard guard(shadow);
+    to = fmgr->allocateBelow(diskNodeSize, from);
+    if(to == RWNIL) return from;
+    if(shadow && shadow->active)
+      shadow->fresh.insert(to, to);
+  }
+  stats->relocations++;
+  RWDiskTreeNode* node = new RWDiskTreeNode(nodeRefSize,this);
+  readcache(from, node);
+  writecache(to, node);
+  if(parent == RWNIL)
+  {
+    baseInfo.rootLoc = to;
+    writeInfo();
+    readRoot();
+  }
+  else
+  {
+    readcache(parent, node);
+    node->sons(son) = to;
+    writecache(parent, node);
+  }
+  delete node;
+  freeNode(from);
+  return to;
+}
+
+/*
+ * Packed counterpart of restoreNode(): sons(k) of workNode has become
+ * too small.  If it and a sibling, with the key between them, fit in
+ * one node, they are merged; otherwise their keys are shared out
+ * between them evenly by bytes.  Either way workNode is changed but
+ * not written: settle() does that.
+ */
+void
+RWBTreeOnDisk::rebalance(int k)
+{
+  int s = (k > 0) ? k-1 : k;		// left sibling, if there is one
+  RWoffset leftOff  = workNode->sons(s);
+  RWoffset rightOff = workNode->sons(s+1);
+  RWDiskTreeNode *left  = new RWDiskTreeNode(nodeRefSize,this);
+  RWDiskTreeNode *right = new RWDiskTreeNode(nodeRefSize,this);
+  RWDiskTreeNode *tempNode = new RWDiskTreeNode(nodeRefSize,this);
+  readcache(leftOff,left);
+  readcache(rightOff,right);
+  RWDiskTreeRun run(left, workNode, s, right);
+  unsigned whole;
+  int m = run.middle(whole);
+  if(whole <= packLimit)
+  {
+    stats->merges++;
+    run.copy(tempNode, 0, run.entries());
+    writecache(leftOff,tempNode);
+    freeNode(rightOff);
+    for(int i = s; i < workNode->counter() - 1; i++)
+    {
+      memcpy(workNode->keys(i),workNode->keys(i+1), KEYLEN);
+      workNode->items(i) = workNode->items(i+1);
+      workNode->sons(i+1) = workNode->sons(i+2);
+    }
+    (workNode->counter())--;
+  }
+  else
+  {
+    run.copy(tempNode, 0, m);
+    writecache(leftOff,tempNode);
+    run.copy(tempNode, m+1, run.entries());
+    writecache(rightOff,tempNode);
+    memcpy(moreKey, run.key(m), KEYLEN);	// may be keys(s) itself
+    workNode->items(s) = run.item(m);
+    memcpy(workNode->keys(s), moreKey, KEYLEN);
+  }
+  delete tempNode;
+  delete right;
+  delete left;
+}
+
 #ifndef RW_GLOBAL_ENUMS
 RWBTreeOnDisk::retStatus
 #else
@@ -1154,6 +3150,7 @@ RWBTreeOnDisk::rem(const char* key, RWoffset start, RWCString& retK, RWstoredVal
   readcache(workOffset,workNode);
   int k = workNode->binarySearch(key, compareKeys);
   retStatus retval;
+  RWBoolean swapped = FALSE;
   // test to see if key is in this node
   if(   k < workNode->counter()
      && (*compareKeys)(key,workNode->keys(k),KEYLEN) == 0)
@@ -1162,6 +3159,7 @@ RWBTreeOnDisk::rem(const char* key, RWoffset start, RWCString& retK, RWstoredVal
     {
       // k++ so that on recursion our parent will cope correctly.
       swapWithSuccessor(k++);
+      swapped = TRUE;
       retval = rem(key, workNode->sons(k), retK, val);
     }
     else // this is a leaf: remove the item here and now
@@ -1182,6 +3180,8 @@ RWBTreeOnDisk::rem(const char* key, RWoffset start, RWCString& retK, RWstoredVal
       }
       workNode->sons(n)=workNode->sons(n+1);
       (workNode->counter())--;
+      if(packedKeys())
+	return settle(FALSE);
       writecache(workOffset,workNode);
       // return now so that parent node can clean up if needed.
       if(workOffset == baseInfo.rootLoc)
@@ -1200,6 +3200,20 @@ RWBTreeOnDisk::rem(const char* key, RWoffset start, RWCString& retK, RWstoredVal
   /******
    * If we are here, retval has been set during a recursion
    ******/
+  if(packedKeys())
+  {
+    // A swapped in key may have made this node too big, even if
+    // nothing else has changed it.
+    if(ignored == retval || (success == retval && !swapped))
+      return retval;
+    workOffset = start;
+    readcache(workOffset,workNode);
+    if(more == retval)
+      rebalance(k);
+    else if(split == retval)
+      workNode->insert(moreKey,moreItem,k,moreOffset);
+    return settle(success == retval);
+  }
   if(retval != more)
     return retval;
   else
@@ -1304,6 +3318,35 @@ RWBTreeOnDisk::restoreNode(int whichSon)
   } // end of (not an extremum of the node)
 }
 
+/*
+ * workNode, a packed node, has been changed: write it back, splitting
+ * it if it has grown past packLimit, and tell the parent what to do.
+ * On the way here a node may have gained up to four keys' worth of
+ * bytes over the limit (a key swapped in from below, and a changed
+ * key or a new one from the son that was changed), which the page
+ * leaves room for.  Below a quarter of the limit it wants restoring.
+ * Written means workNode is already on disk as it stands.
+ */
+#ifndef RW_GLOBAL_ENUMS
+RWBTreeOnDisk::retStatus
+#else
+retStatus
+#endif
+RWBTreeOnDisk::settle(RWBoolean written)
+{
+  unsigned size = workNode->packedSize();
+  if(size > packLimit)
+  {
+    splitPacked();
+    return split;
+  }
+  if(!written)
+    writecache(workOffset,workNode);
+  if(workOffset == baseInfo.rootLoc)
+    return (workNode->counter() > 0) ? success : more;
+  return (size < packLimit / 4) ? more : success;
+}
+
 /*
  * split workNode in two, pass back a set of key,val,*right*son 
  * (via moreXXX) for insertion in parent node.
@@ -1315,6 +3358,7 @@ RWBTreeOnDisk::splitNode(int loc)
   RWstoredValue tempItem;
   RWoffset tempOffset;
   RWDiskTreeNode *tempNode = new RWDiskTreeNode(nodeRefSize,this);
+  stats->splits++;
 #ifdef RDEBUG
   cout << "splitNode(" << loc<< ")" << endl;
   workNode->showOff(workOffset);
@@ -1367,7 +3411,7 @@ RWBTreeOnDisk::splitNode(int loc)
   }
   // all is copied over, and moreXX has data. Save it, and 
   // get ready to un-recurse.
-  moreOffset = fmgr->allocate(nodeRefSize);
+  moreOffset = allocNode();
 #ifdef RDEBUG
   cout << "(old), new nodes are:" << endl;
   workNode->showOff(workOffset);
@@ -1379,6 +3423,28 @@ RWBTreeOnDisk::splitNode(int loc)
   delete[] tempKey;
 }
 
+/*
+ * Packed counterpart of splitNode(): workNode, already holding the new
+ * key, is too big.  Split it where the bytes balance.
+ */
+void
+RWBTreeOnDisk::splitPacked()
+{
+  RWDiskTreeNode *tempNode = new RWDiskTreeNode(nodeRefSize,this);
+  stats->splits++;
+  RWDiskTreeRun run(workNode);
+  unsigned whole;
+  int m = run.middle(whole);
+  run.copy(tempNode, m+1, run.entries());
+  memcpy(moreKey,workNode->keys(m),KEYLEN);
+  moreItem = workNode->items(m);
+  workNode->counter() = m;
+  moreOffset = allocNode();
+  writecache(moreOffset,tempNode);
+  delete tempNode;
+  writecache(workOffset,workNode);
+}
+
 /*
  * workNode[k]'s data is put into it's successor's location on the tree.
  * the successor's data is put into workNode[k]. Otherwise, everything
@@ -1456,3 +3522,423 @@ RWBTreeOnDisk::tp(RWoffset o)
   delete[] keepOffs;
 }
 #endif
+
+/****************************************************************
+ *								*
+ *		Methods for Class RWBTreeOnDiskCursor		*
+ *								*
+ ****************************************************************/
+
+/*
+ * Position is kept as a path: off_[l] is the node at level l (the root
+ * is level 0) and, above depth_, idx_[l] is the child taken from it.
+ * At depth_, idx_[depth_] is the index of the current key.
+ */
+
+RWBTreeOnDiskCursor::RWBTreeOnDiskCursor(RWBTreeOnDisk& t) :
+  tree_(&t),
+  keylen_(t.baseInfo.keylen),
+  depth_(-1),
+  fresh_(TRUE),
+  levels_(0),
+  off_(rwnil),
+  idx_(rwnil),
+  node_(rwnil),
+  view_(rwnil),
+  copy_(rwnil),
+  pinned_(rwnil),
+  lo_(rwnil),
+  hi_(rwnil)
+{
+  grow();
+}
+
+RWBTreeOnDiskCursor::~RWBTreeOnDiskCursor()
+{
+  for(register int l = 0; l < levels_; l++)
+  {
+    release(l);
+    delete view_[l];
+    delete copy_[l];
+  }
+  RWVECTOR_DELETE(levels_) off_;
+  RWVECTOR_DELETE(levels_) idx_;
+  RWVECTOR_DELETE(levels_) node_;
+  RWVECTOR_DELETE(levels_) view_;
+  RWVECTOR_DELETE(levels_) copy_;
+  RWVECTOR_DELETE(levels_) pinned_;
+  RWVECTOR_DELETE(keylen_) lo_;
+  RWVECTOR_DELETE(keylen_) hi_;
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::operator()()
+{
+  return fresh_ ? first() : next();
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::first()
+{
+  fresh_ = FALSE;
+  if(lo_) return seek(lo_);
+  depth_ = -1;
+  if(tree_->isEmpty()) return FALSE;
+  toLeftmost(0, tree_->baseInfo.rootLoc);
+  return inRange();
+}
+
+RWCString
+RWBTreeOnDiskCursor::key() const
+{
+  RWPRECONDITION(isValid());
+  unsigned klen = tree_->baseInfo.keylen;
+  const char* pkey = node_[depth_]->keys(idx_[depth_]);
+  if(tree_->ignoreNulls())
+    return RWCString(pkey, klen);
+  return RWCString(pkey, rwmin(klen, (unsigned)strlen(pkey)));
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::last()
+{
+  fresh_ = FALSE;
+  if(hi_) return seekBefore(hi_);
+  depth_ = -1;
+  if(tree_->isEmpty()) return FALSE;
+  toRightmost(0, tree_->baseInfo.rootLoc);
+  return inRange();
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::next()
+{
+  if(depth_ < 0) return FALSE;
+  int l = depth_;
+  RWDiskTreeNode* n = node_[l];
+  int i = idx_[l];
+  if(n->sons(i+1) != RWNIL)		// smallest key of the right subtree
+  {
+    idx_[l] = i+1;
+    toLeftmost(l+1, n->sons(i+1));
+  }
+  else if(i+1 < (int)n->counter())
+    idx_[l]++;
+  else if(!upForward(l))
+    return FALSE;
+  return inRange();
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::prev()
+{
+  if(depth_ < 0) return FALSE;
+  int l = depth_;
+  RWDiskTreeNode* n = node_[l];
+  int i = idx_[l];
+  if(n->sons(i) != RWNIL)		// largest key of the left subtree
+    toRightmost(l+1, n->sons(i));
+  else if(i > 0)
+    idx_[l]--;
+  else if(!upBackward(l))
+    return FALSE;
+  return inRange();
+}
+
+// Unpins the path as well, giving the cache back its slots.
+void
+RWBTreeOnDiskCursor::reset()
+{
+  for(register int l = 0; l < levels_; l++)
+    release(l);
+  depth_ = -1;
+  fresh_ = TRUE;
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::seek(const char* key)
+{
+  fresh_ = FALSE;
+  depth_ = -1;
+  if(tree_->isEmpty()) return FALSE;
+  unsigned klen = tree_->baseInfo.keylen;
+  RWdiskTreeCompare cmp = tree_->compareKeys;
+  if(lo_ && (*cmp)(key, lo_, klen) < 0)
+    key = lo_;
+
+  RWoffset off = tree_->baseInfo.rootLoc;
+  for(int l = 0; ; l++)
+  {
+    load(l, off);
+    RWDiskTreeNode* n = node_[l];
+    int i = n->binarySearch(key, cmp);
+    if(i < (int)n->counter() && (*cmp)(key, n->keys(i), klen) == 0)
+    {
+      idx_[l] = i;
+      depth_ = l;
+      break;
+    }
+    if(n->sons(i) == RWNIL)		// leaf: key lies just before i
+    {
+      if(i < (int)n->counter())
+      {
+	idx_[l] = i;
+	depth_ = l;
+      }
+      else if(!upForward(l))
+	return FALSE;
+      break;
+    }
+    idx_[l] = i;
+    off = n->sons(i);
+  }
+  return inRange();
+}
+
+/*
+ * The keys starting with prefix are those in [prefix, p), where p is
+ * prefix with its last byte that is not 0xff incremented, and what
+ * follows dropped.  That assumes the default byte by byte comparison.
+ */
+void
+RWBTreeOnDiskCursor::setPrefix(const char* prefix, size_t len)
+{
+  unsigned klen = tree_->baseInfo.keylen;
+  if(len > klen) len = klen;
+  char* lo = new char[klen];
+  char* hi = new char[klen];
+  memset(lo, 0, klen);
+  memcpy(lo, prefix, len);
+  memcpy(hi, lo, klen);
+  int j = (int)len - 1;
+  while(j >= 0 && (unsigned char)hi[j] == 0xff)
+    hi[j--] = 0;
+  if(j >= 0)
+    hi[j]++;
+  setRange(lo, j >= 0 ? hi : rwnil);
+  RWVECTOR_DELETE(klen) lo;
+  RWVECTOR_DELETE(klen) hi;
+}
+
+void
+RWBTreeOnDiskCursor::setRange(const char* lo, const char* hi)
+{
+  unsigned klen = keylen_;
+  RWVECTOR_DELETE(klen) lo_;
+  RWVECTOR_DELETE(klen) hi_;
+  lo_ = hi_ = rwnil;
+  if(lo)
+  {
+    lo_ = new char[klen];
+    if(tree_->ignoreNulls())
+      memcpy(lo_, lo, klen);
+    else
+      strncpy(lo_, lo, klen);
+  }
+  if(hi)
+  {
+    hi_ = new char[klen];
+    if(tree_->ignoreNulls())
+      memcpy(hi_, hi, klen);
+    else
+      strncpy(hi_, hi, klen);
+  }
+  depth_ = -1;
+  fresh_ = TRUE;
+}
+
+RWstoredValue
+RWBTreeOnDiskCursor::value() const
+{
+  RWPRECONDITION(isValid());
+  return node_[depth_]->items(idx_[depth_]);
+}
+
+/********************* private functions **********************/
+
+void
+RWBTreeOnDiskCursor::grow()
+{
+  int n = levels_ ? 2*levels_ : 8;
+  RWoffset*        off    = new RWoffset[n];
+  int*             idx    = new int[n];
+  RWDiskTreeNode** node   = new RWDiskTreeNode*[n];
+  RWDiskTreeNode** view   = new RWDiskTreeNode*[n];
+  RWDiskTreeNode** copy   = new RWDiskTreeNode*[n];
+  RWBoolean*       pinned = new RWBoolean[n];
+  register int l;
+  for(l = 0; l < levels_; l++)
+  {
+    off[l]    = off_[l];
+    idx[l]    = idx_[l];
+    node[l]   = node_[l];
+    view[l]   = view_[l];
+    copy[l]   = copy_[l];
+    pinned[l] = pinned_[l];
+  }
+  for(; l < n; l++)
+  {
+    off[l]    = RWNIL;
+    node[l]   = rwnil;
+    view[l]   = new RWDiskTreeNode(tree_);
+    copy[l]   = rwnil;
+    pinned[l] = FALSE;
+  }
+  RWVECTOR_DELETE(levels_) off_;
+  RWVECTOR_DELETE(levels_) idx_;
+  RWVECTOR_DELETE(levels_) node_;
+  RWVECTOR_DELETE(levels_) view_;
+  RWVECTOR_DELETE(levels_) copy_;
+  RWVECTOR_DELETE(levels_) pinned_;
+  off_ = off; idx_ = idx; node_ = node;
+  view_ = view; copy_ = copy; pinned_ = pinned;
+  levels_ = n;
+}
+
+// Invalidate the cursor if it has moved outside [lo_, hi_).
+RWBoolean
+RWBTreeOnDiskCursor::inRange()
+{
+  if(depth_ < 0) return FALSE;
+  unsigned klen = tree_->baseInfo.keylen;
+  const char* k = node_[depth_]->keys(idx_[depth_]);
+  if( (lo_ && (*tree_->compareKeys)(k, lo_, klen) < 0) ||
+       (hi_ && (*tree_->compareKeys)(k, hi_, klen) >= 0) )
+  {
+    depth_ = -1;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Make the node at off the one at this level.  It is looked at in
+ * place in a pinned cache slot if possible, otherwise copied.  A node
+ * already pinned there is current: writes go through to the slot.
+ */
+void
+RWBTreeOnDiskCursor::load(int l, RWoffset off)
+{
+  if(l == levels_) grow();
+  if(pinned_[l] && off_[l] == off) return;
+  release(l);
+  off_[l] = off;
+  // Packed nodes can't be looked at in place
+  const char* p = tree_->packedKeys() ? rwnil : tree_->cmgr->pin(off);
+  if(p != rwnil && ((unsigned long)p % sizeof(RWoffset)) == 0)
+  {
+    view_[l]->nodeRef = (void*)p;
+    node_[l] = view_[l];
+    pinned_[l] = TRUE;
+    return;
+  }
+  if(p != rwnil) tree_->cmgr->unpin(off);
+  if(copy_[l] == rwnil)
+    copy_[l] = new RWDiskTreeNode(tree_->nodeRefSize, tree_);
+  tree_->readcache(off, copy_[l]);
+  node_[l] = copy_[l];
+}
+
+void
+RWBTreeOnDiskCursor::release(int l)
+{
+  if(pinned_[l]) tree_->cmgr->unpin(off_[l]);
+  pinned_[l] = FALSE;
+  off_[l] = RWNIL;
+  node_[l] = rwnil;
+}
+
+// Largest key < key; used by last() when there is an upper bound.
+RWBoolean
+RWBTreeOnDiskCursor::seekBefore(const char* key)
+{
+  depth_ = -1;
+  if(tree_->isEmpty()) return FALSE;
+  RWoffset off = tree_->baseInfo.rootLoc;
+  for(int l = 0; ; l++)
+  {
+    load(l, off);
+    RWDiskTreeNode* n = node_[l];
+    int i = n->binarySearch(key, tree_->compareKeys);
+    if(n->sons(i) == RWNIL)		// leaf: keys(i-1) < key <= keys(i)
+    {
+      if(i > 0)
+      {
+	idx_[l] = i-1;
+	depth_ = l;
+      }
+      else if(!upBackward(l))
+	return FALSE;
+      break;
+    }
+    idx_[l] = i;
+    off = n->sons(i);
+  }
+  return inRange();
+}
+
+void
+RWBTreeOnDiskCursor::toLeftmost(int l, RWoffset off)
+{
+  for(;;)
+  {
+    load(l, off);
+    idx_[l] = 0;
+    if((off = node_[l]->sons(0)) == RWNIL) break;
+    l++;
+  }
+  depth_ = l;
+}
+
+void
+RWBTreeOnDiskCursor::toRightmost(int l, RWoffset off)
+{
+  for(;;)
+  {
+    load(l, off);
+    int c = node_[l]->counter();
+    if((off = node_[l]->sons(c)) == RWNIL)
+    {
+      idx_[l] = c-1;
+      break;
+    }
+    idx_[l] = c;
+    l++;
+  }
+  depth_ = l;
+}
+
+/*
+ * Climb from the end of a subtree at level l to the nearest ancestor
+ * key after (upForward) or before (upBackward) it.
+ */
+RWBoolean
+RWBTreeOnDiskCursor::upForward(int l)
+{
+  while(l-- > 0)
+  {
+    if(idx_[l] < (int)node_[l]->counter())
+    {
+      depth_ = l;
+      return TRUE;
+    }
+  }
+  depth_ = -1;
+  return FALSE;
+}
+
+RWBoolean
+RWBTreeOnDiskCursor::upBackward(int l)
+{
+  while(l-- > 0)
+  {
+    if(idx_[l] > 0)
+    {
+      idx_[l]--;
+      depth_ = l;
+      return TRUE;
+    }
+  }
+  depth_ = -1;
+  return FALSE;
+}
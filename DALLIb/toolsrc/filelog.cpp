@@ -0,0 +1,579 @@
+/*
+ * RWFileLog: write-ahead log for an RWFile.  See rw/filelog.h.
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+#include "rw/filelog.h"
+#include "rw/rwfile.h"
+#include "rw/rwerr.h"
+#include "rw/toolerr.h"
+STARTWRAP
+#include <stdio.h>
+#include <string.h>
+#ifdef unix
+#  include <unistd.h>		/* Looking for fsync() */
+#endif
+ENDWRAP
+
+RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile$ $Revision$ $Date$");
+
+#ifndef RW_NO_CPP_RECURSION
+# define new rwnew
+#endif
+
+/*
+ * The log file is a magic number followed by records.  A record is a
+ * header and, unless it is a commit record, the bytes written at its
+ * offset.  The length field of a commit record holds the checksum of
+ * all the records since the previous commit.
+ */
+struct RWFileLogRecord
+{
+  RWoffset		offset;
+  unsigned long		length;
+};
+
+static const long	logMagic   = 0x52574c47L;	// "RWLG"
+static const RWoffset	commitMark = -2L;
+static const long	headerSize = sizeof(long);
+static const unsigned long defaultCheckpoint = 1048576L;
+
+// Adler-32, carried on from s (start with 1).
+static unsigned long
+rwLogSum(unsigned long s, const void* p, size_t n)
+{
+  const unsigned char* c = (const unsigned char*)p;
+  unsigned long a = s & 0xffff;
+  unsigned long b = (s >> 16) & 0xffff;
+  while (n)
+  {
+    // 5552 bytes is as many as can be summed without overflow:
+    size_t k = n < 5552 ? n : 5552;
+    n -= k;
+    while (k--)
+    {
+      a += *c++;
+      b += a;
+    }
+    a %= 65521L;
+    b %= 65521L;
+  }
+  return (b << 16) | a;
+}
+
+RWFileLog::RWFileLog(RWFile* file, const char* logName)
+ : file_(file),
+   logp_(rwnil),
+   pos_(0),
+   size_(0),
+   fileSize_(0),
+   nbuckets_(64),
+   hashNext_(rwnil),
+   pageNos_(rwnil),
+   pages_(rwnil),
+   npages_(0),
+   maxpages_(0),
+   buf_(rwnil),
+   buflen_(0),
+   bufmax_(0),
+   sum_(1),
+   logSize_(headerSize),
+   ckptSize_(defaultCheckpoint),
+   appended_(0),
+   synced_(0),
+   commits_(0),
+   syncs_(0)
+{
+  name_ = new char[strlen(logName)+1];
+  strcpy(name_, logName);
+  buckets_ = new size_t[nbuckets_];
+  for (register unsigned i=0; i<nbuckets_; i++) buckets_[i] = RW_NPOS;
+
+  FILE* fp = file_->filep;
+  if (fflush(fp) == EOF) return;
+  pos_ = ftell(fp);
+  if (fseek(fp, 0, 2) < 0) return;
+  size_ = fileSize_ = ftell(fp);
+
+  logp_ = fopen(name_, "rb+");
+  if (logp_ == rwnil) logp_ = fopen(name_, "wb+");
+  if (logp_ == rwnil) return;
+
+  // Replay whatever was committed before we last stopped:
+  long good = recover();
+  if (good < 0 || (good > headerSize && !applyLog(good)) || !emptyLog())
+  {
+    fclose(logp_);
+    logp_ = rwnil;
+  }
+}
+
+/*
+ * Commits anything outstanding and writes it back, leaving nothing in
+ * the log, which is then removed.
+ */
+RWFileLog::~RWFileLog()
+{
+  if (logp_)
+  {
+    if (checkpoint())
+    {
+      fclose(logp_);
+      remove(name_);
+    }
+    else
+      fclose(logp_);
+    fseek(file_->filep, pos_, 0);
+  }
+  for (register size_t i=0; i<npages_; i++)
+    RWVECTOR_DELETE(pageSize) pages_[i];
+  RWVECTOR_DELETE(maxpages_) pages_;
+  RWVECTOR_DELETE(maxpages_) pageNos_;
+  RWVECTOR_DELETE(maxpages_) hashNext_;
+  RWVECTOR_DELETE(nbuckets_) buckets_;
+  RWVECTOR_DELETE(bufmax_) buf_;
+  RWVECTOR_DELETE(strlen(name_)+1) name_;
+}
+
+RWBoolean
+RWFileLog::checkpoint()
+{
+  if (!commit(TRUE)) return FALSE;
+#ifdef RW_MULTI_THREAD
+  RWGuard sguard(syncLock_);
+  RWGuard guard(lock_);
+#endif
+  // Anything written since the commit must not reach the file yet:
+  if (buflen_ || synced_ != appended_) return TRUE;
+  return writeBack();
+}
+
+unsigned long
+RWFileLog::checkpointSize(unsigned long n)
+{
+  unsigned long ret = ckptSize_;
+  ckptSize_ = n;
+  return ret;
+}
+
+/*
+ * Make everything written so far one atomic change to the file.  If
+ * sync is TRUE, also wait until it is durable.  With sync FALSE the
+ * change is still atomic but may be lost, together with those after
+ * it, in a crash before the next synchronous commit.
+ */
+RWBoolean
+RWFileLog::commit(RWBoolean sync)
+{
+  unsigned long mine;
+  {
+    RWGUARD(lock_);
+    if (logp_ == rwnil) return FALSE;
+    if (buflen_)
+    {
+      RWFileLogRecord c;
+      c.offset = commitMark;
+      c.length = sum_;
+      append(&c, sizeof(c));
+      if (fwrite(buf_, 1, buflen_, logp_) != buflen_) return FALSE;
+      logSize_ += (long)buflen_;
+      buflen_ = 0;
+      sum_    = 1;
+      appended_++;
+      commits_++;
+    }
+    mine = appended_;
+  }
+  return sync ? syncTo(mine) : TRUE;
+}
+
+// Wait until every commit made so far is durable.
+RWBoolean
+RWFileLog::sync()
+{
+  unsigned long mine;
+  {
+    RWGUARD(lock_);
+    if (logp_ == rwnil) return FALSE;
+    mine = appended_;
+  }
+  return syncTo(mine);
+}
+
+/*
+ * Read n bytes at the current offset and move past them.  The offset
+ * belongs to the stream functions of the RWFile, which the caller
+ * serializes.
+ */
+size_t
+RWFileLog::read(void* p, size_t n)
+{
+  n = read(pos_, p, n);
+  pos_ += (long)n;
+  return n;
+}
+
+/*
+ * Read n bytes at offset off, from the page images where there are
+ * any and from the file elsewhere.
+ */
+size_t
+RWFileLog::read(long off, void* p, size_t n)
+{
+  RWGUARD(lock_);
+  if (off < 0 || off >= size_) return 0;
+  if ((long)n > size_ - off) n = (size_t)(size_ - off);
+  char* c = (char*)p;
+  size_t left = n;
+  while (left)
+  {
+    long   pno = off / pageSize;
+    size_t in  = (size_t)(off % pageSize);
+    size_t k   = pageSize - in;
+    if (k > left) k = left;
+    size_t i = buckets_[(size_t)pno & (nbuckets_-1)];
+    while (i != RW_NPOS && pageNos_[i] != pno) i = hashNext_[i];
+    if (i != RW_NPOS)
+      memcpy(c, pages_[i] + in, k);
+    else
+    {
+      // Past the end of the file itself reads as zeros, as it would
+      // had the bytes beyond been written through stdio:
+      size_t f = off >= fileSize_ ? 0 : (size_t)(fileSize_ - off);
+      if (f > k) f = k;
+      if (f && file_->directRead(off, c, f) != f)
+	return n - left;
+      if (f < k) memset(c + f, 0, k - f);
+    }
+    off  += (long)k;
+    c    += k;
+    left -= k;
+  }
+  return n;
+}
+
+size_t
+RWFileLog::write(const void* p, size_t n)
+{
+  n = write(pos_, p, n);
+  pos_ += (long)n;
+  return n;
+}
+
+size_t
+RWFileLog::write(long off, const void* p, size_t n)
+{
+  RWGUARD(lock_);
+  if (logp_ == rwnil || off < 0) return 0;
+  RWFileLogRecord r;
+  r.offset = off;
+  r.length = n;
+  append(&r, sizeof(r));
+  append(p, n);
+
+  const char* c = (const char*)p;
+  size_t left = n;
+  while (left)
+  {
+    size_t in = (size_t)(off % pageSize);
+    size_t k  = pageSize - in;
+    if (k > left) k = left;
+    char* pg = page(off / pageSize);
+    memcpy(pg + in, c, k);
+    off  += (long)k;
+    c    += k;
+    left -= k;
+  }
+  if (off > size_) size_ = off;
+  return n;
+}
+
+/****************************************************************
+ *								*
+ *			Private functions			*
+ *								*
+ ****************************************************************/
+
+// Add bytes to the records awaiting commit.
+void
+RWFileLog::append(const void* p, size_t n)
+{
+  if (buflen_ + n > bufmax_)
+  {
+    size_t newmax = bufmax_ ? 2*bufmax_ : 4096;
+    while (newmax < buflen_ + n) newmax *= 2;
+    char* newbuf = new char[newmax];
+    if (buflen_) memcpy(newbuf, buf_, buflen_);
+    RWVECTOR_DELETE(bufmax_) buf_;
+    buf_    = newbuf;
+    bufmax_ = newmax;
+  }
+  memcpy(buf_ + buflen_, p, n);
+  buflen_ += n;
+  sum_ = rwLogSum(sum_, p, n);
+}
+
+// Apply the records in the log before offset upto to the file.
+RWBoolean
+RWFileLog::applyLog(long upto)
+{
+  char  tmp[pageSize];
+  long  at = headerSize;
+  if (fseek(logp_, at, 0) < 0) return FALSE;
+  while (at < upto)
+  {
+    RWFileLogRecord r;
+    if (fread((char*)&r, sizeof(r), 1, logp_) != 1) return FALSE;
+    at += sizeof(r);
+    if (r.offset == commitMark) continue;
+    long to = r.offset;
+    unsigned long left = r.length;
+    while (left)
+    {
+      size_t k = left < pageSize ? (size_t)left : (size_t)pageSize;
+      if (fread(tmp, 1, k, logp_) != k) return FALSE;
+      if (file_->directWrite(to, tmp, k) != k) return FALSE;
+      to   += (long)k;
+      left -= k;
+    }
+    at += (long)r.length;
+    if (r.offset + (long)r.length > size_) size_ = r.offset + (long)r.length;
+  }
+  fileSize_ = size_;
+  return syncData();
+}
+
+// Cut the log back to just its header, durably.
+RWBoolean
+RWFileLog::emptyLog()
+{
+  if (freopen(name_, "wb+", logp_) == rwnil)
+  {
+    logp_ = rwnil;
+    return FALSE;
+  }
+  long magic = logMagic;
+  if (fwrite((char*)&magic, sizeof(magic), 1, logp_) != 1) return FALSE;
+  if (fflush(logp_) == EOF || !syncLog()) return FALSE;
+  logSize_ = headerSize;
+  return TRUE;
+}
+
+// The image of page pageNo, made from the file if not already there.
+char*
+RWFileLog::page(long pageNo)
+{
+  size_t i = buckets_[(size_t)pageNo & (nbuckets_-1)];
+  while (i != RW_NPOS && pageNos_[i] != pageNo) i = hashNext_[i];
+  if (i != RW_NPOS) return pages_[i];
+
+  if (npages_ == maxpages_)
+  {
+    size_t newmax = maxpages_ ? 2*maxpages_ : 64;
+    long*   newNos   = new long[newmax];
+    char**  newPages = new char*[newmax];
+    size_t* newNext  = new size_t[newmax];
+    for (register size_t j=0; j<npages_; j++)
+    {
+      newNos[j]   = pageNos_[j];
+      newPages[j] = pages_[j];
+    }
+    RWVECTOR_DELETE(maxpages_) pageNos_;
+    RWVECTOR_DELETE(maxpages_) pages_;
+    RWVECTOR_DELETE(maxpages_) hashNext_;
+    pageNos_  = newNos;
+    pages_    = newPages;
+    hashNext_ = newNext;
+    maxpages_ = newmax;
+
+    // Keep the load factor under 1:
+    if (maxpages_ > nbuckets_)
+    {
+      RWVECTOR_DELETE(nbuckets_) buckets_;
+      while (nbuckets_ < maxpages_) nbuckets_ <<= 1;
+      buckets_ = new size_t[nbuckets_];
+    }
+    register size_t b;
+    for (b=0; b<nbuckets_; b++) buckets_[b] = RW_NPOS;
+    for (b=0; b<npages_; b++)
+    {
+      size_t& h = buckets_[(size_t)pageNos_[b] & (nbuckets_-1)];
+      hashNext_[b] = h;
+      h = b;
+    }
+  }
+
+  char* pg = new char[pageSize];
+  long  off = pageNo * pageSize;
+  size_t got = 0;
+  if (off < fileSize_)
+    got = file_->directRead(off, pg, pageSize);
+  if (got < pageSize) memset(pg + got, 0, pageSize - got);
+
+  i = npages_++;
+  pageNos_[i] = pageNo;
+  pages_[i]   = pg;
+  size_t& h = buckets_[(size_t)pageNo & (nbuckets_-1)];
+  hashNext_[i] = h;
+  h = i;
+  return pg;
+}
+
+/*
+ * Scan the log.  Returns the offset just past the last commit record
+ * whose checksum is good (the header size if there is none), or -1 if
+ * the log cannot be read.
+ */
+long
+RWFileLog::recover()
+{
+  long magic;
+  if (fseek(logp_, 0, 0) < 0) return -1;
+  if (fread((char*)&magic, sizeof(magic), 1, logp_) != 1)
+    return headerSize;			// New, or never got its header
+  if (magic != logMagic)
+    RWTHROW(RWExternalErr(RWMessage(RWTOOL_MAGIC, magic, logMagic)));
+
+  char tmp[pageSize];
+  long at   = headerSize;
+  long good = at;
+  unsigned long sum = 1;
+  RWFileLogRecord r;
+  while (fread((char*)&r, sizeof(r), 1, logp_) == 1)
+  {
+    if (r.offset == commitMark)
+    {
+      if (r.length != sum) break;	// Torn
+      at  += sizeof(r);
+      good = at;
+      sum  = 1;
+      continue;
+    }
+    if (r.offset < 0) break;
+    sum = rwLogSum(sum, &r, sizeof(r));
+    unsigned long left = r.length;
+    while (left)
+    {
+      size_t k = left < pageSize ? (size_t)left : (size_t)pageSize;
+      if (fread(tmp, 1, k, logp_) != k) return good;
+      sum = rwLogSum(sum, tmp, k);
+      left -= k;
+    }
+    at += sizeof(r) + (long)r.length;
+  }
+  return good;
+}
+
+RWBoolean
+RWFileLog::syncData()
+{
+  if (fflush(file_->filep) == EOF) return FALSE;
+#ifdef unix
+  if (fsync(fileno(file_->filep)) < 0) return FALSE;
+#endif
+  return TRUE;
+}
+
+RWBoolean
+RWFileLog::syncLog()
+{
+#ifdef unix
+  if (fsync(fileno(logp_)) < 0) return FALSE;
+#endif
+  return TRUE;
+}
+
+/*
+ * Wait until the first "mine" commits are durable.  Only one thread
+ * at a time syncs; one that waited for it may find itself covered.
+ */
+RWBoolean
+RWFileLog::syncTo(unsigned long mine)
+{
+  RWGUARD(syncLock_);
+  if (synced_ >= mine) return TRUE;	// Someone else's sync covered us
+  unsigned long target;
+  {
+    RWGUARD(lock_);
+    if (fflush(logp_) == EOF) return FALSE;
+    target = appended_;
+  }
+  if (!syncLog()) return FALSE;
+  syncs_++;
+  synced_ = target;
+
+  // Lazy checkpoint, when nobody has written since:
+  if ((unsigned long)logSize_ > ckptSize_)
+  {
+    RWGUARD(lock_);
+    if (buflen_ == 0 && synced_ == appended_)
+      return writeBack();
+  }
+  return TRUE;
+}
+
+/*
+ * Write the page images back to the file, make it durable, then empty
+ * the log.  Called with nothing uncommitted.
+ */
+RWBoolean
+RWFileLog::writeBack()
+{
+  register size_t i;
+  for (i=0; i<npages_; i++)
+  {
+    long off = pageNos_[i] * pageSize;
+    long n   = size_ - off;
+    if (n <= 0) continue;
+    if (n > pageSize) n = pageSize;
+    if (file_->directWrite(off, pages_[i], (size_t)n) != (size_t)n)
+      return FALSE;
+  }
+  if (size_ > fileSize_) fileSize_ = size_;
+  if (!syncData() || !emptyLog()) return FALSE;
+
+  for (i=0; i<npages_; i++)
+    RWVECTOR_DELETE(pageSize) pages_[i];
+  npages_ = 0;
+  for (i=0; i<nbuckets_; i++) buckets_[i] = RW_NPOS;
+  return TRUE;
+}
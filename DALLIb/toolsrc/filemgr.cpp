@@ -108,9 +108,13 @@
  */
 
 #include "rw/filemgr.h"
+#include "rw/filelog.h"
 #include "rw/rwerr.h"
 #include "rw/toolerr.h"
+STARTWRAP
 #include <assert.h>
+#include <string.h>
+ENDWRAP
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: filemgr.cpp,v $ $Revision: 6.6 $ $Date: 1994/07/18 20:51:00 $");
 
@@ -466,6 +470,8 @@ public:
 
   virtual RWoffset	allocate(RWspace)    = 0;
   virtual void          deallocate(RWoffset) = 0;
+  virtual RWoffset	allocateBelow(RWspace, RWoffset) {return RWNIL;}
+  virtual void		moveDown() {;}	// Free list toward the front
 #ifdef RDEBUG
   virtual RWoffset      walkFreeList(RWoffset&, int&, RWspace&) = 0;
   virtual void          summarize() = 0;
@@ -1112,69 +1118,689 @@ RWNewListManager::summarize()
 
 //////////////////////////////////////////////////////////////////////////
 //                                                                      //
-//                      RWFileManager definitions                       //
+//                             RWExtentNode                             //
 //                                                                      //
 //////////////////////////////////////////////////////////////////////////
 
 /*
- * Definitions for RWFileManager mostly consists of a bunch of forwarding
- * functions to the abstract base class RWListManager.
- *
+ * The third free list format.  On disk it is a chain of nodes, each
+ * an array of free extents in no particular order; an empty entry has
+ * size zero.  Nodes are never given back.  The manager keeps the lot
+ * in memory, indexed, and only ever writes single entries: it never
+ * reads the free list again after the file is opened.
  */
 
-RWFileManager::RWFileManager(const char* fname, const char* mode)
- : RWFile(fname, mode),
-   filemgr_(rwnil),
-   startOfData_(RWNIL),
-   endOfData_(RWNIL)
+const int extentNodeOrder = 62;         // Number of extents in a node
+const unsigned short extentMagicNumber = 0x1236;
+
+struct RWExtent
 {
-  if( isValid() && Exists() )
+  RWoffset		offset_;
+  RWspace		size_;		// Zero if the entry is unused
+};
+
+struct RWExtentNode
+{
+  unsigned short	magicNumber_;
+  RWoffset		next_;		// Next node, or RWNIL
+  RWExtent		extents_[extentNodeOrder];
+
+  void			initialize(RWoffset);
+};
+
+void
+RWExtentNode::initialize(RWoffset next)
+{
+  magicNumber_ = extentMagicNumber;
+  next_        = next;
+  for (register int i=0; i<extentNodeOrder; i++)
   {
-    // Is this file empty?
-    if( IsEmpty() )
+    extents_[i].offset_ = 0;
+    extents_[i].size_   = 0;
+  }
+}
+
+/*
+ * Open addressed hash table from a file offset to an extent slot, with
+ * deletion.  Used to find the free extents bordering on a given one.
+ */
+class RWExtentMap
+{
+
+public:
+
+  RWExtentMap();
+  ~RWExtentMap();
+
+  size_t		find(RWoffset) const;	// RW_NPOS if not there
+  void			insert(RWoffset, size_t);
+  void			remove(RWoffset);
+
+private:
+
+  size_t		home(RWoffset) const;
+  void			resize(size_t);
+
+  size_t		n_;		// Power of 2
+  size_t		used_;
+  RWoffset*		keys_;		// RWNIL if empty
+  size_t*		slots_;
+};
+
+RWExtentMap::RWExtentMap()
+ : n_(0), used_(0), keys_(rwnil), slots_(rwnil)
+{
+  resize(64);
+}
+
+RWExtentMap::~RWExtentMap()
+{
+  RWVECTOR_DELETE(n_) keys_;
+  RWVECTOR_DELETE(n_) slots_;
+}
+
+size_t
+RWExtentMap::find(RWoffset k) const
+{
+  size_t i = home(k);
+  while (keys_[i] != RWNIL)
+  {
+    if (keys_[i] == k) return slots_[i];
+    i = (i+1) & (n_-1);
+  }
+  return RW_NPOS;
+}
+
+void
+RWExtentMap::insert(RWoffset k, size_t slot)
+{
+  size_t i = home(k);
+  while (keys_[i] != RWNIL && keys_[i] != k)
+    i = (i+1) & (n_-1);
+  if (keys_[i] == RWNIL) used_++;
+  keys_[i]  = k;
+  slots_[i] = slot;
+  if (2*used_ > n_) resize(2*n_);
+}
+
+// Linear probing: close the gap by moving later entries back.
+void
+RWExtentMap::remove(RWoffset k)
+{
+  size_t i = home(k);
+  while (keys_[i] != k)
+  {
+    if (keys_[i] == RWNIL) return;
+    i = (i+1) & (n_-1);
+  }
+  size_t j = i;
+  for (;;)
+  {
+    j = (j+1) & (n_-1);
+    if (keys_[j] == RWNIL) break;
+    size_t h = home(keys_[j]);
+    // Can the entry at j move to i?  Only if its home is not in (i, j].
+    if ( (i <= j) ? (h <= i || h > j) : (h <= i && h > j) )
     {
-      // Virgin file; use the new style manager:
-      // (If mode is read-only - writeErr() will be called)
-      startOfData_    = RWNIL;
-      endOfData_      = rootOffset() + sizeof(RWNewNode);
-      size_t nodeSize = sizeof(RWNewNode);
-      if (!SeekToBegin()) seekErr();
-      if (!Write(startOfData_)  ||
-	  !Write(endOfData_)    ||
-	  !Write(nodeSize) ) writeErr();
-      filemgr_ = new RWNewListManager(this, TRUE);
+      keys_[i]  = keys_[j];
+      slots_[i] = slots_[j];
+      i = j;
     }
+  }
+  keys_[i] = RWNIL;
+  used_--;
+}
 
-    else
-    {
-      // File is not empty.
-      size_t nodeSize;
+size_t
+RWExtentMap::home(RWoffset k) const
+{
+  unsigned long h = (unsigned long)k;
+  h ^= h >> 15;
+  h *= 2654435761UL;
+  h ^= h >> 13;
+  return (size_t)(h & (n_-1));
+}
 
-      // Recover header information:
-      if (!SeekToBegin()) seekErr();
-      if (!Read(startOfData_)   ||
-	  !Read(endOfData_)     ||
-	  !Read(nodeSize) ) readErr();
+void
+RWExtentMap::resize(size_t n)
+{
+  RWoffset* oldKeys  = keys_;
+  size_t*   oldSlots = slots_;
+  size_t    oldN     = n_;
+  n_     = n;
+  used_  = 0;
+  keys_  = new RWoffset[n_];
+  slots_ = new size_t[n_];
+  register size_t i;
+  for (i=0; i<n_; i++) keys_[i] = RWNIL;
+  for (i=0; i<oldN; i++)
+    if (oldKeys[i] != RWNIL) insert(oldKeys[i], oldSlots[i]);
+  RWVECTOR_DELETE(oldN) oldKeys;
+  RWVECTOR_DELETE(oldN) oldSlots;
+}
 
-      // Use the node size to figure out if it is old style or
-      // new style nodes:
-      if (nodeSize == sizeof(RWNewNode))
-        filemgr_ = new RWNewListManager(this, FALSE);
-      else if (nodeSize == sizeof(RWOldNode))
-        filemgr_ = new RWOldListManager(this, FALSE);
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                         RWExtentListManager                          //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Free extents are kept on size segregated lists: list b holds those
+ * of at least 2^b bytes and less than 2^(b+1).  An allocation looks a
+ * little way down its own list for a fit, then takes the first extent
+ * on the next non-empty larger list, which is bound to fit.  A freed
+ * extent is merged with free neighbours on either side, found through
+ * the hash tables of extent starts and ends.  So neither allocation
+ * nor deallocation depends on the number of free extents, and nothing
+ * that could be coalesced ever stays apart.
+ */
+class RWExtentListManager : public RWListManager
+{
+
+public:
+
+  RWExtentListManager(RWFileManager*, RWBoolean);
+  virtual ~RWExtentListManager();
+  virtual RWoffset	allocate(RWspace);
+  virtual void          deallocate(RWoffset);
+  virtual RWoffset	allocateBelow(RWspace, RWoffset);
+  virtual void		moveDown();
+#ifdef RDEBUG
+  virtual RWoffset      walkFreeList(RWoffset&, int&, RWspace&);
+  virtual void          summarize();
+#endif
+
+private:
+
+  enum { nbins = 8*sizeof(RWspace), probes = 8 };
+
+  static RWspace	spaceFor(RWspace);
+  RWoffset		takeExtent(size_t, RWspace&);
+  void			addExtent(RWoffset, RWspace);
+  void			addNode();
+  RWspace		blockSize(RWoffset);
+  void			freeRemnant(RWoffset, RWspace);
+  static int		binOf(RWspace);
+  void			link(size_t);
+  void			newNode(RWoffset);
+  void			readNodes();
+  void			removeExtent(size_t);
+  void			resizeExtent(size_t, RWoffset, RWspace);
+  void			unlink(size_t);
+  void			writeSlot(size_t);
+
+  // Per node:
+  RWoffset*		nodeLocs_;
+  size_t		nnodes_;
+  size_t		maxnodes_;
+
+  // Per slot (extentNodeOrder per node):
+  RWoffset*		offsets_;
+  RWspace*		sizes_;
+  size_t*		prev_;		// Size list links
+  size_t*		next_;
+
+  size_t*		freeSlots_;	// Stack of unused slots
+  size_t		nfree_;
+  size_t		bins_[nbins];	// Head of each size list
+  RWExtentMap		starts_;	// Start offset -> slot
+  RWExtentMap		ends_;		// End offset   -> slot
+};
+
+RWExtentListManager::RWExtentListManager(RWFileManager* fm, RWBoolean newFile)
+ : RWListManager(fm),
+   nodeLocs_(rwnil), nnodes_(0), maxnodes_(0),
+   offsets_(rwnil), sizes_(rwnil), prev_(rwnil), next_(rwnil),
+   freeSlots_(rwnil), nfree_(0)
+{
+  for (register int b=0; b<nbins; b++) bins_[b] = RW_NPOS;
+  here_ = rootOffset();
+  if (newFile)
+  {
+    RWExtentNode node;
+    node.initialize(RWNIL);
+    if ( !filemgr_->SeekTo(here_)                          ) seekErr();
+    if ( !filemgr_->Write((const char*)&node, sizeof(node)) ) writeErr();
+  }
+  readNodes();
+}
+
+RWExtentListManager::~RWExtentListManager()
+{
+  RWVECTOR_DELETE(maxnodes_) nodeLocs_;
+  RWVECTOR_DELETE(maxnodes_ * extentNodeOrder) offsets_;
+  RWVECTOR_DELETE(maxnodes_ * extentNodeOrder) sizes_;
+  RWVECTOR_DELETE(maxnodes_ * extentNodeOrder) prev_;
+  RWVECTOR_DELETE(maxnodes_ * extentNodeOrder) next_;
+  RWVECTOR_DELETE(maxnodes_ * extentNodeOrder) freeSlots_;
+}
+
+RWoffset
+RWExtentListManager::allocate(RWspace spaceRequested)
+{
+  RWspace spaceRequired = spaceFor(spaceRequested);
+
+  // Look for a fit on the extent's own list, then take the first
+  // extent from a list of larger ones:
+  size_t slot = RW_NPOS;
+  int b = binOf(spaceRequired);
+  int n = 0;
+  for (size_t s = bins_[b]; s != RW_NPOS && n < probes; s = next_[s], n++)
+  {
+    if (sizes_[s] >= spaceRequired) { slot = s; break; }
+  }
+  while (slot == RW_NPOS && ++b < nbins)
+    slot = bins_[b];
+
+  RWoffset ret;
+  if (slot == RW_NPOS)
+    ret = allocateAtEnd(spaceRequired);
+  else
+    ret = takeExtent(slot, spaceRequired);
+
+  // Record the size of the allocation in the header:
+  if ( !filemgr_->SeekTo(ret)           ) seekErr();
+  if ( !filemgr_->Write(spaceRequired)  ) writeErr();
+  return ret + sizeof(RWspace);		// Adjust to what the user will see
+}
+
+/*
+ * First fit by address, for compaction.  The extents are in no order,
+ * so every one is looked at.
+ */
+RWoffset
+RWExtentListManager::allocateBelow(RWspace spaceRequested, RWoffset limit)
+{
+  RWspace spaceRequired = spaceFor(spaceRequested);
+  size_t slot = RW_NPOS;
+  size_t nslots = nnodes_ * extentNodeOrder;
+  for (register size_t s = 0; s < nslots; s++)
+  {
+    if (sizes_[s] >= spaceRequired &&
+	(slot == RW_NPOS || offsets_[s] < offsets_[slot]))
+      slot = s;
+  }
+  if (slot == RW_NPOS || offsets_[slot] + (RWoffset)sizeof(RWspace) >= limit)
+    return RWNIL;
+
+  RWoffset ret = takeExtent(slot, spaceRequired);
+  if ( !filemgr_->SeekTo(ret)           ) seekErr();
+  if ( !filemgr_->Write(spaceRequired)  ) writeErr();
+  return ret + sizeof(RWspace);
+}
+
+void
+RWExtentListManager::deallocate(RWoffset loc)
+{
+  // Subtract off the header and get the size of the allocation:
+  loc -= sizeof(RWspace);
+  RWspace space;
+  if ( !filemgr_->SeekTo(loc) ) seekErr();
+  if ( !filemgr_->Read(space) ) readErr();
+
+  // Coalesce with free neighbours on either side:
+  size_t right = starts_.find(loc + (RWoffset)space);
+  if (right != RW_NPOS)
+  {
+    space += sizes_[right];
+    removeExtent(right);
+  }
+  size_t left = ends_.find(loc);
+  if (left != RW_NPOS)
+  {
+    loc    = offsets_[left];
+    space += sizes_[left];
+  }
+
+  // Free space at the end of the file goes back to the file:
+  if (deallocateFromEnd(loc, space))
+  {
+    if (left != RW_NPOS) removeExtent(left);
+  }
+  else if (left != RW_NPOS)
+    resizeExtent(left, loc, space);
+  else
+    addExtent(loc, space);
+}
+
+/*
+ * Move the nodes of the chain, other than the first, into free space
+ * lower in the file where there is any, so that they don't hold the
+ * end of the file out.  A node overwrites the header of its space, so
+ * the header is put back before the old space is given up.
+ */
+void
+RWExtentListManager::moveDown()
+{
+  const RWspace nodeSpace = sizeof(RWExtentNode) - sizeof(RWspace);
+  RWExtentNode node;
+  size_t n = nnodes_;
+  for (register size_t k = 1; k < n; k++)
+  {
+    RWoffset from = nodeLocs_[k];
+    RWoffset to   = allocateBelow(nodeSpace, from + sizeof(RWspace));
+    if (to == RWNIL) continue;
+    to -= sizeof(RWspace);
+    RWspace space = blockSize(to);
+
+    // Copy the node, then point the one before at the copy:
+    if ( !filemgr_->SeekTo(from)                            ) seekErr();
+    if ( !filemgr_->Read((char*)&node, sizeof(node))        ) readErr();
+    if ( !filemgr_->SeekTo(to)                              ) seekErr();
+    if ( !filemgr_->Write((const char*)&node, sizeof(node)) ) writeErr();
+    nodeLocs_[k] = to;
+    RWoffset nextLoc = nodeLocs_[k-1] + ((char*)&node.next_ - (char*)&node);
+    if ( !filemgr_->SeekTo(nextLoc) ) seekErr();
+    if ( !filemgr_->Write(to)       ) writeErr();
+
+    if ( !filemgr_->SeekTo(from)              ) seekErr();
+    if ( !filemgr_->Write(spaceFor(nodeSpace)) ) writeErr();
+    deallocate(from + sizeof(RWspace));
+    freeRemnant(to, space);
+  }
+}
+
+/****************************************************************
+ *								*
+ *		RWExtentListManager private functions		*
+ *								*
+ ****************************************************************/
+
+// Add on the size header and keep allocations RWoffset aligned.
+RWspace
+RWExtentListManager::spaceFor(RWspace spaceRequested)
+{
+  const unsigned long align = sizeof(RWoffset) - 1;
+  return (unsigned long)(spaceRequested + sizeof(RWspace) + align) & ~align;
+}
+
+/*
+ * Take space from the front of the extent in slot.  If what would be
+ * left is too small to be useful it is taken too, and space is
+ * enlarged to match.
+ */
+RWoffset
+RWExtentListManager::takeExtent(size_t slot, RWspace& space)
+{
+  RWoffset ret = offsets_[slot];
+  RWspace left = sizes_[slot] - space;
+  if (left < MINSPACE)
+  {
+    space = sizes_[slot];		// Take the remnant too
+    removeExtent(slot);
+  }
+  else
+    resizeExtent(slot, ret + (RWoffset)space, left);
+  return ret;
+}
+
+void
+RWExtentListManager::addExtent(RWoffset loc, RWspace space)
+{
+  if (nfree_ == 0) addNode();
+  size_t slot = freeSlots_[--nfree_];
+  offsets_[slot] = loc;
+  sizes_[slot]   = space;
+  link(slot);
+  writeSlot(slot);
+}
+
+/*
+ * Add a node to the end of the chain.  As with the older styles, its
+ * space is allocated like any other, less the header; nodes are never
+ * given back, though.  Allocating never needs a new slot, so there is
+ * no recursion.
+ */
+void
+RWExtentListManager::addNode()
+{
+  RWoffset loc = allocate(sizeof(RWExtentNode) - sizeof(RWspace)) - sizeof(RWspace);
+  RWspace space = blockSize(loc);
+  RWExtentNode node;
+  node.initialize(RWNIL);
+  if ( !filemgr_->SeekTo(loc)                             ) seekErr();
+  if ( !filemgr_->Write((const char*)&node, sizeof(node)) ) writeErr();
+
+  // Point the last node at it:
+  RWoffset nextLoc = nodeLocs_[nnodes_-1] + ((char*)&node.next_ - (char*)&node);
+  if ( !filemgr_->SeekTo(nextLoc) ) seekErr();
+  if ( !filemgr_->Write(loc)      ) writeErr();
+
+  newNode(loc);
+  // Push in reverse, so that slots are used in order:
+  size_t first = (nnodes_-1) * extentNodeOrder;
+  for (register int i=extentNodeOrder-1; i>=0; i--)
+    freeSlots_[nfree_++] = first + i;
+  freeRemnant(loc, space);
+}
+
+// The size recorded in the header of the space at loc.
+RWspace
+RWExtentListManager::blockSize(RWoffset loc)
+{
+  RWspace space;
+  if ( !filemgr_->SeekTo(loc) ) seekErr();
+  if ( !filemgr_->Read(space) ) readErr();
+  return space;
+}
+
+/*
+ * A node at loc, in space bytes, only needs the space of a node; the
+ * rest, taken as a remnant when the extent was split, goes back on the
+ * free list.  A node overwrites its header, so this is what lets
+ * moveDown() give the node's space up by its size.
+ */
+void
+RWExtentListManager::freeRemnant(RWoffset loc, RWspace space)
+{
+  RWspace nodeBlock = spaceFor(sizeof(RWExtentNode) - sizeof(RWspace));
+  if (space <= nodeBlock) return;
+  RWoffset rest = loc + (RWoffset)nodeBlock;
+  if ( !filemgr_->SeekTo(rest)             ) seekErr();
+  if ( !filemgr_->Write(space - nodeBlock) ) writeErr();
+  deallocate(rest + sizeof(RWspace));
+}
+
+int
+RWExtentListManager::binOf(RWspace space)
+{
+  int b = 0;
+  while (space >>= 1) b++;
+  return b;
+}
+
+// Put a slot on its size list and in the hash tables.
+void
+RWExtentListManager::link(size_t slot)
+{
+  size_t& head = bins_[binOf(sizes_[slot])];
+  prev_[slot] = RW_NPOS;
+  next_[slot] = head;
+  if (head != RW_NPOS) prev_[head] = slot;
+  head = slot;
+  starts_.insert(offsets_[slot], slot);
+  ends_.insert(offsets_[slot] + (RWoffset)sizes_[slot], slot);
+}
+
+// Make room for the slots of one more node, at loc.
+void
+RWExtentListManager::newNode(RWoffset loc)
+{
+  if (nnodes_ == maxnodes_)
+  {
+    size_t newmax   = maxnodes_ ? 2*maxnodes_ : 4;
+    size_t oldslots = maxnodes_ * extentNodeOrder;
+    size_t newslots = newmax    * extentNodeOrder;
+    RWoffset* newLocs  = new RWoffset[newmax];
+    RWoffset* newOffs  = new RWoffset[newslots];
+    RWspace*  newSizes = new RWspace[newslots];
+    size_t*   newPrev  = new size_t[newslots];
+    size_t*   newNext  = new size_t[newslots];
+    size_t*   newFree  = new size_t[newslots];
+    if (nnodes_)
+    {
+      memcpy(newLocs,  nodeLocs_,  nnodes_  * sizeof(RWoffset));
+      memcpy(newOffs,  offsets_,   oldslots * sizeof(RWoffset));
+      memcpy(newSizes, sizes_,     oldslots * sizeof(RWspace));
+      memcpy(newPrev,  prev_,      oldslots * sizeof(size_t));
+      memcpy(newNext,  next_,      oldslots * sizeof(size_t));
+      memcpy(newFree,  freeSlots_, nfree_   * sizeof(size_t));
+    }
+    RWVECTOR_DELETE(maxnodes_) nodeLocs_;
+    RWVECTOR_DELETE(oldslots) offsets_;
+    RWVECTOR_DELETE(oldslots) sizes_;
+    RWVECTOR_DELETE(oldslots) prev_;
+    RWVECTOR_DELETE(oldslots) next_;
+    RWVECTOR_DELETE(oldslots) freeSlots_;
+    nodeLocs_  = newLocs;
+    offsets_   = newOffs;
+    sizes_     = newSizes;
+    prev_      = newPrev;
+    next_      = newNext;
+    freeSlots_ = newFree;
+    maxnodes_  = newmax;
+  }
+  size_t first = nnodes_ * extentNodeOrder;
+  for (register int i=0; i<extentNodeOrder; i++)
+    sizes_[first+i] = 0;
+  nodeLocs_[nnodes_++] = loc;
+}
+
+// Read the whole chain, building the in-memory index.
+void
+RWExtentListManager::readNodes()
+{
+  RWExtentNode node;
+  RWoffset loc = rootOffset();
+  while (loc != RWNIL)
+  {
+    if ( !filemgr_->SeekTo(loc)                      ) seekErr();
+    if ( !filemgr_->Read((char*)&node, sizeof(node)) ) readErr();
+    if ( node.magicNumber_ != extentMagicNumber )
+      RWTHROW(RWExternalErr(RWMessage(RWTOOL_MAGIC,
+				      (long)node.magicNumber_,
+				      (long)extentMagicNumber) ));
+    newNode(loc);
+    size_t first = (nnodes_-1) * extentNodeOrder;
+    for (register int i=extentNodeOrder-1; i>=0; i--)
+    {
+      size_t slot = first + i;
+      if (node.extents_[i].size_ == 0)
+	freeSlots_[nfree_++] = slot;
       else
       {
-	RWTHROW(RWExternalErr(RWMessage(RWTOOL_FLIST,
-					(long)sizeof(RWNewNode),
-					(long)nodeSize) ));
+	offsets_[slot] = node.extents_[i].offset_;
+	sizes_[slot]   = node.extents_[i].size_;
+	link(slot);
       }
     }
+    loc = node.next_;
   }
+}
+
+void
+RWExtentListManager::removeExtent(size_t slot)
+{
+  unlink(slot);
+  sizes_[slot] = 0;
+  freeSlots_[nfree_++] = slot;
+  writeSlot(slot);
+}
+
+void
+RWExtentListManager::resizeExtent(size_t slot, RWoffset loc, RWspace space)
+{
+  unlink(slot);
+  offsets_[slot] = loc;
+  sizes_[slot]   = space;
+  link(slot);
+  writeSlot(slot);
+}
+
+void
+RWExtentListManager::unlink(size_t slot)
+{
+  if (prev_[slot] != RW_NPOS) next_[prev_[slot]] = next_[slot];
+  else                        bins_[binOf(sizes_[slot])] = next_[slot];
+  if (next_[slot] != RW_NPOS) prev_[next_[slot]] = prev_[slot];
+  starts_.remove(offsets_[slot]);
+  ends_.remove(offsets_[slot] + (RWoffset)sizes_[slot]);
+}
+
+void
+RWExtentListManager::writeSlot(size_t slot)
+{
+  static RWExtentNode layout;		// Just for its member offsets
+  RWExtent e;
+  e.offset_ = offsets_[slot];
+  e.size_   = sizes_[slot];
+  RWoffset loc = nodeLocs_[slot / extentNodeOrder] +
+    ((char*)&layout.extents_[slot % extentNodeOrder] - (char*)&layout);
+  if ( !filemgr_->SeekTo(loc)                       ) seekErr();
+  if ( !filemgr_->Write((const char*)&e, sizeof(e)) ) writeErr();
+}
+
+#ifdef RDEBUG
+
+/*
+ * Here idx is a slot number, counted across all nodes, and nodeLoc
+ * the node holding it.
+ */
+RWoffset
+RWExtentListManager::walkFreeList(RWoffset& nodeLoc, int& idx, RWspace& space)
+{
+  if (nodeLoc==0) idx = 0;
+  size_t nslots = nnodes_ * extentNodeOrder;
+  while ((size_t)idx < nslots && sizes_[idx] == 0) idx++;
+  if ((size_t)idx >= nslots) return RWNIL;
+  nodeLoc = nodeLocs_[idx / extentNodeOrder];
+  space   = sizes_[idx];
+  return offsets_[idx++];
+}
+
+void
+RWExtentListManager::summarize()
+{
+  for (size_t n=0; n<nnodes_; n++)
+  {
+    cout << "*** Block starting at " << nodeLocs_[n] << endl;
+    cout << "      Location\tSpace\n";
+    for (int i=0; i<extentNodeOrder; i++)
+    {
+      size_t slot = n*extentNodeOrder + i;
+      if (sizes_[slot])
+	cout << "      " << offsets_[slot] << "\t" << sizes_[slot] << endl;
+    }
+  }
+}
+
+#endif  /* RDEBUG */
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+//                      RWFileManager definitions                       //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * Definitions for RWFileManager mostly consists of a bunch of forwarding
+ * functions to the abstract base class RWListManager.
+ *
+ */
+
+RWFileManager::RWFileManager(const char* fname, const char* mode)
+ : RWFile(fname, mode),
+   filemgr_(rwnil),
+   startOfData_(RWNIL),
+   endOfData_(RWNIL)
+{
+  readHeader();
 }  
 
 RWFileManager::~RWFileManager()
 {
-  delete filemgr_;
+  delete filemgr_;	// RWFile closes any log
 }
 
 RWoffset
@@ -1204,6 +1830,26 @@ RWFileManager::deallocate(RWoffset loc)
   filemgr_->deallocate(loc);
 }
 
+RWoffset
+RWFileManager::allocateBelow(RWspace space, RWoffset limit)
+{
+  RWPRECONDITION(filemgr_ != rwnil);
+  return filemgr_->allocateBelow(space, limit);
+}
+
+/*
+ * Give the space past endData() back to the system, first moving the
+ * free list down out of the way where possible.  The file itself is
+ * left as it is while it is logged.
+ */
+RWBoolean
+RWFileManager::trim()
+{
+  RWPRECONDITION(filemgr_ != rwnil);
+  filemgr_->moveDown();
+  return Truncate(endOfData_);
+}
+
 /*
  * Allocates space at the end of the file.
  */
@@ -1218,6 +1864,9 @@ RWFileManager::allocateAtEnd(RWspace spaceRequired)
   if ( !SeekTo(sizeof(RWoffset)) ) seekErr();
   if ( !Write(endOfData_) )        writeErr();
 
+  // Keep the new space addressable if the file is memory mapped:
+  if ( isMapped() && !GrowMap(endOfData_) ) writeErr();
+
 #ifdef applec
   if(ioctl(fileno(filep),FIOSETEOF,(long*)endOfData_) == -1) writeErr();
 #endif
@@ -1271,6 +1920,124 @@ RWFileManager::rootOffset() const
   return sizeof(startOfData_) + sizeof(endOfData_) + sizeof(size_t);
 }
 
+/*
+ * Recover header information from the file, or write it if the file is
+ * new, and set up the appropriate free list manager.
+ */
+void
+RWFileManager::readHeader()
+{
+  if( isValid() && Exists() )
+  {
+    // Is this file empty?
+    if( IsEmpty() )
+    {
+      // Virgin file; use the extent manager:
+      // (If mode is read-only - writeErr() will be called)
+      startOfData_    = RWNIL;
+      endOfData_      = rootOffset() + sizeof(RWExtentNode);
+      size_t nodeSize = sizeof(RWExtentNode);
+      if (!SeekToBegin()) seekErr();
+      if (!Write(startOfData_)  ||
+	  !Write(endOfData_)    ||
+	  !Write(nodeSize) ) writeErr();
+      filemgr_ = new RWExtentListManager(this, TRUE);
+    }
+
+    else
+    {
+      // File is not empty.
+      size_t nodeSize;
+
+      // Recover header information:
+      if (!SeekToBegin()) seekErr();
+      if (!Read(startOfData_)   ||
+	  !Read(endOfData_)     ||
+	  !Read(nodeSize) ) readErr();
+
+      // Use the node size to figure out which style of free list
+      // the file has.  Older styles are still maintained as they are:
+      if (nodeSize == sizeof(RWExtentNode))
+        filemgr_ = new RWExtentListManager(this, FALSE);
+      else if (nodeSize == sizeof(RWNewNode))
+        filemgr_ = new RWNewListManager(this, FALSE);
+      else if (nodeSize == sizeof(RWOldNode))
+        filemgr_ = new RWOldListManager(this, FALSE);
+      else
+      {
+	RWTHROW(RWExternalErr(RWMessage(RWTOOL_FLIST,
+					(long)sizeof(RWExtentNode),
+					(long)nodeSize) ));
+      }
+    }
+  }
+}
+
+/*
+ * Attach a write-ahead log.  Returns FALSE if the log cannot be opened
+ * or recovered, or the file is mapped or read only.
+ */
+RWBoolean
+RWFileManager::openLog(const char* logName)
+{
+  if (log_) return TRUE;
+  if (isMapped() || !isValid() || isReadOnly()) return FALSE;
+
+  const char* suffix = ".log";
+  size_t len = strlen(filename) + strlen(suffix) + 1;
+  char* defName = rwnil;
+  if (logName == rwnil)
+  {
+    defName = new char[len];
+    strcpy(defName, filename);
+    strcat(defName, suffix);
+    logName = defName;
+  }
+  RWFileLog* log = new RWFileLog(this, logName);
+  RWVECTOR_DELETE(len) defName;
+  if (!log->isValid())
+  {
+    delete log;
+    return FALSE;
+  }
+  log_ = log;
+
+  // Recovery may have changed everything:
+  delete filemgr_;
+  filemgr_ = rwnil;
+  readHeader();
+  return TRUE;
+}
+
+// Commit and write back whatever is outstanding, and detach the log.
+void
+RWFileManager::closeLog()
+{
+  if (log_ == rwnil) return;
+  RWBoolean ok = log_->checkpoint();
+  delete log_;
+  log_ = rwnil;
+  if (!ok) writeErr();
+}
+
+void
+RWFileManager::checkpoint()
+{
+  if (log_ ? !log_->checkpoint() : !Flush()) writeErr();
+}
+
+void
+RWFileManager::commit(RWBoolean sync)
+{
+  if (log_ ? !log_->commit(sync) : !Flush()) writeErr();
+}
+
+void
+RWFileManager::sync()
+{
+  if (log_ ? !log_->sync() : !Flush()) writeErr();
+}
+
 #ifdef RDEBUG
 
 RWoffset
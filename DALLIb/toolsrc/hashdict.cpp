@@ -136,7 +136,6 @@
 #include "rw/hashdict.h"
 #include "rw/collass.h"
 #include "rw/idenset.h"
-#include "rw/slistcol.h"
 #include "defcol.h"   
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: hashdict.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/18 20:51:00 $");
@@ -400,21 +399,17 @@ RWHashDictionary::removeKeyAndValue(const RWCollectable* key, RWCollectable*& va
  *								*
  ****************************************************************/
 
-static void replaceWithCopy(void*& a, void*)
-{
-  a = ((RWCollectable*)a)->copy();
-}
-
 /* 
  * Make a (shallow) copy of each association.  Note that this version
- * will work for both value and identity associations.
+ * will work for both value and identity associations.  A copy hashes
+ * as the original did, so it may take its slot.
  */
 void
 RWHashDictionary::copyAssociations()
 {
   for (size_t i=0; i<buckets(); i++) {
-    if (table_(i)) {
-      table_(i)->applyReference(replaceWithCopy,0);
+    if (table_[i].item_) {
+      table_[i].item_ = table_[i].item_->copy();
     }
   }
 }
@@ -122,7 +122,6 @@
  */
 
 #include "rw/hashtab.h"
-#include "rw/slistcol.h"
 #include "defcol.h"             
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: hashtab.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/18 20:51:00 $");
@@ -131,38 +130,58 @@ RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: hashtab.cpp,v $ $Revis
 # define new rwnew
 #endif
 
-#define BUCKET         RWSlistCollectables
-#define BUCKETITERATOR RWSlistCollectablesIterator  
+#define DEFAULT_MAX_LOAD 0.75
 
 RWDEFINE_COLLECTABLE2(RWHashTable, __RWHASHTABLE)
 
+// Smallest power of two no less than n, and at least 2:
+static size_t
+rwSlotsFor(size_t n)
+{
+  size_t N = 2;
+  while (N < n) N <<= 1;
+  return N;
+}
+
+static RWHashTableSlot*
+rwNewSlots(size_t N)
+{
+  RWHashTableSlot* t = new RWHashTableSlot[N];
+  for (register size_t i=0; i<N; i++) {
+    t[i].item_ = rwnil;
+    t[i].hash_ = 0;
+  }
+  return t;
+}
+
 // Default constructor: N defaults to RWCollectable::DEFAULT_CAPACITY (=64)
 RWHashTable::RWHashTable(size_t N) :
-  table_(N ? N : 2,rwnil),
-  nitems_(0)
+  nslots_(rwSlotsFor(N)),
+  nitems_(0),
+  nremoved_(0),
+  maxLoad_(DEFAULT_MAX_LOAD)
 {
+  table_ = rwNewSlots(nslots_);
+  limit_ = (size_t)(maxLoad_ * nslots_);
 }
  
-/*
- * got to put this somewhere; might as well be here:
- */
-implement(RWGVector,RWSlistCollectablesP) 
-
 // Destructor:
 RWHashTable::~RWHashTable()
 {
-  clear();
+  RWVECTOR_DELETE(nslots_) table_;
 }
 
 // Copy constructor: makes a shallow copy
 RWHashTable::RWHashTable(const RWHashTable& v) :
-  table_(v.table_.length(), rwnil),
-  nitems_(v.nitems_)
+  nslots_(v.nslots_),
+  nitems_(v.nitems_),
+  nremoved_(v.nremoved_),
+  limit_(v.limit_),
+  maxLoad_(v.maxLoad_)
 {
-  size_t N = table_.length();
-  for(size_t i=0; i<N; i++)
-    if (v.table_(i))
-      table_(i) = new BUCKET(*v.table_(i));	// Copy will be made
+  table_ = new RWHashTableSlot[nslots_];
+  for (register size_t i=0; i<nslots_; i++)
+    table_[i] = v.table_[i];
 }
 
 /*
@@ -173,16 +192,16 @@ RWHashTable&
 RWHashTable::operator=(const RWHashTable& v)
 {
   if (&v != this) {
-    clear();			// Clear the slate
-
-    size_t N = v.table_.length();	// Adopt the argument's length
-    table_.reshape(N);
-
-    // Now iterate through v's table, inserting a copy of each chain:
-    for (size_t i=0; i<N; i++){
-      table_(i) = v.table_(i) ? new BUCKET(*v.table_(i)) : rwnil;
+    if (nslots_ != v.nslots_) {
+      RWVECTOR_DELETE(nslots_) table_;
+      table_ = new RWHashTableSlot[nslots_ = v.nslots_];
     }
-    nitems_ = v.nitems_;
+    for (register size_t i=0; i<nslots_; i++)
+      table_[i] = v.table_[i];
+    nitems_   = v.nitems_;
+    nremoved_ = v.nremoved_;
+    limit_    = v.limit_;
+    maxLoad_  = v.maxLoad_;
   }
   return *this;
 }
@@ -193,27 +212,20 @@ RWHashTable::operator=(const RWHashTable& v)
 void
 RWHashTable::apply(RWapplyCollectable ap, void* x)
 {
-  size_t N = table_.length();
-  for (size_t i=0; i<N; i++) 
-    if(table_(i))
-       table_(i)->apply(ap,x);
+  for (register size_t i=0; i<nslots_; i++) 
+    if (table_[i].item_)
+      (*ap)(table_[i].item_, x);
 }
 
 // clear all entries
 void 
 RWHashTable::clear()  
 {
-  for(size_t i = 0; i < table_.length(); i++)
-  {
-#ifdef __ATT__
-    BUCKET* p = table_(i);	// Temporary necessary for cfront
-    delete p;			// clears the list
-#else
-    delete table_(i);		// clears the list
-#endif
-    table_(i) = rwnil;		// indicates no data
+  for (register size_t i=0; i<nslots_; i++) {
+    table_[i].item_ = rwnil;
+    table_[i].hash_ = 0;
   }
-  nitems_ = 0;
+  nitems_ = nremoved_ = 0;
 }
 
 // Find the first occurrence of "a":
@@ -221,8 +233,8 @@ RWCollectable*
 RWHashTable::find(const RWCollectable* a) const
 {
   RWPRECONDITION(a!=rwnil);
-  BUCKET* p = this->table_(hashIndex(a));
-  RWCollectable* t = p ? p->find(a) : rwnil;
+  size_t i = findSlot(a, a->hash());
+  RWCollectable* t = i==RW_NPOS ? rwnil : table_[i].item_;
   RWPOSTCONDITION(t==rwnil || t->isEqual(a));
   return t;
 }
@@ -234,44 +246,58 @@ RWHashTable::find(const RWCollectable* a) const
 RWCollectable*
 RWHashTable::insert(RWCollectable* a)
 {
-  size_t idx = hashIndex(a);
-
-  // Allocate a chain if one doesn't exist already:
-  if(table_(idx) == rwnil)
-    table_(idx) = new BUCKET;
-
-  nitems_++;
-
-  // Now insert into the chain:
-  return table_(idx)->insert(a);
+  return insertHash(a->hash(), a);
 }
 
 /*
  * Return the number of items that are equal to the item pointed
- * to by "a".  Because all such instances will be in the same bucket,
- * we need only search that bucket.
+ * to by "a".  Because all such instances lie in the run of slots
+ * that starts at a's home slot, we need only search that run.
  */
 size_t
 RWHashTable::occurrencesOf(const RWCollectable* a) const
 {
-   BUCKET* p = this->table_(hashIndex(a));
-   return p ? p->occurrencesOf(a) : 0;
+  unsigned h = a->hash();
+  size_t count = 0;
+  size_t mask = nslots_-1;
+  for (register size_t i=homeSlot(h); ; i = (i+1) & mask) {
+    const RWHashTableSlot& s = table_[i];
+    if (s.item_ == rwnil) {
+      if (s.hash_ == 0) break;			// End of the run
+    }
+    else if (s.hash_ == h && s.item_->isEqual(a))
+      count++;
+  }
+  return count;
 }
 
 /*
  * Remove and return one occurrence of a; if a is not in table return 0.
  */
-RWCollectable*
+RWCollectable*   
 RWHashTable::remove(const RWCollectable* a)   
 {
-  BUCKET* p = table_(hashIndex(a));
-  RWCollectable* c = p ? p->remove(a) : rwnil;
-  if (c)
-    --nitems_;
+  size_t i = findSlot(a, a->hash());
+  RWCollectable* c = i==RW_NPOS ? rwnil : removeSlot(i);
   RWPOSTCONDITION(c==rwnil || c->isEqual(a));
   return c;
 }
 
+/*
+ * Set the fraction of the slots that may be used before the table
+ * grows.  Returns the old value.
+ */
+double
+RWHashTable::maxLoad(double f)
+{
+  RWPRECONDITION(f >= 0.25 && f <= 0.95);
+  double old = maxLoad_;
+  maxLoad_ = f;
+  limit_ = (size_t)(maxLoad_ * nslots_);
+  if (nitems_ + nremoved_ >= limit_) resize(nitems_ + 1);
+  return old;
+}
+
 /****************************************************************
  *								*
  *			RWHashTable				*
@@ -281,12 +307,10 @@ RWHashTable::remove(const RWCollectable* a)
 
 
 /*
- *  Resize adjusts the number of buckets, not the number of items.
- *  If number of items ~= (2/3)* number of slots,
- *  then the probability that the next insert will find an empty 
- *  slot is almost .5 (which indicates that about 1/2 the existing data 
- *  are in chains of at least length 2). We will use 3*items/2 as our
- *  default value. For small tables, we will force to 16 slots.
+ *  Resize adjusts the number of slots, not the number of items.
+ *  By default we use 3*items/2 slots, or more if needed to keep
+ *  within maxLoad(), rounded up to a power of two.  For small tables,
+ *  we will force to 16 slots.
  */
 
 void
@@ -296,38 +320,95 @@ RWHashTable::resize(size_t N)
   size_t oldTally = entries();
 #endif
   if (N==0) N = nitems_ < 12 ? 16 : nitems_*3/2 ;
+  N = rwSlotsFor(N);
+  while ((size_t)(maxLoad_ * N) <= nitems_) N <<= 1;
+  rehash(N);
+  RWPOSTCONDITION(oldTally==entries());
+}
 
-  // Save old values -- NB: this involves a copy:
-  RWGVector(RWSlistCollectablesP) tempTable =table_;
-  table_.reshape(N);		// Resize internal table
-  table_  = rwnil;		// Zero it
-  nitems_ = 0;
+/*
+ * Rebuild the table with N slots, a power of two, dropping the marks
+ * left by removed items.
+ */
+void
+RWHashTable::rehash(size_t N)
+{
+  RWHashTableSlot* old = table_;
+  size_t oldN = nslots_;
+  table_  = rwNewSlots(N);
+  nslots_ = N;
+  limit_  = (size_t)(maxLoad_ * nslots_);
+  nremoved_ = 0;
 
-  // Now iterate through the old collection, inserting each item
-  for (size_t i=0; i<tempTable.length(); i++){
-    if (tempTable(i)) {
-      BUCKETITERATOR next(*tempTable(i));
-      RWCollectable* p;
-      while ( (p=next())!=rwnil )
-        insert(p);
-      BUCKET* ch = tempTable(i);		// Temporary necessary for cfront
-      delete ch;
+  size_t mask = nslots_-1;
+  for (register size_t i=0; i<oldN; i++){
+    if (old[i].item_) {
+      register size_t j = homeSlot(old[i].hash_);
+      while (table_[j].item_) j = (j+1) & mask;
+      table_[j] = old[i];
     }
   }
-  RWPOSTCONDITION(oldTally==entries());
+  RWVECTOR_DELETE(oldN) old;
+}
+
+size_t
+RWHashTable::findSlot(const RWCollectable* a, unsigned h, RWBoolean identity) const
+{
+  size_t mask = nslots_-1;
+  for (register size_t i=homeSlot(h); ; i = (i+1) & mask) {
+    const RWHashTableSlot& s = table_[i];
+    if (s.item_ == rwnil) {
+      if (s.hash_ == 0) return RW_NPOS;	// End of the run
+    }
+    else if (s.hash_ == h && (identity ? s.item_ == a : s.item_->isEqual(a)))
+      return i;
+  }
 }
 
 /*
- * Insert the item "a" at the index "idx":
+ * Insert the item "a", whose hash value is "h".  The first slot that
+ * is empty or marked as removed is taken.  Should the items and marks
+ * pass the limit, the table is first rebuilt, doubling until the items
+ * come to no more than half the limit; if it is the marks that passed
+ * it, that may be at the same size.
  */
 RWCollectable*
-RWHashTable::insertIndex(size_t idx, RWCollectable* a)
+RWHashTable::insertHash(unsigned h, RWCollectable* a)
 {
-  // Allocate a chain if one doesn't exist already:
-  if(table_(idx) == rwnil) 
-    table_(idx) = new BUCKET;
+  RWPRECONDITION(a!=rwnil);
+  if (nitems_ + nremoved_ + 1 > limit_) {
+    size_t N = nslots_;
+    while ((size_t)(maxLoad_ * N) < 2*(nitems_+1)) N <<= 1;
+    rehash(N);
+  }
+
+  size_t mask = nslots_-1;
+  register size_t i = homeSlot(h);
+  while (table_[i].item_) i = (i+1) & mask;
+  if (table_[i].hash_) --nremoved_;	// Reusing a removed item's slot
+  table_[i].item_ = a;
+  table_[i].hash_ = h;
   nitems_++;
-  // Now insert into the chain:
-  return table_(idx)->insert(a);
+  return a;
 }
 
+/*
+ * Empty slot "i", marking it as removed unless the run of slots
+ * ends with it.
+ */
+RWCollectable*
+RWHashTable::removeSlot(size_t i)
+{
+  RWCollectable* c = table_[i].item_;
+  RWPRECONDITION(c!=rwnil);
+  table_[i].item_ = rwnil;
+  if (table_[(i+1) & (nslots_-1)].item_ == rwnil &&
+      table_[(i+1) & (nslots_-1)].hash_ == 0)
+    table_[i].hash_ = 0;
+  else {
+    table_[i].hash_ = ~0U;
+    nremoved_++;
+  }
+  --nitems_;
+  return c;
+}
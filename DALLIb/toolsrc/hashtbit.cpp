@@ -67,17 +67,9 @@
  */
 
 #include "rw/hashtab.h"
-#include "rw/slistcol.h"
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: hashtbit.cpp,v $ $Revision: 6.3 $ $Date: 1994/07/18 20:51:00 $");
 
-#ifndef RW_NO_CPP_RECURSION
-# define new rwnew
-#endif
-
-#define BUCKET         RWSlistCollectables  
-#define BUCKETITERATOR RWSlistCollectablesIterator
-
 
 /****************************************************************
  *								*
@@ -85,111 +77,85 @@ RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: hashtbit.cpp,v $ $Revi
  *								*
  ****************************************************************/
 
+/*
+ * The iterator walks the slots in order.  idx_ is one more than the
+ * slot of the current item, so that 0 means before the first.
+ * Removing an item leaves its slot empty but in place, so the walk
+ * is not disturbed.
+ */
 
 RWHashTableIterator::RWHashTableIterator(RWHashTable& h) :
  myHash_(&h),
- idx_(RW_NPOS),
- iterator_(rwnil)
+ idx_(0)
 {
-  reset();
 }
 
 RWHashTableIterator::RWHashTableIterator(const RWHashTableIterator& h) :
  myHash_(h.myHash_),
  idx_(h.idx_)
 {
-  iterator_ = h.iterator_ ? new BUCKETITERATOR(*h.iterator_) : rwnil;
 }
 
 RWHashTableIterator::~RWHashTableIterator()
 {
-   delete iterator_;
 }
 
 RWHashTableIterator&
 RWHashTableIterator::operator=(const RWHashTableIterator& h)
 {
-  if (this != &h)
-  {
-    delete iterator_;
-    myHash_   = h.myHash_;
-    idx_      = h.idx_;
-    iterator_ = h.iterator_ ? new BUCKETITERATOR(*h.iterator_) : rwnil;
-  }
+  myHash_ = h.myHash_;
+  idx_    = h.idx_;
   return *this;
 }
 
 RWCollectable*
 RWHashTableIterator::operator()()
 {
-  RWCollectable* p=rwnil;
-  while (iterator_ && (p=(*iterator_)())==rwnil )
-    nextIterator();
-  return p;
+  size_t N = myHash_->buckets();
+  while (idx_ < N) {
+    RWCollectable* p = myHash_->table_[idx_++].item_;
+    if (p) return p;
+  }
+  idx_ = N+1;			// Past the end
+  return rwnil;
 }
 
 RWCollectable*
 RWHashTableIterator::findNext(const RWCollectable* a)
 {
-  RWCollectable* p=rwnil;
-  while (iterator_ && (p=iterator_->findNext(a))==rwnil )
-    nextIterator();
-  return p;
+  unsigned h = a->hash();
+  size_t N = myHash_->buckets();
+  while (idx_ < N) {
+    const RWHashTableSlot& s = myHash_->table_[idx_++];
+    if (s.item_ && s.hash_ == h && s.item_->isEqual(a)) return s.item_;
+  }
+  idx_ = N+1;
+  return rwnil;
 }
 
 RWCollectable*
 RWHashTableIterator::remove()
 {
-  RWCollectable* p = iterator_ ? iterator_->remove() : rwnil;
-  if (p) --myHash_->nitems_;
-  return p;
+  if (idx_ == 0 || idx_ > myHash_->buckets() || !myHash_->table_[idx_-1].item_)
+    return rwnil;
+  return myHash_->removeSlot(idx_-1);
 }
 
 RWCollectable*
 RWHashTableIterator::removeNext(const RWCollectable* a)
 {
-  RWCollectable* p=rwnil;
-  while (iterator_ && (p=iterator_->removeNext(a))==rwnil )
-    nextIterator();
-  if (p) --myHash_->nitems_;
-  return p;
+  return findNext(a) ? myHash_->removeSlot(idx_-1) : rwnil;
 }
 
 void
 RWHashTableIterator::reset()
 {
-  delete iterator_;
-  iterator_ = rwnil;
-
-  for (idx_=0; idx_ < myHash_->buckets(); idx_++)
-  {
-    if (myHash_->table_(idx_))
-    {
-      iterator_ = new BUCKETITERATOR(*myHash_->table_(idx_));
-      return;
-    }
-  }
+  idx_ = 0;
 }
 
 RWCollectable*
 RWHashTableIterator::key() const
 {
-   return iterator_ ? iterator_->key() : rwnil;
+  if (idx_ == 0 || idx_ > myHash_->buckets()) return rwnil;
+  return myHash_->table_[idx_-1].item_;
 }
-
-void
-RWHashTableIterator::nextIterator()
-{
-  delete iterator_;		// Invalidate old iterator
-  iterator_ = rwnil;
-
-  while (++idx_ < myHash_->buckets())
-  {
-    if (myHash_->table_(idx_))
-    {
-      iterator_ = new BUCKETITERATOR(*myHash_->table_(idx_));
-      return;
-    }
-  }
-}
-
@@ -100,9 +100,7 @@
  */
 
 #include "rw/idenset.h"
-#include "rw/slistcol.h"
 #include "defcol.h"
-#define CHAIN         RWSlistCollectables
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: idenset.cpp,v $ $Revision: 6.4 $ $Date: 1994/07/18 20:51:00 $");
 
@@ -121,8 +119,8 @@ RWIdentitySet::~RWIdentitySet() {}
 RWCollectable*
 RWIdentitySet::find(const RWCollectable* a) const
 {
-  CHAIN* p = this->table_(hashIndexReference(a));
-  return p ? p->findReference(a) : rwnil;
+  size_t i = findSlot(a, RWhashAddress(a), TRUE);
+  return i==RW_NPOS ? rwnil : table_[i].item_;
 }
 
 /*
@@ -131,13 +129,9 @@ RWIdentitySet::find(const RWCollectable* a) const
 RWCollectable*
 RWIdentitySet::insert(RWCollectable* a)
 {
-  RWCollectable* ret;
-  size_t idx = hashIndexReference(a);
-  if (table_(idx)==rwnil || (ret=table_(idx)->findReference(a))==rwnil) {
-    insertIndex(idx, a);
-    ret = a;
-  }
-  return ret;
+  unsigned h = RWhashAddress(a);
+  size_t i = findSlot(a, h, TRUE);
+  return i==RW_NPOS ? insertHash(h, a) : table_[i].item_;
 }
 
 /*
@@ -147,9 +141,8 @@ RWIdentitySet::insert(RWCollectable* a)
 RWCollectable*
 RWIdentitySet::remove(const RWCollectable* a)
 {
-  CHAIN* p = table_(hashIndexReference(a));
-  RWCollectable* c = p ? p->removeReference(a) : rwnil;
-  if (c) --nitems_;	// Decrement if found
+  size_t i = findSlot(a, RWhashAddress(a), TRUE);
+  RWCollectable* c = i==RW_NPOS ? rwnil : removeSlot(i);
   RWPOSTCONDITION(c==rwnil || c==a);
   return c;
 }
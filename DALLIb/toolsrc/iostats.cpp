@@ -0,0 +1,178 @@
+/*
+ * Statistics kept by the disk based classes.  See rw/iostats.h.
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+
+#include "rw/iostats.h"
+STARTWRAP
+#ifdef unix
+#  include <sys/time.h>		/* Looking for gettimeofday() */
+#else
+#  include <time.h>
+#endif
+ENDWRAP
+
+RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile$ $Revision$ $Date$");
+
+/****************************************************************
+ *								*
+ *			RWLatencyHistogram			*
+ *								*
+ ****************************************************************/
+
+unsigned long
+RWLatencyHistogram::count() const
+{
+  unsigned long n = 0;
+  for (register int i=0; i<nbuckets; i++) n += counts_[i];
+  return n;
+}
+
+double
+RWLatencyHistogram::mean() const
+{
+  unsigned long n = count();
+  return n ? total_ / n : 0;
+}
+
+/*
+ * The least bucket limit below which at least the fraction p of the
+ * events fall: an upper bound on the p'th quantile.
+ */
+unsigned long
+RWLatencyHistogram::percentile(double p) const
+{
+  double want = p * count();
+  double seen = 0;
+  for (register int i=0; i<nbuckets-1; i++)
+  {
+    seen += counts_[i];
+    if (seen >= want && seen > 0) return upperBound(i);
+  }
+  return upperBound(nbuckets-1);
+}
+
+void
+RWLatencyHistogram::record(unsigned long usec)
+{
+  total_ += usec;
+  register int i = 0;
+  while (usec && i < nbuckets-1)
+  {
+    usec >>= 1;
+    i++;
+  }
+  counts_[i]++;
+}
+
+void
+RWLatencyHistogram::reset()
+{
+  for (register int i=0; i<nbuckets; i++) counts_[i] = 0;
+  total_ = 0;
+}
+
+/*
+ * Wall clock time in microseconds, from an arbitrary origin.  Only
+ * differences mean anything.  Without gettimeofday() it falls back on
+ * clock(), which counts processor time and will miss time spent
+ * waiting for the disk.
+ */
+unsigned long
+RWLatencyHistogram::now()
+{
+#ifdef unix
+  struct timeval tv;
+  gettimeofday(&tv, rwnil);
+  return (unsigned long)tv.tv_sec * 1000000UL + (unsigned long)tv.tv_usec;
+#else
+  return (unsigned long)((double)clock() * 1000000.0 / CLOCKS_PER_SEC);
+#endif
+}
+
+unsigned long
+RWLatencyHistogram::upperBound(int i)
+{
+  return 1UL << i;
+}
+
+/****************************************************************
+ *								*
+ *			Statistics objects			*
+ *								*
+ ****************************************************************/
+
+void
+RWFileStatistics::reset()
+{
+  reads = writes = 0;
+  bytesRead = bytesWritten = 0;
+  readTime.reset();
+  writeTime.reset();
+}
+
+void
+RWCacheStatistics::reset()
+{
+  reads = readHits = mappedReads = 0;
+  writes = writeHits = 0;
+  evictions = readahead = prefetches = 0;
+  fileReads = fileWrites = 0;
+  bytesRead = bytesWritten = 0;
+}
+
+void
+RWPageHeapStatistics::reset()
+{
+  locks = lockHits = 0;
+  swapIns = evictions = swapOuts = 0;
+}
+
+void
+RWDiskTreeStatistics::reset()
+{
+  lookups = lookupVisits = filterRejects = 0;
+  inserts = removes = 0;
+  nodeReads = nodeWrites = 0;
+  splits = merges = relocations = 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * RWMappedPageHeap definitions
+ *
+ * $Id$
+ *
+ ****************************************************************************
+ *
+ * Rogue Wave Software, Inc.
+ * P.O. Box 2328
+ * Corvallis, OR 97339
+ *
+ * (c) Copyright 1989, 1990, 1991, 1992, 1993, 1994 Rogue Wave Software, Inc.
+ * ALL RIGHTS RESERVED
+ *
+ * The software and information contained herein are proprietary to, and
+ * comprise valuable trade secrets of, Rogue Wave Software, Inc., which
+ * intends to preserve as trade secrets such software and information.
+ * This software is furnished pursuant to a written license agreement and
+ * may be used, copied, transmitted, and stored only in accordance with
+ * the terms of such license and with the inclusion of the above copyright
+ * notice.  This software and information or any other copies thereof may
+ * not be provided or otherwise made available to any other person.
+ *
+ * Notwithstanding any other lease or license that may pertain to, or
+ * accompany the delivery of, this computer software and information, the
+ * rights of the Government regarding its use, reproduction and disclosure
+ * are as set forth in Section 52.227-19 of the FARS Computer
+ * Software-Restricted Rights clause.
+ * 
+ * Use, duplication, or disclosure by the Government is subject to
+ * restrictions as set forth in subparagraph (c)(1)(ii) of the Rights in
+ * Technical Data and Computer Software clause at DFARS 52.227-7013.
+ * 
+ * This computer software and information is distributed with "restricted
+ * rights."  Use, duplication or disclosure is subject to restrictions as
+ * set forth in NASA FAR SUP 18-52.227-79 (April 1985) "Commercial
+ * Computer Software-Restricted Rights (April 1985)."  If the Clause at
+ * 18-52.227-74 "Rights in Data General" is specified in the contract,
+ * then the "Alternate III" clause applies.
+ *
+ ***************************************************************************
+ *
+ */
+
+#include "rw/mappage.h"
+#include "rw/rwerr.h"
+#include "rw/toolerr.h"
+STARTWRAP
+#include <stdio.h>
+#include <string.h>
+#if defined(unix) && !defined(RW_NO_MMAP)
+#  define RW_MAPPED_PAGES 1
+#  include <sys/types.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+ENDWRAP
+
+RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile$ $Revision$ $Date$");
+
+#ifndef RW_NO_CPP_RECURSION
+# define new rwnew
+#endif
+
+/*
+ * What is known about each page.  A deallocated page keeps its place
+ * in the file and is chained on freeHandle_ for reuse.
+ */
+class RWMappedPage
+{
+public:
+  unsigned		slot;		// Slot in the clock, or noSlot
+  RWHandle		nextFree;	// Chain of deallocated handles
+  short			lockCount;
+  char			referenced;	// Used since the clock hand passed
+  char			dirty;		// Changed since last written back
+  char			used;		// Allocated
+};
+
+static const unsigned noSlot = ~0U;
+
+const unsigned long RWMappedPageHeap::segmentSize_    = 64UL*1024UL*1024UL;
+const unsigned      RWMappedPageHeap::handleIncrement_ = 128;
+
+#ifdef RW_CRLF_CONVENTION
+# define ACCESS "wb+"
+#else
+# define ACCESS "w+"
+#endif
+
+RWMappedPageHeap::RWMappedPageHeap(const char* filename, unsigned nbufs, unsigned pgsize) :
+  RWVirtualPageHeap(roundPageSize(pgsize)),
+  pages_(rwnil),
+  nPages_(0),
+  maxPages_(0),
+  freeHandle_(0),
+  segments_(rwnil),
+  nSegments_(0),
+  maxSegments_(0),
+  pagesPerSegment_(1),
+  nBuffers_(nbufs),
+  resident_(rwnil),
+  freeSlots_(rwnil),
+  nFree_(nbufs),
+  hand_(0),
+  victims_(rwnil),
+  tempfp_(0)
+{
+  RWPRECONDITION2(nbufs, "RWMappedPageHeap::RWMappedPageHeap(): Number of buffers must be greater than zero");
+  RWPRECONDITION2(pgsize,"RWMappedPageHeap::RWMappedPageHeap(): Page size must be greater than zero");
+
+  if (segmentSize_ > pageSize()) pagesPerSegment_ = (unsigned)(segmentSize_ / pageSize());
+
+  resident_  = new RWHandle[nBuffers_];
+  freeSlots_ = new unsigned[nBuffers_];
+  victims_   = new RWHandle[nBuffers_/8 + 1];
+  for (register unsigned i=0; i<nBuffers_; i++) {
+    resident_[i]  = 0;
+    freeSlots_[i] = nBuffers_-1-i;	// Hand out the slots in order
+  }
+
+#ifdef RW_MAPPED_PAGES
+  tempfp_ = filename ? fopen(filename, ACCESS) : tmpfile();
+#endif
+}
+
+RWMappedPageHeap::~RWMappedPageHeap()
+{
+#ifdef RWDEBUG
+  for (unsigned i=0; i<nPages_; i++) {
+    if (pages_[i].used) {
+      RWTHROW(RWInternalErr(RWMessage(RWTOOL_ALLOCOUT, "RWMappedPageHeap")));
+    }
+  }
+#endif
+#ifdef RW_MAPPED_PAGES
+  for (unsigned iseg=0; iseg<nSegments_; iseg++)
+    munmap(segments_[iseg], (size_t)pagesPerSegment_*pageSize());
+#endif
+  if (tempfp_) fclose(tempfp_);
+  RWVECTOR_DELETE(nBuffers_/8 + 1) victims_;
+  RWVECTOR_DELETE(nBuffers_) freeSlots_;
+  RWVECTOR_DELETE(nBuffers_) resident_;
+  RWVECTOR_DELETE(maxSegments_) segments_;
+  RWVECTOR_DELETE(maxPages_) pages_;
+}
+
+RWHandle
+RWMappedPageHeap::allocate()
+{
+  RWPRECONDITION2(isValid(), "RWMappedPageHeap::allocate(): RWMappedPageHeap is invalid");
+  RWHandle h = freeHandle_;
+  if (h)
+    freeHandle_ = pages_[h-1].nextFree;
+  else {
+    // Extend the page table:
+    if (nPages_ == maxPages_) {
+      unsigned newMax = maxPages_ + handleIncrement_;
+      RWMappedPage* newPages = new RWMappedPage[newMax];
+      if (nPages_) memcpy(newPages, pages_, nPages_*sizeof(RWMappedPage));
+      RWVECTOR_DELETE(maxPages_) pages_;
+      pages_    = newPages;
+      maxPages_ = newMax;
+    }
+    // ... and the file:
+    if (nPages_ == nSegments_*pagesPerSegment_ && !mapSegment()) {
+      RWTHROW(RWExternalErr(RWMessage(RWTOOL_WRITEERR)));
+    }
+    h = ++nPages_;
+  }
+
+  RWMappedPage& page = pages_[h-1];
+  page.slot       = noSlot;
+  page.nextFree   = 0;
+  page.lockCount  = 0;
+  page.referenced = FALSE;
+  page.dirty      = FALSE;
+  page.used       = TRUE;
+  return h;
+}
+
+/*
+ * The contents of a deallocated page are thrown away without being
+ * written back.
+ */
+void
+RWMappedPageHeap::deallocate(RWHandle h)
+{
+  if (h==0) return;
+  RWPRECONDITION2(handleValid(h), "RWMappedPageHeap::deallocate(RWHandle): Invalid handle");
+  RWMappedPage& page = pages_[h-1];
+  if (page.slot != noSlot) {
+    resident_[page.slot] = 0;
+    freeSlots_[nFree_++] = page.slot;
+#ifdef RW_MAPPED_PAGES
+    madvise(addressOfHandle(h), pageSize(), MADV_DONTNEED);
+#endif
+  }
+  page.slot     = noSlot;
+  page.used     = FALSE;
+  page.nextFree = freeHandle_;
+  freeHandle_   = h;
+}
+
+void
+RWMappedPageHeap::dirty(RWHandle h)
+{
+  RWPRECONDITION2(handleValid(h), "RWMappedPageHeap::dirty(RWHandle): Invalid handle");
+  if (pages_[h-1].lockCount==0) {
+    RWTHROW(RWInternalErr(RWMessage(RWTOOL_UNLOCK)));
+  }
+  pages_[h-1].dirty = TRUE;
+}
+
+void*
+RWMappedPageHeap::lock(RWHandle h)
+{
+  RWPRECONDITION2(isValid(), "RWMappedPageHeap::lock(RWHandle): RWMappedPageHeap is invalid");
+  RWPRECONDITION2(handleValid(h) && h, "RWMappedPageHeap::lock(RWHandle): Invalid handle");
+
+  stats_.locks++;
+  RWMappedPage& page = pages_[h-1];
+  if (page.slot != noSlot)
+    stats_.lockHits++;
+  else if (!makeResident(h))
+    return rwnil;
+  page.lockCount++;
+  page.referenced = TRUE;
+  return addressOfHandle(h);
+}
+
+void
+RWMappedPageHeap::unlock(RWHandle h)
+{
+  RWPRECONDITION2(handleValid(h) && h, "RWMappedPageHeap::unlock(RWHandle): Invalid handle");
+  if (pages_[h-1].lockCount==0) {
+    RWTHROW(RWInternalErr(RWMessage(RWTOOL_UNLOCK)));
+  }
+  pages_[h-1].lockCount--;
+}
+
+/*
+ * Start reading in a page which is not resident.  It does not take a
+ * slot until it is locked.
+ */
+void
+RWMappedPageHeap::prefetch(RWHandle h)
+{
+  RWPRECONDITION2(handleValid(h), "RWMappedPageHeap::prefetch(RWHandle): Invalid handle");
+#ifdef RW_MAPPED_PAGES
+  if (h && pages_[h-1].slot == noSlot)
+    madvise(addressOfHandle(h), pageSize(), MADV_WILLNEED);
+#endif
+}
+
+/*
+ * Write back every dirty page which is resident, in runs of adjacent
+ * pages.  The pages stay resident.
+ */
+void
+RWMappedPageHeap::flush()
+{
+#ifdef RW_MAPPED_PAGES
+  RWHandle h = 1;
+  while (h <= nPages_) {
+    if (!pages_[h-1].dirty) { h++; continue; }
+    RWHandle first = h;
+    do {
+      pages_[h-1].dirty = FALSE;
+      stats_.swapOuts++;
+      h++;
+    } while (h <= nPages_ && pages_[h-1].dirty && (h-1) % pagesPerSegment_);
+    msync(addressOfHandle(first), (size_t)(h-first)*pageSize(), MS_SYNC);
+  }
+#endif
+}
+
+/************************************************
+ *						*
+ *		PROTECTED FUNCTIONS		*
+ *						*
+ ************************************************/
+
+RWBoolean
+RWMappedPageHeap::handleValid(RWHandle h) const
+{
+  if (h==0) return TRUE;
+  return h <= nPages_ && pages_[h-1].used;
+}
+
+char*
+RWMappedPageHeap::addressOfHandle(RWHandle h) const
+{
+  unsigned ipage = h-1;
+  return segments_[ipage/pagesPerSegment_] + (size_t)(ipage%pagesPerSegment_)*pageSize();
+}
+
+RWoffset
+RWMappedPageHeap::offsetOfHandle(RWHandle h) const
+{
+  return (RWoffset)(h-1) * (RWoffset)pageSize();
+}
+
+/*
+ * Extend the swap file by a segment and map it.  The file is sparse:
+ * disk space is only taken by pages which are written.
+ */
+RWBoolean
+RWMappedPageHeap::mapSegment()
+{
+#ifdef RW_MAPPED_PAGES
+  if (nSegments_ == maxSegments_) {
+    unsigned newMax = maxSegments_ ? 2*maxSegments_ : 8;
+    char** newSegments = new char*[newMax];
+    for (register unsigned i=0; i<nSegments_; i++) newSegments[i] = segments_[i];
+    RWVECTOR_DELETE(maxSegments_) segments_;
+    segments_    = newSegments;
+    maxSegments_ = newMax;
+  }
+
+  size_t length = (size_t)pagesPerSegment_*pageSize();
+  off_t  offset = (off_t)nSegments_*(off_t)length;
+  int fd = fileno(tempfp_);
+  if (ftruncate(fd, offset + (off_t)length) < 0) return FALSE;
+  void* p = mmap(rwnil, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, offset);
+  if (p == MAP_FAILED) {
+    ftruncate(fd, offset);
+    return FALSE;
+  }
+  segments_[nSegments_++] = (char*)p;
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * Give the page a slot in the clock, swapping out a batch of others
+ * if there is none free.  The whole page is read in at once rather
+ * than a fault at a time.
+ */
+RWBoolean
+RWMappedPageHeap::makeResident(RWHandle h)
+{
+  if (nFree_ == 0) swapOutBatch();
+  if (nFree_ == 0) return FALSE;		// Everything is locked
+
+  unsigned islot = freeSlots_[--nFree_];
+  resident_[islot] = h;
+  pages_[h-1].slot = islot;
+  stats_.swapIns++;
+#ifdef RW_MAPPED_PAGES
+  madvise(addressOfHandle(h), pageSize(), MADV_WILLNEED);
+#endif
+  return TRUE;
+}
+
+/*
+ * Move the clock hand round, taking up to an eighth of the slots
+ * from pages which are not locked and have not been used since the
+ * hand last passed.  Two turns are enough unless all are locked.
+ */
+void
+RWMappedPageHeap::swapOutBatch()
+{
+  unsigned batch = nBuffers_/8 + 1;
+  unsigned n = 0;
+  for (register unsigned steps = 2*nBuffers_; steps > 0 && n < batch; steps--) {
+    unsigned islot = hand_;
+    if (++hand_ == nBuffers_) hand_ = 0;
+    RWHandle h = resident_[islot];
+    if (h == 0) continue;
+    RWMappedPage& page = pages_[h-1];
+    if (page.lockCount) continue;
+    if (page.referenced) {
+      page.referenced = FALSE;
+      continue;
+    }
+    resident_[islot] = 0;
+    freeSlots_[nFree_++] = islot;
+    page.slot = noSlot;
+    victims_[n++] = h;
+  }
+  stats_.evictions += n;
+  if (n) release(victims_, n);
+}
+
+/*
+ * Drop the given pages from memory, first writing back those which
+ * are dirty.  The handles are sorted so that adjacent pages go as one
+ * run: one msync() writes all of the dirty pages in it, and one
+ * madvise() and posix_fadvise() drop it from the address space and
+ * the page cache.
+ */
+void
+RWMappedPageHeap::release(RWHandle* h, unsigned n)
+{
+  register unsigned i, j;
+  for (i=1; i<n; i++) {		// Insertion sort; batches are small
+    RWHandle t = h[i];
+    for (j=i; j>0 && h[j-1]>t; j--) h[j] = h[j-1];
+    h[j] = t;
+  }
+
+  for (i=0; i<n; i=j) {
+    RWBoolean anyDirty = FALSE;
+    // Extend the run while the next page follows on in the same segment:
+    for (j=i; j<n; j++) {
+      if (j>i && (h[j] != h[j-1]+1 || (h[j]-1) % pagesPerSegment_ == 0)) break;
+      RWMappedPage& page = pages_[h[j]-1];
+      if (page.dirty) {
+	anyDirty = TRUE;
+	stats_.swapOuts++;
+	page.dirty = FALSE;
+      }
+    }
+#ifdef RW_MAPPED_PAGES
+    char*  addr   = addressOfHandle(h[i]);
+    size_t length = (size_t)(j-i)*pageSize();
+    if (anyDirty) msync(addr, length, MS_SYNC);
+    madvise(addr, length, MADV_DONTNEED);
+#  ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fileno(tempfp_), (off_t)offsetOfHandle(h[i]), (off_t)length,
+		  POSIX_FADV_DONTNEED);
+#  endif
+#endif
+  }
+}
+
+/************************************************
+ *						*
+ *		PRIVATE FUNCTIONS		*
+ *						*
+ ************************************************/
+
+// Pages must start on a boundary of the system's pages.
+unsigned
+RWMappedPageHeap::roundPageSize(unsigned pgsize)
+{
+#ifdef RW_MAPPED_PAGES
+  unsigned sys = (unsigned)sysconf(_SC_PAGESIZE);
+  if (pgsize % sys) pgsize += sys - pgsize % sys;
+#endif
+  return pgsize;
+}
@@ -89,6 +89,10 @@
  */
 
 #include "rw/mempool.h"
+#ifdef RW_MULTI_THREAD
+#  include "rw/mutex.h"
+#  include "rw/instmgr.h"
+#endif
 
 RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: mempool.cpp,v $ $Revision: 6.4 $ $Date: 1994/07/18 20:51:00 $");
 
@@ -103,48 +107,250 @@ RW_RCSID("Copyright (C) Rogue Wave Software --- $RCSfile: mempool.cpp,v $ $Revis
  */
 
 // If not a 16bitDLL and not memcheck and not debug.
-// If following changes, also change #if in mempool.h
 #if !(defined(_RWTOOLSDLL) && defined(__WIN16__)) && !defined(RWMEMCK) && !defined(RWDEBUG) 
 
 /*
- * The following two static member data are guaranteed to be initialized
- * to zero by the language.  This is crucial for "nstash".
+ * A magazine holds up to RWPOOLSIZE free objects of one size class.
+ * The depot keeps, for each class, a stack of full magazines and one
+ * of empty ones, and the slab being cut up.  A cache holds a thread's
+ * two magazines for each class: "loaded", which allocations take from
+ * and frees go to, and "previous", which is kept either full or empty
+ * so that a thread alternating between allocating and freeing around
+ * a magazine boundary does not go to the depot each time.
+ */
+struct RWPoolMagazine
+{
+  RWPoolMagazine*	next_;
+  int			n_;
+  void*			obj_[RWPOOLSIZE];
+};
+
+struct RWPoolDepot
+{
+  RWPoolMagazine*	full_;
+  RWPoolMagazine*	empty_;
+  char*			slab_;		// Next object to be cut from the slab
+  char*			slabEnd_;
+};
+
+struct RWPoolCache
+{
+  RWPoolMagazine*	loaded_[RWMAXPOOLS];
+  RWPoolMagazine*	previous_[RWMAXPOOLS];
+};
+
+/*
+ * Static data are guaranteed to be initialized to zero by the
+ * language, so the depot, and the cache of a single threaded
+ * program, are ready before any constructor has run.
+ */
+static RWPoolDepot rwPoolDepot[RWMAXPOOLS];
+
+#ifdef RW_MULTI_THREAD
+
+static RWMutex rwPoolLock(RWMutex::staticCtor);
+
+/*
+ * The caches are found through a static instance manager.  Until it
+ * has been constructed, which happens before any other thread can be
+ * started, ready_ is still zero and objects come straight from the
+ * operating system, at the full size of their class so that they can
+ * join it when freed.
+ */
+class RWPoolCacheManager : public RWInstanceManager
+{
+public:
+  RWPoolCacheManager() : ready_(TRUE) { }
+  virtual void rwfar*	newValue();
+  virtual void		deleteValue(void rwfar*);
+  RWBoolean		ready_;
+};
+
+static RWPoolCacheManager rwPoolCaches;
+
+#else
+
+static RWPoolCache rwPoolCache;
+
+#endif
+
+// The size class of an object of sz bytes:
+static inline int
+rwPoolClass(size_t sz)
+{
+  return sz ? (int)((sz - 1) / RWPOOLGRAIN) : 0;
+}
+
+static RWPoolMagazine*
+rwPoolEmptyMagazine(RWPoolDepot& d)
+{
+  RWPoolMagazine* m = d.empty_;
+  if (m) d.empty_ = m->next_;
+  else   m = ::new RWPoolMagazine;
+  m->n_ = 0;
+  return m;
+}
+
+/*
+ * Return a full magazine: one from the depot, if it has one, else one
+ * filled with objects cut from the slab.  Called with the lock held.
  */
-void* RWMemoryPool::stash[RWMAXPOOLS][RWPOOLSIZE];
-short RWMemoryPool::nstash[RWMAXPOOLS];
+static RWPoolMagazine*
+rwPoolFullMagazine(RWPoolDepot& d, int slot)
+{
+  RWPoolMagazine* m = d.full_;
+  if (m) {
+    d.full_ = m->next_;
+    return m;
+  }
+  size_t sz = (size_t)(slot+1) * RWPOOLGRAIN;
+  m = rwPoolEmptyMagazine(d);
+  while (m->n_ < RWPOOLSIZE) {
+    if (d.slab_ + sz > d.slabEnd_) {
+      size_t slabsz = sz*RWPOOLSIZE > RWPOOLSLAB ? sz*RWPOOLSIZE : RWPOOLSLAB;
+      d.slab_ = ::new char[slabsz];
+      d.slabEnd_ = d.slab_ + slabsz;
+    }
+    m->obj_[m->n_++] = d.slab_;
+    d.slab_ += sz;
+  }
+  return m;
+}
+
+static void
+rwPoolPutMagazine(RWPoolMagazine*& list, RWPoolMagazine* m)
+{
+  m->next_ = list;
+  list = m;
+}
+
+#ifdef RW_MULTI_THREAD
+
+void rwfar*
+RWPoolCacheManager::newValue()
+{
+  RWPoolCache* c = ::new RWPoolCache;
+  for (register int i=0; i<RWMAXPOOLS; i++)
+    c->loaded_[i] = c->previous_[i] = rwnil;
+  return c;
+}
+
+// Hand the magazines of a departing thread back to the depot:
+void
+RWPoolCacheManager::deleteValue(void rwfar* v)
+{
+  RWPoolCache* c = (RWPoolCache*)v;
+  if (c == rwnil) return;
+  RWGUARD(rwPoolLock);
+  for (register int i=0; i<RWMAXPOOLS; i++) {
+    RWPoolMagazine* m[2];
+    m[0] = c->loaded_[i];
+    m[1] = c->previous_[i];
+    for (register int j=0; j<2; j++)
+      if (m[j])
+        rwPoolPutMagazine(m[j]->n_ ? rwPoolDepot[i].full_
+                                   : rwPoolDepot[i].empty_, m[j]);
+  }
+  ::delete c;
+}
+
+void
+RWMemoryPool::releaseCache()
+{
+  if (rwPoolCaches.ready_) rwPoolCaches.freeValue();
+}
+
+static RWPoolCache*
+rwPoolCurrentCache()
+{
+  if (!rwPoolCaches.ready_) return rwnil;
+  RWPoolCache* c = (RWPoolCache*)rwPoolCaches.currentValue();
+  return c ? c : (RWPoolCache*)rwPoolCaches.addValue();
+}
+
+#else
+
+// The only thread keeps its magazines.
+void
+RWMemoryPool::releaseCache()
+{
+}
+
+static inline RWPoolCache*
+rwPoolCurrentCache()
+{
+  return &rwPoolCache;
+}
+
+#endif
 
 void*
 RWMemoryPool::operator new(size_t sz)
 {
-  // Round the size up to an even number:
-  sz = (sz+1) & ~0x1;
-  // Divide by two, then subtract one to get the slot number:
-  int slot = (sz >> 1) - 1;
+  int slot = rwPoolClass(sz);
+
+  // If this object is too big for us to handle, call the global new
+  // operator:
+  if (slot >= RWMAXPOOLS) return ::new char[sz];
 
-  // If this object is small enough for us to handle and there is an available
-  // allocation, return it.  Otherwise call the global new operator:
-  return slot < RWMAXPOOLS && nstash[slot] ? stash[slot][--nstash[slot]] : ::new char[sz];
+  RWPoolCache* c = rwPoolCurrentCache();
+  if (c == rwnil) return ::new char[(slot+1)*RWPOOLGRAIN];
+  RWPoolMagazine* m = c->loaded_[slot];
+  if (m == rwnil || m->n_ == 0) {
+    RWPoolMagazine* p = c->previous_[slot];
+    if (p && p->n_) {			// previous is full: swap
+      c->previous_[slot] = m;
+      c->loaded_[slot] = m = p;
+    }
+    else {				// Trade an empty one for a full one
+      RWGUARD(rwPoolLock);
+      RWPoolDepot& d = rwPoolDepot[slot];
+      if (p) rwPoolPutMagazine(d.empty_, p);
+      c->previous_[slot] = m;
+      c->loaded_[slot] = m = rwPoolFullMagazine(d, slot);
+    }
+  }
+  return m->obj_[--m->n_];
 }
 
 void
 RWMemoryPool::operator delete(void* p, size_t sz)
 {
-  // enforce sz is even, to match operator new(), as required for some
-  // compilers.
-   sz = (sz+1) & ~0x1;
-  // Divide by two and subtract one to get the slot number:
-  int slot = (sz >> 1) - 1;
+  int slot = rwPoolClass(sz);
+
+  if (slot >= RWMAXPOOLS) {
+    ::delete p;
+    return;
+  }
 
-  if(slot >= RWMAXPOOLS || nstash[slot] >= RWPOOLSIZE)
+  RWPoolCache* c = rwPoolCurrentCache();
+  if (c == rwnil) {
     ::delete p;
-  else
-    stash[slot][nstash[slot]++] = p;
+    return;
+  }
+  RWPoolMagazine* m = c->loaded_[slot];
+  if (m == rwnil || m->n_ == RWPOOLSIZE) {
+    RWPoolMagazine* q = c->previous_[slot];
+    if (q && q->n_ == 0) {		// previous is empty: swap
+      c->previous_[slot] = m;
+      c->loaded_[slot] = m = q;
+    }
+    else {				// Trade a full one for an empty one
+      RWGUARD(rwPoolLock);
+      RWPoolDepot& d = rwPoolDepot[slot];
+      if (q) rwPoolPutMagazine(d.full_, q);
+      c->previous_[slot] = m;
+      c->loaded_[slot] = m = rwPoolEmptyMagazine(d);
+    }
+  }
+  m->obj_[m->n_++] = p;
 }
 
 #else
 
   void* RWMemoryPool::operator new(size_t sz)           { return ::new char[sz]; }
   void  RWMemoryPool::operator delete(void* p, size_t)  { ::delete p; }
+  void  RWMemoryPool::releaseCache()                    { }
 
 
 
@@ -173,6 +173,7 @@
 
 #include "rw/defs.h"
 #include "rw/rwfile.h"
+#include "rw/filelog.h"
 #include "rw/rwerr.h"
 #include "rw/coreerr.h"
 
@@ -193,14 +194,26 @@ STARTWRAP
 #endif
 #if defined(__SC__) || defined(__TURBOC__) || defined(RW_MSC_BACKEND) || defined(__HIGHC__) || defined(__JPI__) || defined(__IBMCPP__) && !defined(THINK_CPLUS)
 #  include <io.h>	/* Looking for access() and unlink() in here. */
-#else
+#elif !defined(unix)		/* else <unistd.h>, below */
    extern "C" {
      int access(const char*, int);
      int unlink(const char*); /* remove() may be more portable in the future */
    }
 #endif
 #ifdef unix
+#  include <unistd.h>
 #  include <fcntl.h>
+#  include <errno.h>
+#  ifndef RW_NO_PREAD
+#    define RW_POSITIONED_IO 1	/* pread() and pwrite() */
+#  endif
+#  ifndef RW_NO_MMAP
+#    define RW_MAPPED_FILE 1
+#    include <sys/mman.h>
+#    if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#      define MAP_ANONYMOUS MAP_ANON
+#    endif
+#  endif
 #endif
 ENDWRAP
 
@@ -229,10 +242,14 @@ ENDWRAP
 # endif
 #endif
 
-#define READ(s)			fread((char*)&s, sizeof(s), 1, filep)
-#define READVEC(s,count) 	fread((char*)s, sizeof(*s), count, filep)
-#define WRITE(s)		fwrite((char*)&s, sizeof(s), 1, filep)
-#define WRITEVEC(s,count)	fwrite((const char*) s, sizeof(*s), count, filep)
+#define READ(s)			rawRead((char*)&s, sizeof(s), 1)
+#define READVEC(s,count) 	rawRead((char*)s, sizeof(*s), count)
+#define WRITE(s)		rawWrite((char*)&s, sizeof(s), 1)
+#define WRITEVEC(s,count)	rawWrite((const char*) s, sizeof(*s), count)
+
+// Smallest amount by which a mapping is grown.  A multiple of any
+// reasonable page size.
+static const long mapQuantum = 65536L;
 
 #ifdef RW_CRLF_CONVENTION
   static const char* updateMode = "rb+";
@@ -245,8 +262,27 @@ ENDWRAP
 RWFile::RWFile(const char* name, const char* mode)
  : filename(rwnil),
    filep(rwnil),
-   access_mode(0)
+   access_mode(0),
+   map_base(rwnil),
+   map_length(0),
+   map_size(0),
+   map_pos(0),
+   log_(rwnil),
+   stdio_state(0),
+   timing_(FALSE)
 {
+  if (name == rwnil)
+  {
+    // In memory: permanently "mapped", with no file behind it.
+    filename = new char [1];
+    filename[0] = '\0';
+    if ((map_base = memoryAlloc(mapQuantum)) != rwnil)
+      map_length = mapQuantum;
+#ifdef unix
+    access_mode = O_RDWR;
+#endif
+    return;
+  }
   if (mode)
     filep = fopen(name, mode);
   else
@@ -266,11 +302,19 @@ RWFile::RWFile(const char* name, const char* mode)
 
 RWFile::~RWFile()
 {
+  delete log_;
+  if (isInMemory())
+    memoryFree(map_base, map_length);
+  else
+    UnmapFile();
   if (filep != NULL) fclose(filep);
   RWVECTOR_DELETE( strlen(filename)+1 ) filename;
 }
 
-RWBoolean RWFile::Exists() { return rwaccess(filename, 0) >= 0; }
+RWBoolean RWFile::Exists()
+{
+  return isInMemory() || rwaccess(filename, 0) >= 0;
+}
 
 RWBoolean RWFile::Exists(const char* name)
 {
@@ -336,8 +380,19 @@ RWBoolean RWFile::Read(char rwhuge* p, unsigned long N)
 RWBoolean RWFile::Read(char* string)
 {
   int c;
+  if (!log_ && !isMapped())
+  {
+    RWGUARD(stateLock_);
+    stdio_state |= stdioRead;
+  }
   while (1) {
-    c = fgetc(filep);
+    char ch;
+    if (log_)
+      c = log_->read(&ch, 1) ? (unsigned char)ch : EOF;
+    else if (isMapped())
+      c = map_pos<map_size ? (unsigned char)map_base[map_pos++] : EOF;
+    else
+      c = fgetc(filep);
     if( c==EOF || c=='\0') break;
     *string++ = (char)c;
   }
@@ -411,15 +466,34 @@ RWBoolean RWFile::Write(const char* string) {
  *								*
  ****************************************************************/
 
-long RWFile::CurOffset() { return ftell(filep); }
+long RWFile::CurOffset()
+{
+  if (log_) return log_->tell();
+  return isMapped() ? map_pos : ftell(filep);
+}
 
-RWBoolean RWFile::Eof()   { return feof(filep); }
+RWBoolean RWFile::Eof()
+{
+  if (log_) return log_->eof();
+  return isMapped() ? map_pos >= map_size : feof(filep);
+}
 
 #if defined(VMS) || ( defined(__HIGHC__) && defined(__OS2__) )
 #define unlink(file) remove(file)
 #endif
 
 RWBoolean RWFile::Erase() {
+  if (log_) return FALSE;		// Would defeat the log
+  if (isInMemory())
+  {
+    map_size = map_pos = 0;
+    return TRUE;
+  }
+  UnmapFile();
+  {
+    RWGUARD(stateLock_);
+    stdio_state = 0;
+  }
   return fclose(filep) != EOF && unlink(filename) == 0 && 
 #ifdef RW_CRLF_CONVENTION
       (filep = fopen(filename, "wb+")) != NULL;
@@ -432,11 +506,25 @@ RWBoolean RWFile::Erase() {
 #undef unlink
 #endif
 
-RWBoolean RWFile::Error()  { return ferror(filep); }
+RWBoolean RWFile::Error()  { return filep ? ferror(filep) : FALSE; }
 
-RWBoolean RWFile::Flush() { return fflush(filep) != EOF; }
+RWBoolean RWFile::Flush() {
+  // With a log, nothing goes to the file until committed:
+  if (log_ || isInMemory()) return TRUE;
+#ifdef RW_MAPPED_FILE
+  // Data written to a shared mapping is already in the system's
+  // buffers, just as it is after an fflush().  Schedule it for writing.
+  if (isMapped())
+    return isReadOnly() || msync(map_base, (size_t)map_length, MS_ASYNC) == 0;
+#endif
+  RWGUARD(stateLock_);
+  stdio_state &= ~stdioWritten;
+  return fflush(filep) != EOF;
+}
 
 RWBoolean RWFile::IsEmpty() {
+  if (log_) return log_->size() == 0;
+  if (isMapped()) return map_size == 0;
 #if defined(__OREGON__) || defined(applec)
   int dummy;
   int nb;
@@ -453,8 +541,33 @@ RWBoolean RWFile::IsEmpty() {
 #endif
 }
 
-RWBoolean RWFile::SeekTo(long offset) { return fseek(filep, offset, 0) >= 0; }	
-RWBoolean RWFile::SeekToEnd()         { return fseek(filep, 0, 2) >= 0; }
+RWBoolean RWFile::SeekTo(long offset)
+{
+  if (log_) return log_->seek(offset);
+  if (isMapped())
+  {
+    if (offset < 0) return FALSE;
+    map_pos = offset;
+    return TRUE;
+  }
+  // Seeking pushes out pending output:
+  RWGUARD(stateLock_);
+  stdio_state &= ~stdioWritten;
+  return fseek(filep, offset, 0) >= 0;
+}
+
+RWBoolean RWFile::SeekToEnd()
+{
+  if (log_) return log_->seek(log_->size());
+  if (isMapped())
+  {
+    map_pos = map_size;
+    return TRUE;
+  }
+  RWGUARD(stateLock_);
+  stdio_state &= ~stdioWritten;
+  return fseek(filep, 0, 2) >= 0;
+}
 
 RWBoolean RWFile::isReadOnly() {
 #ifdef unix
@@ -480,3 +593,420 @@ RWBoolean RWFile::isReadWrite() {
 #endif
 }
 
+
+/****************************************************************
+ *								*
+ *			Memory mapping				*
+ *								*
+ ****************************************************************/
+
+/*
+ * Switch the file over to a memory mapping.  Only files open for
+ * reading, or for reading and writing, can be mapped.  The current
+ * position is carried over.
+ */
+RWBoolean RWFile::MapFile()
+{
+#ifdef RW_MAPPED_FILE
+  if (isMapped()) return TRUE;
+  if (log_ || filep == rwnil || !(isReadOnly() || isReadWrite())) return FALSE;
+  if (fflush(filep) == EOF) return FALSE;
+
+  struct stat statbuf;
+  if (fstat(fileno(filep), &statbuf) < 0) return FALSE;
+  long size = (long)statbuf.st_size;
+  long pos  = ftell(filep);
+
+  // A read-only mapping cannot be grown, so it must cover the whole
+  // file and cannot be empty:
+  long length = size;
+  if (!isReadOnly())
+  {
+    length = mapQuantum;
+    while (length < size) length <<= 1;
+    if (ftruncate(fileno(filep), (off_t)length) < 0) return FALSE;
+  }
+  else if (length == 0)
+    return FALSE;
+
+  void* p = mmap(rwnil, (size_t)length,
+		 isReadOnly() ? PROT_READ : PROT_READ|PROT_WRITE,
+		 MAP_SHARED, fileno(filep), 0);
+  if (p == MAP_FAILED)
+  {
+    if (!isReadOnly()) ftruncate(fileno(filep), (off_t)size);
+    return FALSE;
+  }
+
+  map_base   = (char*)p;
+  map_length = length;
+  map_size   = size;
+  map_pos    = pos;
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * Drop the mapping.  The file is cut back to its logical size and
+ * stdio picks up at the current position.
+ */
+void RWFile::UnmapFile()
+{
+#ifdef RW_MAPPED_FILE
+  if (!isMapped() || isInMemory()) return;
+  munmap(map_base, (size_t)map_length);
+  if (!isReadOnly()) ftruncate(fileno(filep), (off_t)map_size);
+  map_base   = rwnil;
+  map_length = 0;
+  fseek(filep, map_pos, 0);
+#endif
+}
+
+/*
+ * Make sure that the first "size" bytes of the file are addressable
+ * through the mapping.  Does not change the logical size of the file.
+ * The mapping is grown geometrically, so the cost is amortized.
+ */
+RWBoolean RWFile::GrowMap(long size)
+{
+  if (!isMapped()) return FALSE;
+  if (size <= map_length) return TRUE;
+  if (isInMemory())
+  {
+    long length = map_length;
+    while (length < size) length <<= 1;
+    char* p = memoryAlloc(length);
+    if (p == rwnil) return FALSE;
+    memcpy(p, map_base, (size_t)map_size);
+    memoryFree(map_base, map_length);
+    map_base   = p;
+    map_length = length;
+    return TRUE;
+  }
+#ifdef RW_MAPPED_FILE
+  if (isReadOnly()) return FALSE;
+
+  long length = map_length;
+  while (length < size) length <<= 1;
+  if (ftruncate(fileno(filep), (off_t)length) < 0) return FALSE;
+  void* p = mmap(rwnil, (size_t)length, PROT_READ|PROT_WRITE,
+		 MAP_SHARED, fileno(filep), 0);
+  if (p == MAP_FAILED) return FALSE;
+  munmap(map_base, (size_t)map_length);
+  map_base   = (char*)p;
+  map_length = length;
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * Returns the address of the N bytes at "offset", or rwnil if the
+ * file is not mapped or they lie (partly) beyond the end of the file.
+ */
+char* RWFile::MappedAddress(long offset, size_t N) const
+{
+  if (!isMapped() || offset < 0 || offset + (long)N > map_size)
+    return rwnil;
+  return map_base + offset;
+}
+
+RWBoolean RWFile::SaveAs(const char* name)
+{
+  if (!isMapped() || log_) return FALSE;
+  FILE* fp = fopen(name, newMode);
+  if (fp == NULL) return FALSE;
+  RWBoolean ok = map_size == 0 ||
+    fwrite(map_base, (size_t)map_size, 1, fp) == 1;
+  if (fclose(fp) == EOF) ok = FALSE;
+  return ok;
+}
+
+/*
+ * The region behind a file in memory.  Anonymous pages where there
+ * are such things, so that what has not been written to costs nothing.
+ */
+char* RWFile::memoryAlloc(long length)
+{
+#if defined(RW_MAPPED_FILE) && defined(MAP_ANONYMOUS)
+  void* p = mmap(rwnil, (size_t)length, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? rwnil : (char*)p;
+#else
+  return new char[length];
+#endif
+}
+
+void RWFile::memoryFree(char* p, long length)
+{
+#if defined(RW_MAPPED_FILE) && defined(MAP_ANONYMOUS)
+  munmap(p, (size_t)length);
+#else
+  RWVECTOR_DELETE(length) p;
+#endif
+}
+
+/*
+ * Cut the file back to "size" bytes.  Not while it is logged: the log
+ * may still hold changes beyond that point.  A mapped file is only cut
+ * back when it is unmapped.
+ */
+RWBoolean RWFile::Truncate(long size)
+{
+  if (!isValid() || log_ || size < 0 || isReadOnly()) return FALSE;
+  if (isMapped())
+  {
+    if (size < map_size) map_size = size;
+    return TRUE;
+  }
+#ifdef unix
+  // Nothing buffered may outlive the cut:
+  RWGUARD(stateLock_);
+  if (fflush(filep) == EOF) return FALSE;
+  stdio_state = 0;
+  return ftruncate(fileno(filep), (off_t)size) == 0;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * Readahead hint.  A mapping shares the system's page cache with the
+ * descriptor, so the same advice serves both.
+ */
+void RWFile::Prefetch(long offset, long N)
+{
+  if (filep == rwnil || offset < 0 || N <= 0) return;
+#if defined(unix) && defined(POSIX_FADV_WILLNEED)
+  posix_fadvise(fileno(filep), (off_t)offset, (off_t)N, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+ * All of the stream functions come here, to be counted and timed.
+ */
+size_t RWFile::rawRead(void* p, size_t size, size_t count)
+{
+  unsigned long t0 = timing_ ? RWLatencyHistogram::now() : 0;
+  size_t n = streamRead(p, size, count);
+  countRead(n*size, t0);
+  return n;
+}
+
+size_t RWFile::rawWrite(const void* p, size_t size, size_t count)
+{
+  unsigned long t0 = timing_ ? RWLatencyHistogram::now() : 0;
+  size_t n = streamWrite(p, size, count);
+  countWrite(n*size, t0);
+  return n;
+}
+
+/*
+ * ReadAt() may be called from several threads at once (see
+ * sharesReads()), so the counts are only kept under the lock.
+ */
+void RWFile::countRead(size_t bytes, unsigned long t0)
+{
+  unsigned long t = timing_ ? RWLatencyHistogram::now() - t0 : 0;
+  RWGUARD(stateLock_);
+  stats_.reads++;
+  stats_.bytesRead += bytes;
+  if (timing_) stats_.readTime.record(t);
+}
+
+void RWFile::countWrite(size_t bytes, unsigned long t0)
+{
+  unsigned long t = timing_ ? RWLatencyHistogram::now() - t0 : 0;
+  RWGUARD(stateLock_);
+  stats_.writes++;
+  stats_.bytesWritten += bytes;
+  if (timing_) stats_.writeTime.record(t);
+}
+
+size_t RWFile::streamRead(void* p, size_t size, size_t count)
+{
+  if (log_)
+    return log_->read(p, size*count) / size;
+  if (!isMapped())
+  {
+    {
+      RWGUARD(stateLock_);
+      stdio_state |= stdioRead;
+    }
+    return fread((char*)p, size, count, filep);
+  }
+
+  long avail = map_size - map_pos;
+  if (avail <= 0) return 0;
+  if ((long)(size*count) > avail) count = (size_t)avail / size;
+  memcpy(p, map_base + map_pos, size*count);
+  map_pos += (long)(size*count);
+  return count;
+}
+
+size_t RWFile::streamWrite(const void* p, size_t size, size_t count)
+{
+  if (log_)
+    return log_->write(p, size*count) / size;
+  if (!isMapped())
+  {
+    {
+      RWGUARD(stateLock_);
+      stdio_state |= stdioWritten;
+    }
+    return fwrite((const char*)p, size, count, filep);
+  }
+
+  long end = map_pos + (long)(size*count);
+  if (!GrowMap(end)) return 0;
+  memcpy(map_base + map_pos, p, size*count);
+  map_pos = end;
+  if (end > map_size) map_size = end;
+  return count;
+}
+
+/****************************************************************
+ *								*
+ *			Positioned I/O				*
+ *								*
+ ****************************************************************/
+
+RWBoolean RWFile::ReadAt(long offset, void* p, size_t N)
+{
+  if (offset < 0) return FALSE;
+  unsigned long t0 = timing_ ? RWLatencyHistogram::now() : 0;
+  size_t n;
+  if (log_)
+    n = log_->read(offset, p, N);
+  else if (!isMapped())
+    n = directRead(offset, p, N);
+  else if (offset + (long)N > map_size)
+    n = 0;
+  else
+  {
+    memcpy(p, map_base + offset, N);
+    n = N;
+  }
+  countRead(n, t0);
+  return n == N;
+}
+
+RWBoolean RWFile::WriteAt(long offset, const void* p, size_t N)
+{
+  if (offset < 0) return FALSE;
+  unsigned long t0 = timing_ ? RWLatencyHistogram::now() : 0;
+  size_t n;
+  if (log_)
+    n = log_->write(offset, p, N);
+  else if (!isMapped())
+    n = directWrite(offset, p, N);
+  else if (!GrowMap(offset + (long)N))
+    n = 0;
+  else
+  {
+    memcpy(map_base + offset, p, N);
+    if (offset + (long)N > map_size) map_size = offset + (long)N;
+    n = N;
+  }
+  countWrite(n, t0);
+  return n == N;
+}
+
+/*
+ * pread() leaves the stream alone, and the only state directRead()
+ * shares with the stream functions, stdio_state, is kept under
+ * stateLock_.  A mapping may move as it grows.
+ */
+RWBoolean RWFile::sharesReads() const
+{
+#if defined(RW_MULTI_THREAD) && defined(RW_POSITIONED_IO)
+  return !isMapped();
+#else
+  return FALSE;
+#endif
+}
+
+RWBoolean RWFile::timeIO(RWBoolean on)
+{
+  RWBoolean old = timing_;
+  timing_ = on;
+  return old;
+}
+
+/*
+ * Transfer N bytes at offset to or from the file itself, going around
+ * any log or mapping.  Returns the number of bytes moved, which is
+ * short only at end of file or on an error.  The current offset of the
+ * stream is left alone.
+ */
+size_t RWFile::directRead(long offset, void* p, size_t N)
+{
+  if (!syncStream(FALSE)) return 0;
+#ifdef RW_POSITIONED_IO
+  char*  c    = (char*)p;
+  size_t done = 0;
+  while (done < N)
+  {
+    ssize_t n = pread(fileno(filep), c + done, N - done,
+		      (off_t)(offset + (long)done));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += (size_t)n;
+  }
+  return done;
+#else
+  long pos = ftell(filep);
+  if (fseek(filep, offset, 0) < 0) return 0;
+  size_t done = fread((char*)p, 1, N, filep);
+  fseek(filep, pos, 0);
+  return done;
+#endif
+}
+
+size_t RWFile::directWrite(long offset, const void* p, size_t N)
+{
+  if (!syncStream(TRUE)) return 0;
+#ifdef RW_POSITIONED_IO
+  const char* c = (const char*)p;
+  size_t   done = 0;
+  while (done < N)
+  {
+    ssize_t n = pwrite(fileno(filep), c + done, N - done,
+		       (off_t)(offset + (long)done));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += (size_t)n;
+  }
+  return done;
+#else
+  long pos = ftell(filep);
+  if (fseek(filep, offset, 0) < 0) return 0;
+  size_t done = fwrite((const char*)p, 1, N, filep);
+  fseek(filep, pos, 0);
+  return done;
+#endif
+}
+
+/*
+ * Make the descriptor agree with the stream before going around it:
+ * push out any output the stream is holding and, ahead of a write,
+ * drop any input it has read ahead, which the write could make stale.
+ * POSIX has fflush() do the latter too; a seek will not do, as the
+ * library may keep its buffer for a seek which lands inside it.
+ */
+RWBoolean RWFile::syncStream(RWBoolean writing)
+{
+#ifdef RW_POSITIONED_IO
+  RWGUARD(stateLock_);
+  unsigned pending = writing ? stdio_state : stdio_state & stdioWritten;
+  if (pending)
+  {
+    if (fflush(filep) == EOF) return FALSE;
+    stdio_state &= ~pending;
+  }
+#endif
+  return TRUE;
+}
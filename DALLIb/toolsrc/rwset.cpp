@@ -90,7 +90,6 @@
  */
 
 #include "rw/rwset.h"
-#include "rw/slistcol.h"
 #include "defcol.h"
 #include "rw/toolerr.h"   
 
@@ -124,13 +123,9 @@ RWSet::clearAndDestroy()
 RWCollectable*
 RWSet::insert(RWCollectable* a)
 {
-  RWCollectable* ret;
-  size_t idx = hashIndex(a);
-  if (table_(idx)==rwnil || (ret=table_(idx)->find(a))==rwnil) {
-    insertIndex(idx, a);
-    ret = a;
-  }
-  return ret;
+  unsigned h = a->hash();
+  size_t i = findSlot(a, h);
+  return i==RW_NPOS ? insertHash(h, a) : table_[i].item_;
 }
 
 /*
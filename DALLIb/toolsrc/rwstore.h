@@ -74,25 +74,50 @@
  *******************  RWStoreTable declarations ***************************
  **/
 
-#include "rw/rwset.h"
+/*
+ * Maps the address of each object stored so far to its object
+ * number.  Addresses are hashed by Fibonacci hashing into a flat,
+ * open addressed table that is never more than half full.  In
+ * single threaded builds the table is kept between top level saves
+ * and reused; close() empties it, giving back any slots beyond
+ * RWSTOREKEEP.
+ */
+
+#include "rw/collect.h"
+
+const size_t RWSTOREKEEP = 16384;	// Slots kept by a closed table
+
+struct RWStoreSlot {
+  const RWCollectable*	item;		// nil if the slot is empty
+  int			objectNumber;
+};
 
-class RWExport RWStoreTable : public RWSet {
+class RWExport RWStoreTable {
 public:
-  RWStoreTable();
+  RWStoreTable(size_t expected = RWDEFAULT_CAPACITY);
   ~RWStoreTable();
   RWBoolean		add(const RWCollectable*, int&);
-};
+  size_t		entries() const	{return nitems_;}
+  void			reserve(size_t expected);	// Presize for this many objects
 
-class RWExport RWStoreEntry : public RWCollectable {
-friend class RWStoreTable;
-  const RWCollectable*	item;
-  int			objectNumber;
-public:
-  RWStoreEntry(const RWCollectable* c, int n){item=c; objectNumber=n;}
-  unsigned		hash() const;
-  RWBoolean		isEqual(const RWCollectable* c) const;
+  void			open()			{open_ = TRUE;}
+  void			close();
+  RWBoolean		isOpen() const		{return open_;}
+private:
+  RWStoreSlot*		table_;
+  unsigned		bits_;		// nslots_ == 2**bits_
+  size_t		nslots_;
+  size_t		nitems_;
+  RWBoolean		open_;		// In use by a save
+
+  void			rehash(unsigned bits);
+  size_t		homeSlot(const RWCollectable*) const;
+  void			addNil();
 };
 
+// Presizes the store table of the save in progress, if any:
+extern void		rwReserveStoreTable(size_t);
+
 /**
  *******************  RWReadTable declarations ***************************
  **/
@@ -117,4 +117,5 @@ DECLARE_MSG(SUBSTRING, 0x2010, "[SUBSTRING] Illegal substring (%d, %u) from %u e
 DECLARE_MSG(UNLOCK,    0x2011, "[UNLOCK] Improper use of locked object")
 DECLARE_MSG(WRITEERR,  0x2012, "[WRITEERR] Write error")
 DECLARE_MSG(INDEXERR,  0x2013, "[INDEXERR] Illegal Index (%u) for collection with %u elements")
+DECLARE_MSG(KEYORDER,  0x2014, "[KEYORDER] Keys not in ascending order during bulk load")
 